@@ -2,17 +2,24 @@
 #include <iostream>
 #include <cmath>
 #include <fstream>
+#include <vector>
+#include <algorithm>
 
 #include <labdev/tcpip_interface.hh>
 #include <labdev/usbtmc_interface.hh>
 #include <labdev/devices/rigol/dg4000.hh>
 #include <labdev/devices/rigol/ds1000z.hh>
+#include <labdev/utils/measurement.hh>
 
 
 using namespace labdev;
 
 void dso_setup(ds1000z* dso, bool reset = false);
 void fgen_setup(dg4000* fgen, bool reset = false);
+// Mean and standard deviation of one item over several readouts, invalid
+// (non-finite) values are skipped; returns the number of values used
+size_t get_stats(const std::vector<measurements>& meas, unsigned item,
+    double& avg, double& std);
 
 int main (int argc, char** argv) {
     // You can get the IP addresses from the menu "Utility->IO Setting"
@@ -38,10 +45,16 @@ int main (int argc, char** argv) {
         fset.push_back(freq);
     }
 
+    // Statistics of several readouts, measured on the host
+    const int nreads = 10;
+    std::vector<waveform> wfs;
+    std::vector<measurements> m1, m2;
+
     // Data storage
     double a1_avg, a1_std, a2_avg, a2_std, ph_avg, ph_std;
+    size_t nused;   // Fewest valid values of all items
     std::ofstream out_file("measurement.csv", std::ofstream::out);
-    out_file << "Freq [Hz], A1 [V], STD1[V], A2 [V], STD2[V], Phase [deg], STD Phase[deg]\n";
+    out_file << "Freq [Hz], A1 [V], STD1[V], A2 [V], STD2[V], Phase [deg], STD Phase[deg], N\n";
 
     for (const auto& f : fset) {
 
@@ -49,20 +62,36 @@ int main (int argc, char** argv) {
             // Set new frequency
             fgen.set_freq(1, f);
             fgen.wait_to_complete();
-            // CHange timescale according to frequency and reset measurements
+            // Change timescale according to frequency
             dso.set_horz_base(1./f);
-            dso.reset_measurements();
             dso.wait_to_complete();
 
-            sleep(1);   // Time to gather statistics
-
-            // Read measurements
-            a1_avg = dso.get_measurement(1, ds1000z::MEAS_VAMP, ds1000z::MEAS_AVG);
-            a1_std = dso.get_measurement(1, ds1000z::MEAS_VAMP, ds1000z::MEAS_STD);
-            a2_avg = dso.get_measurement(2, ds1000z::MEAS_VAMP, ds1000z::MEAS_AVG);
-            a2_std = dso.get_measurement(2, ds1000z::MEAS_VAMP, ds1000z::MEAS_STD);
-            ph_avg = dso.get_measurement(1, 2, ds1000z::MEAS_RPH, ds1000z::MEAS_AVG);
-            ph_std = dso.get_measurement(1, 2, ds1000z::MEAS_RPH, ds1000z::MEAS_STD);
+            // Read both channels and measure all items at once, phase of
+            // channel 1 relative to channel 2
+            m1.clear();
+            m2.clear();
+            int ntmo = 0;
+            for (int i = 0; i < nreads; i++) {
+                // Until :SING is processed the status is still the STOP
+                // of the previous readout
+                if ( !dso.single_shot_sync(1000) ||
+                     !dso.wait_for_stop(1000) ) {
+                    ntmo++;
+                    continue;
+                }
+                dso.read_channels({1, 2}, wfs);
+                std::vector<measurements> res = measure(wfs, 1);
+                m1.push_back(res[0]);
+                m2.push_back(res[1]);
+            }
+            if (ntmo)
+                printf("%.1f Hz: %i of %i readouts timed out\n", f, ntmo,
+                    nreads);
+            nused = get_stats(m1, ds1000z::MEAS_VAMP, a1_avg, a1_std);
+            nused = std::min(nused,
+                get_stats(m2, ds1000z::MEAS_VAMP, a2_avg, a2_std));
+            nused = std::min(nused,
+                get_stats(m1, ds1000z::MEAS_RPH, ph_avg, ph_std));
         } catch (const exception& ex) {
             // Save measurement and stop program
             std::cout << "Measurement failed (" << ex.what() << ")!" << std::endl;
@@ -70,13 +99,15 @@ int main (int argc, char** argv) {
             throw;
         }
 
-        printf("%.1f Hz\t(%.3f ± %.3f) V\t(%.3f ± %.3f) V\t(%.3f ± %.3f) deg\n",
-            f, a1_avg, a1_std, a2_avg, a2_std, ph_avg, ph_std);
+        printf("%.1f Hz\t(%.3f ± %.3f) V\t(%.3f ± %.3f) V\t(%.3f ± %.3f) deg"
+            "\t(%zu/%i)\n", f, a1_avg, a1_std, a2_avg, a2_std, ph_avg, ph_std,
+            nused, nreads);
 
         out_file << f << ","
         << a1_avg << "," << a1_std << ","
         << a2_avg << "," << a2_std << ","
-        << ph_avg << "," << ph_std << "\n";
+        << ph_avg << "," << ph_std << ","
+        << nused << "\n";
     }
 
     out_file.close();
@@ -96,9 +127,7 @@ void dso_setup(ds1000z* dso, bool reset) {
         dso->enable_channel(i);
         dso->set_atten(i, 1);
         dso->set_vert_base(i, 1.0);
-        dso->set_measurement(i, ds1000z::MEAS_VAMP);
     }
-    dso->set_measurement(1, 2, ds1000z::MEAS_RPH);
     dso->wait_to_complete();
     std::cout << "Done!" << std::endl;
     return;
@@ -119,4 +148,22 @@ void fgen_setup(dg4000* fgen, bool reset) {
 
     std::cout << "Done!" << std::endl;
     return;
-}
\ No newline at end of file
+}
+
+size_t get_stats(const std::vector<measurements>& meas, unsigned item,
+double& avg, double& std) {
+    double sum = 0., sumsq = 0.;
+    size_t n = 0;
+    for (const auto& m : meas) {
+        // Items measure() could not determine (e.g. no edges) are NaN
+        if ( !std::isfinite(m[item]) )
+            continue;
+        sum += m[item];
+        sumsq += m[item] * m[item];
+        n++;
+    }
+    avg = n ? sum / n : NAN;
+    // Rounding may turn the variance of (almost) equal values negative
+    std = (n > 1) ? sqrt(std::max(0., (sumsq - sum * avg) / (n - 1))) : NAN;
+    return n;
+}
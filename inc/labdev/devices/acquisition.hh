@@ -0,0 +1,127 @@
+#ifndef LD_ACQUISITION_HH
+#define LD_ACQUISITION_HH
+
+#include <labdev/devices/oscilloscope.hh>
+#include <labdev/utils/waveform.hh>
+#include <labdev/utils/spsc_queue.hh>
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <sys/time.h>
+
+namespace labdev {
+
+    /*
+     *      Waveforms of one trigger event
+     */
+
+    struct acquisition_frame {
+        uint64_t trigger;               // Trigger count since start()
+        struct timeval time;            // Time of readout
+        std::vector<waveform> wfs;      // In the order of the channels
+    };
+
+    /*
+     *      Continuous acquisition on a separate thread: the producer thread
+     *      arms the oscilloscope with single_shot_sync(), waits until it has
+     *      stopped again (wait_for_stop()), and reads the channels into a
+     *      free frame of a fixed pool. Filled frames are passed to the
+     *      consumer with a lock-free queue and returned with release(), the
+     *      next trigger is armed while the consumer processes the previous
+     *      one.
+     *
+     *      The oscilloscope must not be used by other threads while the
+     *      acquisition is running. Frames are handled by one consumer thread
+     *      (next()/release()); further processing stages can be chained by
+     *      the consumer.
+     *
+     *      Example:
+     *      acquisition acq(&osc, {1, 2});
+     *      acq.start();
+     *      while (...) {
+     *          acquisition_frame* frame = acq.next(1000);
+     *          if (!frame) continue;
+     *          process(frame->wfs);
+     *          acq.release(frame);
+     *      }
+     *      acq.stop();
+     */
+
+    class acquisition {
+    public:
+        acquisition(oscilloscope* osc, const std::vector<unsigned>& channels,
+            size_t nframes = s_dflt_frames);
+        ~acquisition();
+
+        acquisition(const acquisition&) = delete;
+        acquisition& operator=(const acquisition&) = delete;
+
+        static constexpr size_t s_dflt_frames = 4;
+        static constexpr unsigned s_dflt_poll_interval_ms = 1;
+        // Timeout of each wait_for_stop() call, stop() takes effect after
+        // at most this time
+        static constexpr unsigned s_stop_check_ms = 200;
+        // Time for the oscilloscope to accept single_shot_sync(); drivers
+        // without confirmation wait this long if the acquisition completed
+        // between two polls
+        static constexpr unsigned s_start_timeout_ms = 100;
+
+        // Behaviour if all frames are in use by the consumer: BLOCK waits
+        // for a released frame (no trigger is lost, the oscilloscope idles),
+        // DROP keeps triggering and counts the unread triggers as dropped
+        enum Overflow_policy : uint8_t { BLOCK, DROP };
+        void set_overflow_policy(Overflow_policy policy);
+        Overflow_policy get_overflow_policy() const { return m_policy; }
+
+        // Polling interval of the producer while waiting for a released
+        // frame (the oscilloscope is polled with wait_for_stop())
+        void set_poll_interval(unsigned interval_ms);
+
+        // Starts/stops the producer thread, stop() waits for the current
+        // readout to complete; frames not yet released stay valid
+        void start();
+        void stop();
+        bool running() const { return m_running.load(); }
+
+        // Consumer side: returns the next filled frame or nullptr after
+        // timeout_ms; errors of the producer thread are rethrown here
+        acquisition_frame* next(unsigned timeout_ms);
+        // Returns a frame from next() to the pool
+        void release(acquisition_frame* frame);
+
+        // Counters since start()
+        uint64_t get_n_triggers() const { return m_ntriggers.load(); }
+        uint64_t get_n_acquired() const { return m_nacquired.load(); }
+        uint64_t get_n_dropped() const { return m_ndropped.load(); }
+
+    private:
+        oscilloscope* m_osc;
+        const std::vector<unsigned> m_channels;
+        std::vector<acquisition_frame> m_frames;
+        spsc_queue<acquisition_frame*> m_free;      // Consumer -> producer
+        spsc_queue<acquisition_frame*> m_filled;    // Producer -> consumer
+        Overflow_policy m_policy;
+        unsigned m_poll_interval_ms;
+
+        std::thread m_producer;
+        std::atomic<bool> m_running;
+        std::atomic<uint64_t> m_ntriggers, m_nacquired, m_ndropped;
+        // Error of the producer thread, set before m_running is cleared
+        std::exception_ptr m_error;
+        // Frame taken from the pool but not filled when the producer ended
+        acquisition_frame* m_pending;
+
+        void produce();
+        // Returns a free frame, nullptr if none is available (DROP) or the
+        // acquisition was stopped
+        acquisition_frame* get_free_frame();
+        // Arms the oscilloscope and waits for the end of the acquisition,
+        // returns false if the acquisition was stopped while waiting
+        bool wait_stopped();
+    };
+
+}
+
+#endif
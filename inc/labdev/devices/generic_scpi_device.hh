@@ -0,0 +1,133 @@
+#ifndef LD_GENERIC_SCPI_DEVICE_HH
+#define LD_GENERIC_SCPI_DEVICE_HH
+
+#include <labdev/devices/scpi_device.hh>
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace labdev {
+
+    /*
+     *      SCPI device described by a parameter file instead of a driver class.
+     *      The format is one parameter per line, comments start with #:
+     *          <name>  <type>  <header>  [<min> <max> | <values>]  [<unit>]
+     *
+     *      Types are int, double, bool, enum, and string. '{}' in the header
+     *      is replaced by the channel number, the set command is
+     *      '<header> <value>', the query '<header>?'. The optional line
+     *      'channels <n>' limits the channel numbers, enum values are
+     *      separated by ','.
+     *
+     *      Example:
+     *      # Two channel power supply
+     *      channels    2
+     *      voltage     double  SOUR{}:VOLT     0   32.05   V
+     *      current     double  SOUR{}:CURR     0   10.01   A
+     *      output      bool    OUTP{}
+     *      mode        enum    SYST:MODE       LOC,REM,RWL
+     *
+     *      Settings are written and read through the settings cache and can be
+     *      batched with begin_transaction()/commit().
+     */
+
+    class generic_scpi_device : public scpi_device {
+    public:
+        generic_scpi_device() : m_nchannels(0) {};
+        generic_scpi_device(interface* comm, const std::string& desc_path);
+        ~generic_scpi_device() {};
+
+        // Parameter types
+        enum Param_type : uint8_t { PARAM_INT, PARAM_DOUBLE, PARAM_BOOL,
+            PARAM_ENUM, PARAM_STRING };
+
+        // Reads and compiles a description file
+        void load(const std::string& desc_path);
+
+        // Returns the handle of a parameter for repeated access without name
+        // lookup (aborts on unknown names)
+        size_t get_param(const std::string& name) const;
+        bool has_param(const std::string& name) const
+            { return m_param_ids.count(name); }
+        size_t get_n_params() const { return m_params.size(); }
+
+        // Parameter information
+        const std::string& get_name(size_t param) const;
+        Param_type get_type(size_t param) const;
+        const std::string& get_unit(size_t param) const;
+        unsigned get_n_channels() const { return m_nchannels; }
+
+        // Typed access by handle or by name, channel is only used for
+        // parameters with '{}' in their header
+        void set_int(size_t param, int64_t val, unsigned channel = 0);
+        int64_t get_int(size_t param, unsigned channel = 0);
+        void set_double(size_t param, double val, unsigned channel = 0);
+        double get_double(size_t param, unsigned channel = 0);
+        void set_bool(size_t param, bool val, unsigned channel = 0);
+        bool get_bool(size_t param, unsigned channel = 0);
+        void set_enum(size_t param, const std::string& val,
+            unsigned channel = 0);
+        std::string get_enum(size_t param, unsigned channel = 0);
+        void set_string(size_t param, const std::string& val,
+            unsigned channel = 0);
+        std::string get_string(size_t param, unsigned channel = 0);
+
+        void set_int(const std::string& name, int64_t val, unsigned ch = 0)
+            { this->set_int(this->get_param(name), val, ch); }
+        int64_t get_int(const std::string& name, unsigned ch = 0)
+            { return this->get_int(this->get_param(name), ch); }
+        void set_double(const std::string& name, double val, unsigned ch = 0)
+            { this->set_double(this->get_param(name), val, ch); }
+        double get_double(const std::string& name, unsigned ch = 0)
+            { return this->get_double(this->get_param(name), ch); }
+        void set_bool(const std::string& name, bool val, unsigned ch = 0)
+            { this->set_bool(this->get_param(name), val, ch); }
+        bool get_bool(const std::string& name, unsigned ch = 0)
+            { return this->get_bool(this->get_param(name), ch); }
+        void set_enum(const std::string& name, const std::string& val,
+            unsigned ch = 0)
+            { this->set_enum(this->get_param(name), val, ch); }
+        std::string get_enum(const std::string& name, unsigned ch = 0)
+            { return this->get_enum(this->get_param(name), ch); }
+        void set_string(const std::string& name, const std::string& val,
+            unsigned ch = 0)
+            { this->set_string(this->get_param(name), val, ch); }
+        std::string get_string(const std::string& name, unsigned ch = 0)
+            { return this->get_string(this->get_param(name), ch); }
+
+    private:
+        // Compiled parameter description
+        struct param_desc {
+            std::string name;
+            Param_type type;
+            std::string set_fmt;        // e.g. "SOUR{}:VOLT {}\n"
+            std::string query_fmt;      // e.g. "SOUR{}:VOLT?\n"
+            bool per_channel;
+            bool has_range;
+            double min, max;
+            std::vector<std::string> values;    // Enum values
+            std::string unit;
+        };
+
+        std::vector<param_desc> m_params;
+        std::map<std::string, size_t> m_param_ids;
+        unsigned m_nchannels;
+
+        // Parses one description line
+        void parse_line(const std::string& line, unsigned lineno);
+
+        // Checks handle, type, and channel; returns the parameter
+        const param_desc& check_param(size_t id, Param_type type,
+            unsigned channel) const;
+        void check_range(const param_desc& par, double val) const;
+
+        // Writes/queries a parameter with its formatted value
+        template<typename T>
+        void write_param(const param_desc& par, unsigned channel, const T& val);
+        std::string query_param(const param_desc& par, unsigned channel);
+    };
+
+}
+
+#endif
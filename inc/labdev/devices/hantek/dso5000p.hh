@@ -53,8 +53,7 @@ namespace labdev {
         bool stopped();
 
         // Read sample data
-        void read_sample_data(unsigned channel,  
-            std::vector<double> &horz_data, std::vector<double> &vert_data);
+        void read_waveform(unsigned channel, waveform& wf);
 
         /*
 
@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 
+#include <labdev/utils/waveform.hh>
+
 namespace labdev{
 
     /*
@@ -46,6 +48,13 @@ namespace labdev{
         virtual void start_acquisition() = 0;
         virtual void stop_acquisition() = 0;
         virtual void single_shot() = 0;
+        // Arms a single acquisition and returns once the oscilloscope has
+        // accepted it, from then on stopped() refers to the new acquisition;
+        // false if this was not confirmed within timeout_ms. The default
+        // waits with wait_for_start() and cannot tell a missed start from
+        // an acquisition which has already completed, drivers confirm the
+        // command instead (e.g. with *OPC?)
+        virtual bool single_shot_sync(unsigned timeout_ms);
 
         // Trigger settings
         virtual void set_trigger_type(trigger_type trig) = 0;
@@ -57,12 +66,52 @@ namespace labdev{
         // Returns true if data acquisition has stopped
         virtual bool stopped() = 0;
 
-        // Read sample data
-        virtual void read_sample_data(unsigned channel,  
-            std::vector<double> &horz_data, std::vector<double> &vert_data) = 0;
+        // Block until the trigger conditions have been met or the
+        // acquisition has stopped; return false if timeout_ms has passed.
+        // Drivers can override these with event notification, the default
+        // polls with an interval growing from a tenth of the acquisition
+        // time up to one acquisition time (100 us to 100 ms). A single
+        // acquisition may already have stopped when the trigger is polled,
+        // so call them after the start (single_shot_sync()).
+        virtual bool wait_for_trigger(unsigned timeout_ms);
+        virtual bool wait_for_stop(unsigned timeout_ms);
+        // Block until the acquisition has left the stopped state after
+        // single_shot() or start_acquisition(); until then stopped() still
+        // refers to the previous acquisition
+        virtual bool wait_for_start(unsigned timeout_ms);
+
+        // Read sample data as raw samples with scaling (see waveform)
+        virtual void read_waveform(unsigned channel, waveform& wf) = 0;
+
+        // Read sample data converted to time and voltage, uses
+        // read_waveform(); prefer the waveform for long records (16 bytes per
+        // sample instead of 1 or 2)
+        virtual void read_sample_data(unsigned channel,
+            std::vector<double> &horz_data, std::vector<double> &vert_data);
+
+        // Read several channels of the same acquisition into wfs (in the
+        // order of channels, buffers are reused); the acquisition is stopped
+        // once and stays stopped, all waveforms share the same time axis
+        virtual void read_channels(const std::vector<unsigned>& channels,
+            std::vector<waveform>& wfs);
+
+    protected:
+        // Duration of one acquisition in seconds, used to adapt the polling
+        // interval; the default is the horizontal base times s_n_horz_div
+        virtual double get_acquisition_time();
+
+        static constexpr unsigned s_n_horz_div = 10;
+        static constexpr unsigned s_min_poll_interval_us = 100;
+        static constexpr unsigned s_max_poll_interval_us = 100000;
 
     private:
         const unsigned m_n_ch;
+
+        // Polls cond with exponential backoff until it returns true
+        bool poll_until(bool (oscilloscope::*cond)(), unsigned timeout_ms);
+        bool running() { return !this->stopped(); }
+        bool triggered_or_stopped()
+            { return this->triggered() || this->stopped(); }
     };
 }
 
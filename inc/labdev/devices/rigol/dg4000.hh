@@ -4,6 +4,7 @@
 #include <labdev/tcpip_interface.hh>
 #include <labdev/visa_interface.hh>
 #include <labdev/usbtmc_interface.hh>
+#include <labdev/usbtmc_kernel_interface.hh>
 #include <labdev/devices/scpi_device.hh>
 
 namespace labdev {
@@ -18,6 +19,7 @@ namespace labdev {
         dg4000(tcpip_interface* tcpip);
         dg4000(visa_interface* visa);
         dg4000(usbtmc_interface* usbtmc);
+        dg4000(usbtmc_kernel_interface* usbtmc);
         ~dg4000();
 
         static constexpr uint16_t DG4162_VID = 0x1AB1;
@@ -46,7 +48,7 @@ namespace labdev {
         double get_offset(unsigned channel);
 
         // Returns when at least time_ms have passed after sending msg
-        void write_at_least(std::string msg, unsigned time_ms);
+        void write_at_least(const scpi_cmd& cmd, unsigned time_ms);
 
     private:
         void init();
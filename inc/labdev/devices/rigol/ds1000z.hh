@@ -6,6 +6,7 @@
 #include <labdev/tcpip_interface.hh>
 #include <labdev/visa_interface.hh>
 #include <labdev/usbtmc_interface.hh>
+#include <labdev/usbtmc_kernel_interface.hh>
 
 #include <labdev/devices/oscilloscope.hh>
 #include <labdev/devices/scpi_device.hh>
@@ -22,6 +23,7 @@ namespace labdev {
         ds1000z(tcpip_interface* tcpip);
         ds1000z(visa_interface* visa);
         ds1000z(usbtmc_interface* usbtmc);
+        ds1000z(usbtmc_kernel_interface* usbtmc);
         ~ds1000z();
 
         static constexpr uint16_t DS1104_VID = 0x1AB1;
@@ -83,6 +85,9 @@ namespace labdev {
         void start_acquisition() override;
         void stop_acquisition() override;
         void single_shot() override;
+        // Confirms :SING with *OPC?, the oscilloscope processes commands in
+        // order
+        bool single_shot_sync(unsigned timeout_ms) override;
 
         // Edge trigger settings
         void set_trigger_source(unsigned channel) override;
@@ -94,9 +99,11 @@ namespace labdev {
         // Returns true if data acquisition has stopped
         bool stopped() override;
 
-        // Read sample data
-        void read_sample_data(unsigned channel,  
-            std::vector<double> &horz_data, std::vector<double> &vert_data) override;
+        // Read sample data (unsigned 8 bit samples)
+        void read_waveform(unsigned channel, waveform& wf) override;
+        // Fetches the preambles of all channels with a single query
+        void read_channels(const std::vector<unsigned>& channels,
+            std::vector<waveform>& wfs) override;
 
         /* Definition of DS1000Z series specific functions */
 
@@ -104,17 +111,39 @@ namespace labdev {
         void set_measurement(unsigned channel, unsigned item);
         void set_measurement(unsigned channel1, unsigned channel2,
             unsigned item);
+        // (virtual, calls through ds1000z& also use the readout of ds1000z_t)
         double get_measurement(unsigned channel, unsigned item,
             unsigned type);
-        double get_measurement(unsigned channel1, unsigned channel2,
+        virtual double get_measurement(unsigned channel1, unsigned channel2,
             unsigned item, unsigned type);
         void clear_measurements();
-        void reset_measurements();
+        virtual void reset_measurements();
+
+    protected:
+        // For transports without a dedicated constructor (used by ds1000z_t,
+        // e.g. with test transports)
+        ds1000z(interface* comm);
+
+        // Statistics query shared with ds1000z_t
+        static scpi_cmd measurement_query(unsigned channel1, unsigned channel2,
+            unsigned item, unsigned type);
+        void check_channel(unsigned channel);
+        // The DS1000Z screen has 12 horizontal divisions
+        double get_acquisition_time() override
+            { return this->get_horz_base() * 12; }
 
     private:
         void init();
-        void check_channel(unsigned channel);
-        std::vector<uint8_t> read_mem_data( unsigned sta, unsigned sto);
+        size_t read_mem_data(unsigned sta, unsigned sto, uint8_t* data,
+            size_t max_len);
+        // Parses one preamble, sizes and scales the waveform
+        bool read_preamble(scpi_parser& preamble, waveform& wf);
+        // Reads the samples of the current source into the waveform
+        void read_samples(waveform& wf);
+
+        // The DS1000Z has no *LRN?, setups are binary blocks (:SYST:SET)
+        std::string read_setup(unsigned timeout_ms) override;
+        void write_setup(const std::string& setup) override;
 
         unsigned m_npts;
         double m_xincr, m_xorg, m_xref, m_yinc;
@@ -125,6 +154,44 @@ namespace labdev {
 
     };
 
+    /*
+     *      DS1000Z bound to a known transport type (e.g.
+     *      ds1000z_t<tcpip_interface>); the measurement readout used in
+     *      monitoring loops is dispatched statically, also when called
+     *      through ds1000z&. All other methods are the same as for ds1000z.
+     *
+     *      Only the host overhead per readout is reduced (about 20-25 ns of
+     *      130 ns on a loopback transport, see static_dispatch_bench), which
+     *      is small compared to the round trip to a real instrument. Short
+     *      responses like the trigger status gain nothing.
+     */
+
+    template<class Transport>
+    class ds1000z_t : public ds1000z {
+    public:
+        ds1000z_t(Transport* comm) : ds1000z(comm), m_io(comm) {};
+
+        double get_measurement(unsigned channel1, unsigned channel2,
+        unsigned item, unsigned type) override {
+            this->check_channel(channel1);
+            return m_io.query_double( measurement_query(channel1, channel2,
+                item, type) );
+        }
+
+        double get_measurement(unsigned channel, unsigned item,
+        unsigned type) {
+            return this->get_measurement(channel, channel, item, type);
+        }
+
+        void reset_measurements() override {
+            m_io.send( scpi_cmd(":MEAS:STAT:RES\n") );
+            return;
+        }
+
+    private:
+        scpi_static_io<Transport> m_io;
+    };
+
 }
 
 #endif
\ No newline at end of file
@@ -42,8 +42,6 @@ namespace labdev {
         bool ovp_tripped(int channel);
 
     private:
-        int cur_ch;
-
         void init();
 
         // Select seperate channel "instrument"
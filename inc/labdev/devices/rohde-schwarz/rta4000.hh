@@ -6,6 +6,7 @@
 #include <labdev/tcpip_interface.hh>
 #include <labdev/visa_interface.hh>
 #include <labdev/usbtmc_interface.hh>
+#include <labdev/usbtmc_kernel_interface.hh>
 #include <labdev/serial_interface.hh>
 
 #include <labdev/devices/oscilloscope.hh>
@@ -23,6 +24,7 @@ namespace labdev{
         rta4000(tcpip_interface* tcpip);
         rta4000(visa_interface* visa);
         rta4000(usbtmc_interface* usbtmc);
+        rta4000(usbtmc_kernel_interface* usbtmc);
         rta4000(serial_interface* serial);
         ~rta4000() {};
 
@@ -62,8 +64,7 @@ namespace labdev{
         bool stopped() override;
 
         // Read sample data
-        void read_sample_data(unsigned channel, std::vector<double> &horz_data, 
-            std::vector<double> &vert_data) override;
+        void read_waveform(unsigned channel, waveform& wf) override;
 
         /* Definition of RTA4000 series specific functions */
 
@@ -2,6 +2,12 @@
 #define SCPI_DEVICE_HH
 
 #include <labdev/interface.hh>
+#include <labdev/exceptions.hh>
+#include <labdev/utils/scpi_cmd.hh>
+#include <labdev/utils/scpi_parser.hh>
+
+#include <vector>
+#include <map>
 
 namespace labdev {
 
@@ -12,7 +18,10 @@ namespace labdev {
 
     class scpi_device {
     public:
-        scpi_device() : comm(nullptr) {};
+        scpi_device() : comm(nullptr), m_in_transaction(false),
+            m_transaction_len(s_dflt_transaction_len), m_completion(OPC_AUTO),
+            m_cache_enabled(true), m_error_check(ERR_CHECK_DEFERRED),
+            m_err_all(ERR_ALL_UNKNOWN) {};
         scpi_device(interface* interface);
         virtual ~scpi_device();
 
@@ -28,6 +37,27 @@ namespace labdev {
             PON = (1 << 7)      // Power On
         };
 
+        // Error queue entry
+        struct scpi_error {
+            int code;
+            std::string msg;
+        };
+
+        // When commands are checked for errors
+        enum Error_check : uint8_t {
+            ERR_CHECK_OFF,          // Only by the user
+            ERR_CHECK_IMMEDIATE,    // After every command
+            ERR_CHECK_DEFERRED      // When a transaction is committed
+        };
+
+        // Strategies to wait for the completion of pending operations
+        enum Completion_strategy : uint8_t {
+            OPC_AUTO,       // Chosen by the interface type
+            OPC_SRQ,        // *OPC sets ESB and raises a service request
+            OPC_POLL,       // *OPC and *ESR? polling with increasing interval
+            OPC_BLOCKING    // *OPC? which answers when operations completed
+        };
+
         // Clear read/write buffers and status register
         void clear_status();
 
@@ -42,6 +72,14 @@ namespace labdev {
         // (blocking)
         void wait_to_complete(unsigned timeout_ms = 10000);
 
+        // Select strategy used by wait_to_complete() (default OPC_AUTO: service
+        // requests if supported, polling for USBTMC, *OPC? otherwise); OPC_SRQ
+        // sets *ESE/*SRE while waiting and restores the previous masks
+        void set_completion_strategy(Completion_strategy strategy)
+            { m_completion = strategy; }
+        Completion_strategy get_completion_strategy() const
+            { return m_completion; }
+
         // Resets the device
         void reset();
 
@@ -58,17 +96,237 @@ namespace labdev {
         // Returns error string for current error in queue
         std::string get_strerror() { return m_strerror; }
 
+        // Reads all entries of the error queue at once (SYST:ERR:ALL? if
+        // supported, otherwise batches of SYST:ERR? queries); m_error and
+        // m_strerror hold the first error
+        std::vector<scpi_error> read_errors();
+
+        // Drains the error queue and throws device_error on the first error
+        void check_errors();
+
+        // Select when errors are checked (default ERR_CHECK_DEFERRED)
+        void set_error_check(Error_check mode) { m_error_check = mode; }
+        Error_check get_error_check() const { return m_error_check; }
+
+        // Settings cache: drivers skip writes of unchanged settings and answer
+        // repeated queries from the cache; it is cleared on *RST, *RCL, device
+        // errors, and by invalidate_cache() (e.g. after front panel operation)
+        void enable_cache(bool enable = true);
+        bool cache_enabled() const { return m_cache_enabled; }
+        void invalidate_cache();
+
+        // Transactions: setters called between begin_transaction() and
+        // commit() are joined with ';' into as few messages as max_len allows;
+        // commit() waits for completion with *OPC? and checks the error queue
+        // once (throws device_error). Queries flush queued commands first.
+        void begin_transaction(size_t max_len = s_dflt_transaction_len);
+        void commit(unsigned timeout_ms = 10000);
+        // Drops all queued commands
+        void discard_transaction();
+        bool in_transaction() const { return m_in_transaction; }
+
+        // Instrument setup snapshots stored on the host by name: restoring
+        // writes the whole setup in one message, with diff = true only the
+        // commands differing from the current setup are written
+        void save_snapshot(const std::string& name,
+            unsigned timeout_ms = interface::s_dflt_timeout_ms);
+        void restore_snapshot(const std::string& name, bool diff = false,
+            unsigned timeout_ms = interface::s_dflt_timeout_ms);
+        bool has_snapshot(const std::string& name) const
+            { return m_snapshots.count(name); }
+        // Access raw setup data, e.g. to keep snapshots in files
+        const std::string& get_snapshot(const std::string& name) const;
+        void set_snapshot(const std::string& name, const std::string& setup)
+            { m_snapshots[name] = setup; }
+        void remove_snapshot(const std::string& name)
+            { m_snapshots.erase(name); }
+
+        // Save/recall setup in the internal memory of the device (*SAV/*RCL)
+        void save_setup(unsigned slot);
+        void recall_setup(unsigned slot);
+
         // Read and reset the Standard Event Status Register (SESR)
         uint8_t get_event_status_register(unsigned timeout_ms = 1000);
 
+        // Reads an IEEE 488.2 definite (#<n><len><data>) or indefinite
+        // (#0<data><NL>) length block response directly into data, consumes
+        // the trailing terminator; returns the number of data bytes
+        size_t read_block(uint8_t* data, size_t max_len,
+            unsigned timeout_ms = interface::s_dflt_timeout_ms);
+        // Same as above, data is resized once to the announced block length
+        // (its capacity is reused for subsequent reads)
+        size_t read_block(std::vector<uint8_t>& data,
+            unsigned timeout_ms = interface::s_dflt_timeout_ms);
+
     protected:
         // Basic communications interface
         interface* comm;
 
+        // Writes a formatted command (see SCPI_CMD()) without copying it
+        void send(const scpi_cmd& cmd);
+        // Writes a formatted command and returns the response
+        std::string query(const scpi_cmd& cmd,
+            unsigned timeout_ms = interface::s_dflt_timeout_ms);
+
+        // Reads exactly len bytes from the interface
+        void read_exactly(uint8_t* data, size_t len, unsigned timeout_ms);
+        // Reads block header, returns announced length or -1 (indefinite)
+        long read_block_header(unsigned timeout_ms);
+        // Consumes the optional response terminator following a definite
+        // length block (not read if the block ended the message)
+        void read_block_terminator();
+        static constexpr unsigned s_block_term_timeout_ms = 20;
+
+        // Reads/writes the complete device setup (*LRN? by default); devices
+        // with a vendor specific (binary) setup override both
+        virtual std::string read_setup(unsigned timeout_ms);
+        virtual void write_setup(const std::string& setup);
+
+        // Writes a setting command unless the same value was written before
+        void send_cached(const scpi_cmd& cmd);
+        // Queries a setting; the response is kept until the setting is written
+        // with a different value (the device might round or clamp values, so
+        // written values are not returned without asking once)
+        std::string query_cached(const scpi_cmd& cmd,
+            unsigned timeout_ms = interface::s_dflt_timeout_ms);
+        // Returns true if cmd would not change the cached setting
+        bool cache_hit(const scpi_cmd& cmd) const;
+        // Stores the value of a written setting command
+        void cache_store(const scpi_cmd& cmd);
+        // Drops the cached setting of one header (e.g. ":CHAN1:SCAL"), used
+        // if writing another setting changes it on the device
+        void invalidate_cache(const std::string& header);
+
+        // Default maximum length of a compound transaction message
+        static constexpr size_t s_dflt_transaction_len = 1024;
+
+        bool m_in_transaction;
+        size_t m_transaction_len;
+        std::string m_transaction;
+
+        // Writes queued commands of a transaction
+        void flush_transaction();
+
+        // Minimum and maximum interval between two *ESR? queries
+        static constexpr unsigned s_min_poll_interval_ms = 1;
+        static constexpr unsigned s_max_poll_interval_ms = 100;
+
+        Completion_strategy m_completion;
+
+        // Resolves OPC_AUTO for the current interface
+        Completion_strategy select_completion_strategy();
+        void wait_for_srq_completion(unsigned timeout_ms);
+        void poll_completion(unsigned timeout_ms);
+
+        // Cached settings by command header
+        struct cache_entry {
+            bool has_written;
+            std::string written;    // Last written value
+            bool has_read;
+            std::string read;       // Last response
+        };
+        bool m_cache_enabled;
+        std::map<std::string, cache_entry> m_cache;
+
+        // Setup snapshots by name
+        std::map<std::string, std::string> m_snapshots;
+
+        // Writes commands joined with ';' in messages of at most
+        // m_transaction_len bytes
+        void write_program(const std::vector<std::string>& cmds);
+
+        // SYST:ERR? queries combined into one message if SYST:ERR:ALL? is not
+        // supported
+        static constexpr unsigned s_err_batch_size = 8;
+        // Input is read and discarded after a timed out SYST:ERR:ALL? probe
+        // until nothing arrives for this time (a late answer would be taken
+        // as the response to the next query)
+        static constexpr unsigned s_probe_flush_timeout_ms = 100;
+
+        enum Err_all_support : uint8_t { ERR_ALL_UNKNOWN, ERR_ALL_YES,
+            ERR_ALL_NO };
+
+        Error_check m_error_check;
+        Err_all_support m_err_all;
+
+        // Writes a command or queues it in a transaction
+        void write_cmd(const scpi_cmd& cmd);
+        // Appends errors of a SYST:ERR(:ALL)? response, returns false if the
+        // response contained "No error"
+        bool parse_errors(const std::string& resp,
+            std::vector<scpi_error>& errors);
+
         // Holds current error information
         int m_error;
         std::string m_strerror;
     };
+
+    /*
+     *      SCPI I/O bound to a concrete transport type at compile time: calls
+     *      do not go through the vtable and responses are parsed from a stack
+     *      buffer. Transport has to be the actual type of the interface; the
+     *      settings cache and transactions of scpi_device are bypassed.
+     */
+
+    template<class Transport>
+    class scpi_static_io {
+    public:
+        scpi_static_io(Transport* comm) : m_comm(comm) {};
+
+        void send(const scpi_cmd& cmd) {
+            m_comm->Transport::write_raw((const uint8_t*)cmd.data(),
+                cmd.size());
+            return;
+        }
+
+        // Writes cmd and reads a response terminated by '\n' into resp,
+        // returns the response length
+        size_t query(const scpi_cmd& cmd, char* resp, size_t max_len,
+        unsigned timeout_ms = interface::s_dflt_timeout_ms) {
+            this->send(cmd);
+            size_t len = 0;
+            while ( (len == 0) || (resp[len-1] != '\n') ) {
+                if (len >= max_len)
+                    throw bad_protocol("Response does not fit into buffer");
+                int nbytes = m_comm->Transport::read_raw((uint8_t*)resp + len,
+                    max_len - len, timeout_ms);
+                // Transports report timeouts by exception, an empty read
+                // would be repeated forever
+                if (nbytes <= 0)
+                    throw bad_protocol("Response ended early", len);
+                len += nbytes;
+            }
+            return len;
+        }
+
+        double query_double(const scpi_cmd& cmd,
+        unsigned timeout_ms = interface::s_dflt_timeout_ms) {
+            char resp[s_resp_len];
+            size_t len = this->query(cmd, resp, s_resp_len, timeout_ms);
+            scpi_parser parser(resp, len);
+            double val;
+            if ( !parser.read_double(val) )
+                throw bad_protocol("Received invalid numeric response");
+            return val;
+        }
+
+        int64_t query_int(const scpi_cmd& cmd,
+        unsigned timeout_ms = interface::s_dflt_timeout_ms) {
+            char resp[s_resp_len];
+            size_t len = this->query(cmd, resp, s_resp_len, timeout_ms);
+            scpi_parser parser(resp, len);
+            int64_t val;
+            if ( !parser.read_int(val) )
+                throw bad_protocol("Received invalid integer response");
+            return val;
+        }
+
+    private:
+        // Buffer size for single value responses
+        static constexpr size_t s_resp_len = 256;
+
+        Transport* m_comm;
+    };
 }
 
 #endif
\ No newline at end of file
@@ -3,9 +3,11 @@
 
 #include <labdev/exceptions.hh>
 #include <labdev/devices/scpi_device.hh>
+#include <labdev/utils/waveform.hh>
 #include <labdev/tcpip_interface.hh>
 #include <labdev/visa_interface.hh>
 #include <labdev/usbtmc_interface.hh>
+#include <labdev/usbtmc_kernel_interface.hh>
 
 // Edge trigger settings
 #define DPO5000B_EDGE_RISE  0x00
@@ -24,6 +26,7 @@ namespace labdev {
         dpo5000b(visa_interface* visa);
         dpo5000b(tcpip_interface* tcpip);
         dpo5000b(usbtmc_interface* usbtmc);
+        dpo5000b(usbtmc_kernel_interface* usbtmc);
         ~dpo5000b();
 
         static constexpr uint16_t DPO5204B_VID = 0x0699;
@@ -51,6 +54,7 @@ namespace labdev {
         // Read sample data from internal memory
         void read_sample_data(unsigned channel, std::vector<double> &horz_data,
             std::vector<double> &vert_data);
+        void read_waveform(unsigned channel, waveform& wf);
 
         void set_vert_base(unsigned channel, double volts_per_div);
         double get_vert_base(unsigned channel);
@@ -12,6 +12,21 @@ namespace labdev{
 
     enum Interface_type {none, serial, tcpip, usb, usbtmc, visa};
 
+    /*
+     *  Result of non-throwing I/O (status and value)
+     */
+
+    enum Io_status {io_ok, io_timeout};
+
+    template<typename T>
+    struct io_result {
+        Io_status status;
+        T value;
+
+        bool ok() const { return status == io_ok; }
+        explicit operator bool() const { return status == io_ok; }
+    };
+
     /*
      *  Abstract base class for all interfaces
      */
@@ -53,6 +68,36 @@ namespace labdev{
         virtual std::string query(const std::string& msg, 
             unsigned timeout_ms = s_dflt_timeout_ms);
 
+        /*
+         *      Non-throwing reads for polling loops: timeouts are returned as
+         *      io_timeout with the bytes received so far instead of throwing
+         *      labdev::timeout (other errors still throw)
+         */
+
+        // C-style raw byte read, the default implementation catches the
+        // timeout of read_raw()
+        virtual io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms);
+        // C++-style string read
+        io_result<std::string> try_read(
+            unsigned timeout_ms = s_dflt_timeout_ms);
+        // C++-style string write followed by a read
+        io_result<std::string> try_query(const std::string& msg,
+            unsigned timeout_ms = s_dflt_timeout_ms);
+
+        // True if the last read ended the device message (USBTMC EOM, VISA
+        // END), nothing like a terminator follows; false if unknown
+        virtual bool end_of_message() const { return false; }
+
+        /*
+         *      Service requests
+         */
+
+        // Returns true if the interface signals service requests (SRQ)
+        virtual bool srq_supported() { return false; }
+        // Blocks until a service request is received, false on timeout
+        virtual bool wait_for_srq(unsigned timeout_ms) { return false; }
+
         /*
          *      Utility methods
          */
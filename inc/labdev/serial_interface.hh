@@ -5,7 +5,7 @@
 #include <termios.h>
 
 namespace labdev{
-    class serial_interface : public interface {
+    class serial_interface final : public interface {
     public:
         serial_interface();
         serial_interface(const std::string &path, unsigned baud = 9600,
@@ -22,6 +22,8 @@ namespace labdev{
         int write_raw(const uint8_t* data, size_t len) override;
         int read_raw(uint8_t* data, size_t max_len, 
             unsigned timeout_ms = s_dflt_timeout_ms) override;
+        io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms) override;
 
         // Set baud rate for serial interface
         void set_baud(unsigned baud);
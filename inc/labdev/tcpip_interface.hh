@@ -7,7 +7,7 @@
 #include <arpa/inet.h>
 
 namespace labdev {
-    class tcpip_interface : public interface {
+    class tcpip_interface final : public interface {
     public:
         tcpip_interface();
         tcpip_interface(const std::string& ip_addr, unsigned port);
@@ -22,6 +22,8 @@ namespace labdev {
         int write_raw(const uint8_t* data, size_t len) override;
         int read_raw(uint8_t* data, size_t max_len, 
             unsigned timeout_ms = s_dflt_timeout_ms) override;
+        io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms) override;
 
         // Set read/write buffer size
         void set_buffer_size(size_t buf_size);
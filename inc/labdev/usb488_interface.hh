@@ -0,0 +1,84 @@
+#ifndef LD_USB488_INTERFACE_H
+#define LD_USB488_INTERFACE_H
+
+#include <labdev/usbtmc_interface.hh>
+
+namespace labdev{
+
+    /*
+     *      USBTMC-USB488 subclass: status byte, service requests (SRQ), and
+     *      remote/local control via control and interrupt endpoints
+     */
+
+    class usb488_interface final : public usbtmc_interface {
+    public:
+        usb488_interface();
+        usb488_interface(uint16_t vendor_id, uint16_t product_id,
+            std::string serial_number = "");
+        usb488_interface(uint8_t bus_address, uint8_t device_address);
+        ~usb488_interface();
+
+        // USB488 protocol definitions
+        enum bRequest488 : uint16_t {
+            READ_STATUS_BYTE    = 0x80,
+            REN_CONTROL         = 0xA0,
+            GO_TO_LOCAL         = 0xA1,
+            LOCAL_LOCKOUT       = 0xA2
+        };
+
+        enum MsgID488 : uint16_t {
+            TRIGGER             = 0x80
+        };
+
+        // Status byte (STB) definitions
+        enum STB : uint8_t {
+            ESB = (1 << 5),     // Event Status Bit
+            MAV = (1 << 4),     // Message Available
+            RQS = (1 << 6)      // Request Service
+        };
+
+        // Reads the status byte without using the bulk endpoints
+        uint8_t read_status_byte();
+
+        // Returns the status byte sent with the last service request
+        uint8_t get_srq_status_byte() const { return m_srq_stb; }
+
+        // Service requests are received via the interrupt-IN endpoint
+        bool srq_supported() override;
+        bool wait_for_srq(unsigned timeout_ms) override;
+
+        // Remote enable, go to local, and local lockout
+        void remote_enable(bool enable = true);
+        void go_to_local();
+        void local_lockout();
+
+        // Group execute trigger (same as *TRG)
+        void trigger();
+
+        // Claims interface and checks for USB488 compatibility
+        void claim_interface(int int_no, int alt_setting = 0);
+
+    private:
+        static constexpr uint8_t USB488_PROTOCOL = 0x01;
+        // Interrupt-IN notifications (bNotify1)
+        static constexpr uint8_t s_notify_srq = 0x81;
+        static constexpr uint8_t s_notify_stb = 0x80;
+
+        // READ_STATUS_BYTE uses its own bTag in the range 2..127
+        uint8_t m_stb_tag;
+        bool m_srq_pending;
+        uint8_t m_srq_stb;
+
+        void init();
+
+        // Sends a USB488 control request and checks USBTMC_status, returns
+        // number of bytes received
+        int control_request(uint8_t request, uint16_t value, uint8_t* data,
+            int len);
+
+        // Reads one interrupt-IN notification, returns false on timeout
+        bool read_notification(uint8_t* notify, unsigned timeout_ms);
+    };
+}
+
+#endif
@@ -4,6 +4,9 @@
 #include <labdev/interface.hh>
 #include <libusb.h>
 
+#include <fstream>
+#include <sys/time.h>
+
 namespace labdev{
     class usb_interface : public interface {
     public:
@@ -18,10 +21,24 @@ namespace labdev{
         void open(uint8_t bus_no, uint8_t port_no);
         void close() override;
 
+        // Serves all transfers from a capture file instead of libusb (see
+        // start_capture()); written data and the bulk endpoints are compared
+        // against the capture
+        void open_replay(const std::string& path);
+        bool replaying() const { return m_replaying; }
+
+        // Logs all control, bulk, and interrupt transfers including timing
+        // information to a binary file; start before claiming an interface
+        void start_capture(const std::string& path);
+        void stop_capture();
+        bool capturing() const { return m_capture.is_open(); }
+
         // Data transfer to and from bulk endpoint using current ep address
         virtual int write_raw(const uint8_t* data, size_t len) override;
         virtual int read_raw(uint8_t* data, size_t max_len, 
             unsigned timeout_ms = s_dflt_timeout_ms) override;
+        virtual io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms) override;
 
         Interface_type type() const override { return usb; }
 
@@ -38,16 +55,34 @@ namespace labdev{
         int write_bulk(const uint8_t* data, int len);
         int read_bulk(uint8_t* data, int max_len,
             int timeout_ms = s_dflt_timeout_ms);
+        // Returns io_timeout with the bytes received so far instead of
+        // throwing labdev::timeout
+        io_result<int> try_read_bulk(uint8_t* data, int max_len,
+            int timeout_ms = s_dflt_timeout_ms);
 
         // libusb-style data transfer to interrupt endpoints
         int write_interrupt(const uint8_t* data, int len);
         int read_interrupt(uint8_t* data, int max_len,
             int timeout_ms = s_dflt_timeout_ms);
 
+        // Returns a buffer of at least len bytes for bulk transfers; the memory
+        // is kernel-mapped (zero-copy) if supported by OS and libusb
+        uint8_t* get_transfer_buffer(size_t len);
+        // Returns true if the current transfer buffer is kernel-mapped
+        bool zero_copy() const { return m_xfer_buf_devmem; }
+        // Allows kernel-mapped transfer buffers (default); changing it frees
+        // the current buffer, e.g. to compare the throughput of both
+        void set_zero_copy(bool enable);
+
+        // Clears halt/stall condition of an endpoint (including direction bit)
+        void clear_halt(uint8_t ep_addr);
+
         // Set current I/O configuration
         void claim_interface(int int_no, int alt_setting = 0);
         void set_endpoint_in(uint8_t ep_addr);
         void set_endpoint_out(uint8_t ep_addr);
+        void set_endpoint_interrupt_in(uint8_t ep_addr);
+        void set_endpoint_interrupt_out(uint8_t ep_addr);
 
         // Get information on the device
         uint16_t get_vid() { return m_vid; }
@@ -57,12 +92,19 @@ namespace labdev{
         uint8_t get_port() { return m_port; }
 
         // Get information on the current interface
+        int get_interface_number() { return m_cur_interface_no; }
         uint8_t get_interface_class() { return m_interface_class; }
         uint8_t get_interface_subclass() { return m_interface_subclass; }
         uint8_t get_interface_protocol() { return m_interface_protocol; }
+        uint16_t get_max_packet_size() { return m_max_packet_size; }
+        uint8_t get_endpoint_in() { return m_cur_ep_in_addr; }
+        uint8_t get_endpoint_out() { return m_cur_ep_out_addr; }
+        uint8_t get_endpoint_interrupt_in() { return m_cur_ep_int_in_addr; }
+        uint8_t get_endpoint_interrupt_out() { return m_cur_ep_int_out_addr; }
 
     private:
         static const int s_no_interface = -1;
+        static constexpr size_t s_page_size = 4096;
 
         static libusb_context* s_default_ctx;
         static int s_dev_count;
@@ -72,8 +114,48 @@ namespace labdev{
         // Current device I/O information
         int m_cur_cfg, m_cur_alt_setting, m_cur_interface_no;
         uint8_t m_cur_ep_in_addr, m_cur_ep_out_addr;
+        uint8_t m_cur_ep_int_in_addr, m_cur_ep_int_out_addr;
+        uint16_t m_max_packet_size;
+        // Bulk endpoints of the interface descriptor
+        uint8_t m_ep_bulk_in_addr, m_ep_bulk_out_addr;
         bool m_connected;
 
+        // Bulk transfer buffer, see get_transfer_buffer()
+        uint8_t* m_xfer_buf;
+        size_t m_xfer_buf_len;
+        bool m_xfer_buf_devmem;
+        bool m_xfer_buf_allow_devmem;
+
+        // Capture file definitions (all values little endian):
+        //  file header: 'LDUSBCAP', version (u16), VID (u16), PID (u16),
+        //               reserved (u16)
+        //  record:      type (u8), endpoint/bRequest (u8), bmRequestType (u8),
+        //               reserved (u8), wValue (u16), wIndex (u16),
+        //               status (i32), start time (u32, us), duration (u32, us),
+        //               length (u32), followed by length bytes of data
+        // CAP_CLAIM data: interface class, subclass, protocol, interrupt IN
+        // and OUT endpoint, wMaxPacketSize (u16), bulk IN and OUT endpoint
+        static constexpr uint16_t s_capture_version = 2;
+        static constexpr size_t s_claim_info_len = 9;
+        static constexpr size_t s_capture_hdr_len = 16;
+        static constexpr size_t s_record_hdr_len = 24;
+
+        enum capture_type : uint8_t {
+            CAP_CONTROL_OUT     = 0x01,
+            CAP_CONTROL_IN      = 0x02,
+            CAP_BULK_OUT        = 0x03,
+            CAP_BULK_IN         = 0x04,
+            CAP_INTERRUPT_OUT   = 0x05,
+            CAP_INTERRUPT_IN    = 0x06,
+            CAP_CLAIM           = 0x10,
+            CAP_CLEAR_HALT      = 0x11
+        };
+
+        std::ofstream m_capture;
+        std::ifstream m_replay;
+        bool m_replaying;
+        struct timeval m_capture_start;
+
         // General device info
         uint16_t m_vid, m_pid;
         std::string m_serial_no;
@@ -87,6 +169,20 @@ namespace labdev{
         // Reads information from interface descriptors
         void gather_interface_information();
 
+        // Appends a transfer record to the capture file
+        void capture(uint8_t type, uint8_t addr, uint8_t request_type,
+            uint16_t value, uint16_t index, int status, const uint8_t* data,
+            int len, const struct timeval& tsta);
+
+        // Serves the next record from the replay file, returns its status;
+        // IN data is copied to data (nbytes is set to its length, also for
+        // timed out transfers), OUT data is compared with data
+        int replay(uint8_t type, uint8_t addr, uint16_t value, uint16_t index,
+            uint8_t* data, int len, int* nbytes = nullptr);
+
+        // Releases the bulk transfer buffer
+        void free_transfer_buffer();
+
         void check_and_throw(int status, const std::string& msg) const;
         void check_interface();
     };
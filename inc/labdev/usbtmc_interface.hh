@@ -33,6 +33,15 @@ namespace labdev{
             VENDOR_SPECIFIC_IN          = 0x7F
         };
 
+        enum USBTMC_status : uint8_t {
+            STATUS_SUCCESS                  = 0x01,
+            STATUS_PENDING                  = 0x02,
+            STATUS_FAILED                   = 0x80,
+            STATUS_TRANSFER_NOT_IN_PROGRESS = 0x81,
+            STATUS_SPLIT_NOT_IN_PROGRESS    = 0x82,
+            STATUS_SPLIT_IN_PROGRESS        = 0x83
+        };
+
         enum bmTransferAttributes : uint16_t {
             EOM = 0x01,
             TERM_CHAR = 0x02
@@ -45,30 +54,128 @@ namespace labdev{
         Interface_type type() const override { return usbtmc; }
 
         // USBTMC device dependant data transfer
-        int write_dev_dep_msg(std::string msg,
+        int write_dev_dep_msg(const std::string& msg,
+            uint8_t transfer_attr = EOM);
+        // Writes data split into transfers of at most get_max_write_size()
+        int write_dev_dep_msg(const uint8_t* data, size_t len,
             uint8_t transfer_attr = EOM);
         std::string read_dev_dep_msg(int timeout_ms = s_dflt_timeout_ms,
             uint8_t transfer_attr = TERM_CHAR, uint8_t term_char = '\n');
+        // Reads one transfer of at most max_len bytes directly into data
+        int read_dev_dep_msg(uint8_t* data, size_t max_len,
+            int timeout_ms = s_dflt_timeout_ms, uint8_t transfer_attr = TERM_CHAR,
+            uint8_t term_char = '\n');
+        // Same without exceptions on timeouts: the transfer is aborted and
+        // io_timeout is returned with the number of bytes received so far
+        io_result<size_t> try_read_dev_dep_msg(uint8_t* data, size_t max_len,
+            int timeout_ms = s_dflt_timeout_ms,
+            uint8_t transfer_attr = TERM_CHAR, uint8_t term_char = '\n');
+
+        // Raw I/O uses the USBTMC protocol (see write/read_dev_dep_msg())
+        int write_raw(const uint8_t* data, size_t len) override;
+        int read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms = s_dflt_timeout_ms) override;
+        // Timeouts abort the pending Bulk-IN transfer before being reported,
+        // try_read_raw() does not throw (see try_read_dev_dep_msg())
+        io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms) override;
+        // EOM bit of the last DEV_DEP_MSG_IN transfer
+        bool end_of_message() const override { return m_eom; }
+
+        // Maximum number of bytes requested per Bulk-IN transfer
+        void set_max_read_size(uint32_t max_len) { m_max_read_size = max_len; }
+        uint32_t get_max_read_size() const { return m_max_read_size; }
+
+        // Maximum payload per Bulk-OUT transfer (device input buffer size)
+        void set_max_write_size(uint32_t len) { m_max_write_size = len; }
+        uint32_t get_max_write_size() const { return m_max_write_size; }
 
         // USBTMC vendor specific data transfer
-        int write_vendor_specific(std::string msg);
+        int write_vendor_specific(const std::string& msg);
         std::string read_vendor_specific(int timeout_ms = s_dflt_timeout_ms);
 
-        // USBTMC clear Bulk-IN/OUT buffers
+        // USBTMC clear Bulk-IN/OUT buffers and Bulk-OUT halt condition
         void clear_buffer();
 
+        // Abandon the transfer in progress and resynchronize the endpoint
+        void abort_bulk_in();
+        void abort_bulk_out();
+
+        // Device capabilities, read once by claim_interface()
+        uint16_t get_usbtmc_version() const {
+            return m_caps[2] | (m_caps[3] << 8); }
+        bool indicator_pulse_supported() const { return m_caps[4] & 0x04; }
+        bool talk_only() const { return m_caps[4] & 0x02; }
+        bool listen_only() const { return m_caps[4] & 0x01; }
+        bool term_char_supported() const { return m_caps[5] & 0x01; }
+
+        // Flashes the activity indicator of the device (if supported)
+        void indicator_pulse();
+
         // Claims interface and checks for USBTMC compatibility
         void claim_interface(int int_no, int alt_setting = 0);
 
-    private:
+    protected:
         static constexpr unsigned s_header_len = 12;
+        static constexpr size_t s_caps_len = 0x18;
+
+        // GET_CAPABILITIES response including subclass specific bytes
+        uint8_t m_caps[s_caps_len];
+
+        // Advances bTag, skipping the invalid value zero
+        void next_tag();
+
+        // Sends one Bulk-OUT transfer, payload is read from data without copies
+        void write_msg_out(uint8_t message_id, const uint8_t* data, size_t len,
+            uint8_t transfer_attr);
+
+    private:
         static constexpr uint8_t LIBUSB_SUBCLASS_TMC = 0x03;
+        // Largest wMaxPacketSize of bulk endpoints (USB 3.x)
+        static constexpr size_t s_max_packet_size = 1024;
+        // Request up to 64MB per transfer, large waveforms fit in one message
+        static constexpr uint32_t s_dflt_read_size = 64*1024*1024;
+        // Abort and clear status polls (1ms apart) before giving up
+        static constexpr unsigned s_max_status_polls = 500;
+        // Wait for the zero-length packet after a transfer ending on a packet
+        // boundary (devices not sending one delay the read by this time)
+        static constexpr int s_zlp_timeout_ms = 50;
+        static constexpr const char* s_timeout_msg =
+            "Bulk-IN transfer timed out";
 
         uint8_t m_cur_tag, m_term_char;
-        bool m_eom_cap;   // TODO: check if EOM is supported by device
+        bool m_eom;
+        uint32_t m_max_read_size, m_max_write_size;
+        // Scratch area for headers and partial packets of Bulk-OUT messages
+        uint8_t m_out_pkt[s_max_packet_size];
 
         void init();
 
+        // Sends a USBTMC class request and returns USBTMC_status
+        uint8_t class_request(uint8_t recipient, uint8_t request,
+            uint16_t value, uint16_t index, uint8_t* data, int len);
+
+        // Reads and discards Bulk-IN data until a short packet is received
+        void drain_bulk_in();
+
+        // Bulk packet size used to split transfers
+        size_t packet_size();
+
+        // Sends a Bulk-OUT request for an IN message of at most max_len bytes
+        void request_msg_in(uint8_t message_id, uint32_t max_len,
+            uint8_t transfer_attr, uint8_t term_char);
+
+        // Reads the first packet of an IN message, checks the header and
+        // returns TransferSize (at most max_len, the requested size); nfirst
+        // is the number of payload bytes received. Timeouts abort the transfer.
+        io_result<uint32_t> read_msg_in_header(uint8_t message_id,
+            uint32_t max_len, int timeout_ms, bool& eom, size_t& nfirst);
+
+        // Streams the payload directly into data, returns number of bytes read
+        // (also after a timeout, which aborts the transfer)
+        io_result<uint32_t> read_msg_in_payload(uint8_t* data,
+            uint32_t transfer_size, size_t nfirst, int timeout_ms);
+
         // Creates a USBTMC header
         void create_usbtmc_header(uint8_t* header, uint8_t message_id,
         uint8_t transfer_attr, uint32_t transfer_size, uint8_t term_char = 0x00);
@@ -0,0 +1,116 @@
+#ifndef LD_USBTMC_KERNEL_INTERFACE_H
+#define LD_USBTMC_KERNEL_INTERFACE_H
+
+#include <labdev/interface.hh>
+#include <labdev/exceptions.hh>
+
+#ifdef __linux__
+
+namespace labdev {
+
+    /*
+     *      USBTMC via the Linux kernel driver (/dev/usbtmcN); no kernel driver
+     *      has to be detached and service requests are received via poll()
+     */
+
+    class usbtmc_kernel_interface final : public interface {
+    public:
+        usbtmc_kernel_interface();
+        usbtmc_kernel_interface(const std::string& path);
+        ~usbtmc_kernel_interface();
+
+        // Open/close character device, e.g. "/dev/usbtmc0"
+        void open(const std::string& path);
+        void close() override;
+
+        int write_raw(const uint8_t* data, size_t len) override;
+        int read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms = s_dflt_timeout_ms) override;
+        io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms) override;
+        // Short reads end at EOM, otherwise the driver is asked for the
+        // attributes of the last transfer
+        bool end_of_message() const override;
+
+        Interface_type type() const override { return usbtmc; }
+
+        bool connected() const override { return m_connected; }
+
+        // USBTMC clear Bulk-IN/OUT buffers
+        void clear_buffer();
+
+        // Abandon the transfer in progress and resynchronize the endpoint
+        void abort_bulk_in();
+        void abort_bulk_out();
+
+        // Flashes the activity indicator of the device (if supported)
+        void indicator_pulse();
+
+        // USB488 capabilities (USBTMC488_CAPABILITY_* flags)
+        uint8_t get_usb488_capabilities() const { return m_caps488; }
+
+        // USB488 status byte, remote/local control, and trigger
+        uint8_t read_status_byte();
+        void remote_enable(bool enable = true);
+        void go_to_local();
+        void local_lockout();
+        void trigger();
+
+        // Service requests are signalled by the driver via POLLPRI
+        bool srq_supported() override;
+        bool wait_for_srq(unsigned timeout_ms) override;
+
+    private:
+        int m_fd;
+        std::string m_path;
+        bool m_connected;
+        unsigned m_timeout;
+        uint8_t m_caps488;
+        bool m_short_read;
+
+        // Sets driver I/O timeout (only if changed)
+        void set_timeout(unsigned timeout_ms);
+
+        void check_and_throw(int stat, const std::string& msg) const;
+    };
+}
+
+#else
+
+/*
+ *      Empty dummy class if the kernel driver is not available
+ */
+
+namespace labdev {
+    class usbtmc_kernel_interface final : public interface {
+    public:
+        usbtmc_kernel_interface() {
+            fprintf(stderr, "USBTMC kernel driver is only supported on Linux.\n");
+            abort();
+        }
+
+        usbtmc_kernel_interface(const std::string& path) :
+            usbtmc_kernel_interface() {}
+
+        ~usbtmc_kernel_interface() {}
+
+        void close() override {};
+
+        int write_raw(const uint8_t* data, size_t len) override { return -1; }
+        int read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms) override
+            { return -1; }
+
+        Interface_type type() const override { return usbtmc; }
+
+        bool connected() const override { return false; }
+
+        // Clear I/O buffers
+        void clear_buffer() {};
+
+    private:
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef LD_CONVERT_HH
+#define LD_CONVERT_HH
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labdev {
+
+    /*
+     *      Conversion of raw ADC codes to voltages (out = code * scale +
+     *      offset); uses SSE2, AVX2 or AVX-512 if the CPU supports it, the
+     *      instruction set is selected once at runtime
+     */
+
+    // Raw sample formats, 16 bit samples in little or big endian byte order
+    enum Sample_format : uint8_t { S8, U8, S16_LE, S16_BE };
+
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    static constexpr Sample_format S16_HOST = S16_BE;
+    #else
+    static constexpr Sample_format S16_HOST = S16_LE;
+    #endif
+
+    // Bytes per sample
+    inline size_t sample_size(Sample_format fmt)
+        { return ((fmt == S16_LE) || (fmt == S16_BE)) ? 2 : 1; }
+
+    // Converts n samples from in (n * sample_size() bytes, no alignment
+    // required) into out; results of different instruction sets can differ
+    // in the last bit if the compiler fuses multiply and add
+    void convert_samples(const uint8_t* in, Sample_format fmt, float* out,
+        size_t n, float scale, float offset);
+    void convert_samples(const uint8_t* in, Sample_format fmt, double* out,
+        size_t n, double scale, double offset);
+
+    // Instruction sets used for the conversion
+    enum Simd_level : uint8_t { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2,
+        SIMD_AVX512 };
+
+    // Returns the best instruction set supported by the CPU
+    Simd_level detect_simd_level();
+    // Currently used instruction set
+    Simd_level get_simd_level();
+    // Limits the instruction set, e.g. to compare kernels; levels not
+    // supported by the CPU fall back to the best supported one. Not thread
+    // safe, call before converting samples.
+    void set_simd_level(Simd_level level);
+    const char* simd_level_name(Simd_level level);
+
+}
+
+#endif
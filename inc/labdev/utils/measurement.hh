@@ -0,0 +1,48 @@
+#ifndef LD_MEASUREMENT_HH
+#define LD_MEASUREMENT_HH
+
+#include <labdev/utils/waveform.hh>
+
+#include <vector>
+
+namespace labdev {
+
+    /*
+     *      Waveform measurements computed on the host from one readout
+     *      instead of the on-screen statistics of the oscilloscope; items and
+     *      definitions follow ds1000z::measurement_item:
+     *      - VTOP/VBAS are the most frequent levels above/below the middle
+     *        of VMIN and VMAX (VMAX/VMIN without a flat top/base)
+     *      - OVER and PRES are relative to VAMP = VTOP - VBAS
+     *      - Edges are detected at 10%, 50% and 90% of VAMP with hysteresis,
+     *        RTIM/FTIM are the 10-90% times of the first edges, periods and
+     *        widths refer to the 50% crossings
+     *      - MAR is the area of the whole record, MPAR of the first period
+     *      - RDEL/FDEL are the delays from the first edges of the measured
+     *        channel to those of the reference, RPH/FPH the same in degrees
+     *        of the period of the measured channel
+     *      Items which cannot be determined (e.g. less than two edges or no
+     *      reference) are NaN.
+     */
+
+    struct measurements {
+        static constexpr unsigned s_n_items = 24;
+        double value[s_n_items];
+        // item is a ds1000z::measurement_item
+        double operator[](unsigned item) const { return value[item]; }
+    };
+
+    // Measures all items of one waveform, delays relative to ref
+    measurements measure(const waveform& wf, const waveform* ref = nullptr);
+    // Same for the output of read_sample_data() (equidistant samples)
+    measurements measure(const std::vector<double>& horz,
+        const std::vector<double>& vert,
+        const std::vector<double>* ref_vert = nullptr);
+    // Measures all channels in parallel (one thread per channel), delays
+    // relative to wfs[ref]
+    std::vector<measurements> measure(const std::vector<waveform>& wfs,
+        size_t ref = 0);
+
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef LD_SCPI_CMD_HH
+#define LD_SCPI_CMD_HH
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ *      Creates a SCPI command from a format string with '{}' placeholders,
+ *      the number of placeholders and arguments is checked at compile time:
+ *          SCPI_CMD(":CHAN{}:SCAL {}\n", channel, volts_per_div)
+ */
+
+#define SCPI_CMD(fmt, ...) labdev::scpi_cmd( \
+    labdev::scpi_cmd::check_format<labdev::scpi_cmd::count_placeholders(fmt), \
+        sizeof(labdev::scpi_cmd_nargs(__VA_ARGS__)) - 1>(fmt), __VA_ARGS__)
+
+namespace labdev {
+
+    /*
+     *      SCPI command formatted into a fixed size stack buffer (independent
+     *      of the current locale); only commands longer than s_max_len (e.g.
+     *      long string parameters) are continued on the heap
+     */
+
+    class scpi_cmd {
+    public:
+        static constexpr size_t s_max_len = 256;
+
+        // Use SCPI_CMD() to get the argument count checked at compile time
+        template<typename... Args>
+        scpi_cmd(const char* fmt, const Args&... args) : m_len(0) {
+            this->format(fmt, args...);
+            if ( m_heap.empty() )
+                m_buf[m_len] = '\0';
+        }
+
+        const char* data() const
+            { return m_heap.empty() ? m_buf : m_heap.c_str(); }
+        const char* c_str() const { return this->data(); }
+        size_t size() const { return m_len; }
+        std::string str() const { return std::string(this->data(), m_len); }
+
+        // Number of '{}' placeholders in a format string
+        static constexpr size_t count_placeholders(const char* fmt,
+            size_t n = 0) {
+            return (fmt[0] == '\0') ? n :
+                ((fmt[0] == '{') && (fmt[1] == '}')) ?
+                    count_placeholders(fmt + 2, n + 1) :
+                    count_placeholders(fmt + 1, n);
+        }
+
+        template<size_t nplaceholders, size_t nargs>
+        static constexpr const char* check_format(const char* fmt) {
+            static_assert(nplaceholders == nargs,
+                "Number of SCPI command arguments does not match format");
+            return fmt;
+        }
+
+    private:
+        char m_buf[s_max_len + 1];
+        size_t m_len;
+        // Whole command once it does not fit into m_buf
+        std::string m_heap;
+
+        // Copies format string up to the next placeholder, returns position
+        // after the placeholder or nullptr if none is left
+        const char* copy_until_placeholder(const char* fmt);
+
+        void format(const char* fmt) {
+            if ( this->copy_until_placeholder(fmt) )
+                this->fail("Missing SCPI command argument");
+        }
+
+        template<typename T, typename... Args>
+        void format(const char* fmt, const T& arg, const Args&... args) {
+            fmt = this->copy_until_placeholder(fmt);
+            if (!fmt)
+                this->fail("Too many SCPI command arguments");
+            this->append(arg);
+            this->format(fmt, args...);
+        }
+
+        // Supported argument types
+        void append(long long val);
+        void append(unsigned long long val);
+        void append(int val) { this->append((long long)val); }
+        void append(long val) { this->append((long long)val); }
+        void append(unsigned val) { this->append((unsigned long long)val); }
+        void append(unsigned long val)
+            { this->append((unsigned long long)val); }
+        void append(bool val) { this->append(val ? "1" : "0"); }
+        void append(double val);
+        void append(float val) { this->append((double)val); }
+        void append(const char* str);
+        void append(const std::string& str);
+        void append(char c);
+
+        void append_raw(const char* str, size_t len);
+        // Aborts on invalid format strings
+        [[noreturn]] void fail(const char* reason) const;
+    };
+
+    // Argument counter for SCPI_CMD(), only used in unevaluated context
+    template<typename... Args>
+    char (&scpi_cmd_nargs(const Args&...))[sizeof...(Args) + 1];
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LD_SCPI_PARSER_HH
+#define LD_SCPI_PARSER_HH
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace labdev {
+
+    /*
+     *      Parser for IEEE 488.2 response data (NR1/NR2/NR3 numbers, booleans,
+     *      character data, strings, comma separated lists); reads directly
+     *      from the receive buffer without allocations and independent of the
+     *      current locale
+     */
+
+    class scpi_parser {
+    public:
+        // The buffer must stay valid while parsing (no copy is made)
+        scpi_parser(const char* data, size_t len);
+        scpi_parser(const std::string& resp);
+
+        // Each read consumes one list element including the following ',' or
+        // ';' separator; returns false if the element has a different type
+        bool read_int(int64_t& val);
+        bool read_double(double& val);
+        bool read_bool(bool& val);
+        // Character data (e.g. RIS), str points into the buffer
+        bool read_chars(const char*& str, size_t& len);
+        // String data without the enclosing quotes, doubled quotes inside the
+        // string are not unescaped; str points into the buffer
+        bool read_string(const char*& str, size_t& len);
+
+        // Skips the current list element
+        bool skip();
+
+        // Returns true if all elements have been read
+        bool at_end();
+
+        // Number of characters left in the buffer
+        size_t remaining() const { return m_end - m_pos; }
+
+    private:
+        const char* m_pos;
+        const char* m_end;
+
+        // Skips whitespace and line terminators
+        void skip_ws();
+        // Consumes list separator, returns false if element is not terminated
+        bool next_element();
+        // Parses a decimal number into mantissa and base 10 exponent
+        bool read_decimal(uint64_t& mant, int& exp10, bool& neg);
+        // Parses #H, #Q, #B non-decimal numeric data
+        bool read_non_decimal(uint64_t& val);
+    };
+
+    // Convenience functions for single value responses, throw bad_protocol if
+    // the response cannot be parsed
+    int parse_int(const std::string& resp);
+    double parse_double(const std::string& resp);
+    bool parse_bool(const std::string& resp);
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef LD_SPSC_QUEUE_HH
+#define LD_SPSC_QUEUE_HH
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace labdev {
+
+    /*
+     *      Lock-free bounded queue for exactly one producer and one consumer
+     *      thread; push() and pop() never block and return false if the
+     *      queue is full or empty
+     */
+
+    template<typename T>
+    class spsc_queue {
+    public:
+        spsc_queue(size_t capacity) : m_buf(capacity + 1), m_head(0),
+            m_tail(0) {};
+
+        spsc_queue(const spsc_queue&) = delete;
+        spsc_queue& operator=(const spsc_queue&) = delete;
+
+        // Producer side
+        bool push(const T& val) {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t next = this->next(tail);
+            if ( next == m_head.load(std::memory_order_acquire) )
+                return false;
+            m_buf[tail] = val;
+            m_tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side
+        bool pop(T& val) {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if ( head == m_tail.load(std::memory_order_acquire) )
+                return false;
+            val = m_buf[head];
+            m_head.store(this->next(head), std::memory_order_release);
+            return true;
+        }
+
+        // Only exact if neither side is active
+        size_t size() const {
+            size_t head = m_head.load(std::memory_order_acquire);
+            size_t tail = m_tail.load(std::memory_order_acquire);
+            return (tail >= head) ? tail - head : tail + m_buf.size() - head;
+        }
+        bool empty() const { return this->size() == 0; }
+        size_t capacity() const { return m_buf.size() - 1; }
+
+    private:
+        std::vector<T> m_buf;
+        // Head and tail on separate cache lines, producer and consumer do not
+        // invalidate each other's line on every access
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+
+        size_t next(size_t pos) const
+            { return (pos + 1 == m_buf.size()) ? 0 : pos + 1; }
+    };
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef LD_WAVEFORM_HH
+#define LD_WAVEFORM_HH
+
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+
+namespace labdev {
+
+    /*
+     *      Read-only view of contiguous samples (begin/end, size, [])
+     */
+
+    template<typename T>
+    class sample_span {
+    public:
+        sample_span(const T* data, size_t len) : m_data(data), m_len(len) {};
+
+        const T* data() const { return m_data; }
+        size_t size() const { return m_len; }
+        bool empty() const { return m_len == 0; }
+        const T& operator[](size_t i) const { return m_data[i]; }
+        const T* begin() const { return m_data; }
+        const T* end() const { return m_data + m_len; }
+
+    private:
+        const T* m_data;
+        size_t m_len;
+    };
+
+    /*
+     *      Oscilloscope waveform stored as raw ADC codes (1 or 2 bytes per
+     *      sample) together with the scaling of the preamble; time and
+     *      voltage are computed on demand:
+     *          time(i)    = (i - xref) * xincr + xorg
+     *          voltage(i) = (code(i) - yref) * yinc + yorg
+     *
+     *      The sample buffer is kept when the waveform is refilled, reading
+     *      into the same waveform repeatedly does not allocate.
+     */
+
+    class waveform {
+    public:
+        // Raw sample types, 16 bit samples are stored in host byte order
+        enum Sample_type : uint8_t { INT8, UINT8, INT16 };
+
+        // One sample converted to time and voltage
+        struct point {
+            double time;
+            double voltage;
+        };
+
+        waveform();
+        waveform(Sample_type type, size_t npts);
+
+        // Sets type and number of samples; the content of the raw buffer is
+        // undefined until filled through raw_data()
+        void resize(Sample_type type, size_t npts);
+        void clear();
+
+        // Scaling from sample index to time and from ADC code to voltage
+        void set_horz_scale(double xincr, double xorg, double xref = 0.);
+        void set_vert_scale(double yinc, double yorg, double yref = 0.);
+
+        double get_xincr() const { return m_xincr; }
+        double get_xorg() const { return m_xorg; }
+        double get_xref() const { return m_xref; }
+        double get_yinc() const { return m_yinc; }
+        double get_yorg() const { return m_yorg; }
+        double get_yref() const { return m_yref; }
+
+        size_t size() const { return m_npts; }
+        bool empty() const { return m_npts == 0; }
+        Sample_type type() const { return m_type; }
+        // Bytes per sample
+        size_t sample_size() const { return (m_type == INT16) ? 2 : 1; }
+
+        // Raw buffer of size() * sample_size() bytes
+        uint8_t* raw_data() { return m_raw.data(); }
+        const uint8_t* raw_data() const { return m_raw.data(); }
+        size_t raw_size() const { return m_npts * this->sample_size(); }
+
+        // Typed access to the raw samples, T has to match type() (aborts
+        // otherwise)
+        template<typename T>
+        sample_span<T> samples() const;
+
+        // Single sample access
+        int code(size_t i) const;
+        double time(size_t i) const
+            { return ((double)i - m_xref) * m_xincr + m_xorg; }
+        double voltage(size_t i) const
+            { return ((double)this->code(i) - m_yref) * m_yinc + m_yorg; }
+        point at(size_t i) const
+            { point ret = {this->time(i), this->voltage(i)}; return ret; }
+
+        // Converts n samples starting at first into out
+        void to_voltage(float* out, size_t first, size_t n) const;
+        void to_voltage(double* out, size_t first, size_t n) const;
+        void to_time(double* out, size_t first, size_t n) const;
+
+        // Converts all samples
+        std::vector<double> voltages() const;
+        std::vector<float> voltages_float() const;
+        std::vector<double> times() const;
+
+        // Adapter for the vector based oscilloscope::read_sample_data()
+        void to_vectors(std::vector<double>& horz_data,
+            std::vector<double>& vert_data) const;
+
+        // Iterates over the samples as points
+        class const_iterator {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef point value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const point* pointer;
+            typedef point reference;
+
+            const_iterator() : m_wf(nullptr), m_pos(0) {};
+            const_iterator(const waveform* wf, size_t pos) :
+                m_wf(wf), m_pos(pos) {};
+
+            point operator*() const { return m_wf->at(m_pos); }
+            point operator[](difference_type n) const
+                { return m_wf->at(m_pos + n); }
+
+            const_iterator& operator++() { m_pos++; return *this; }
+            const_iterator operator++(int)
+                { const_iterator ret(*this); m_pos++; return ret; }
+            const_iterator& operator--() { m_pos--; return *this; }
+            const_iterator operator--(int)
+                { const_iterator ret(*this); m_pos--; return ret; }
+            const_iterator& operator+=(difference_type n)
+                { m_pos += n; return *this; }
+            const_iterator& operator-=(difference_type n)
+                { m_pos -= n; return *this; }
+            const_iterator operator+(difference_type n) const
+                { return const_iterator(m_wf, m_pos + n); }
+            const_iterator operator-(difference_type n) const
+                { return const_iterator(m_wf, m_pos - n); }
+            difference_type operator-(const const_iterator& other) const
+                { return (difference_type)(m_pos - other.m_pos); }
+
+            bool operator==(const const_iterator& other) const
+                { return m_pos == other.m_pos; }
+            bool operator!=(const const_iterator& other) const
+                { return m_pos != other.m_pos; }
+            bool operator<(const const_iterator& other) const
+                { return m_pos < other.m_pos; }
+
+        private:
+            const waveform* m_wf;
+            size_t m_pos;
+        };
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, m_npts); }
+
+    private:
+        Sample_type m_type;
+        size_t m_npts;
+        std::vector<uint8_t> m_raw;
+        double m_xincr, m_xorg, m_xref;
+        double m_yinc, m_yorg, m_yref;
+
+        // Aborts if T does not match the sample type
+        void check_type(Sample_type type) const;
+    };
+
+    template<> inline sample_span<int8_t> waveform::samples<int8_t>() const {
+        this->check_type(INT8);
+        return sample_span<int8_t>((const int8_t*)m_raw.data(), m_npts);
+    }
+
+    template<> inline sample_span<uint8_t> waveform::samples<uint8_t>() const {
+        this->check_type(UINT8);
+        return sample_span<uint8_t>(m_raw.data(), m_npts);
+    }
+
+    template<> inline sample_span<int16_t> waveform::samples<int16_t>() const {
+        this->check_type(INT16);
+        return sample_span<int16_t>((const int16_t*)m_raw.data(), m_npts);
+    }
+
+}
+
+#endif
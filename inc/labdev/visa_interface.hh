@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 #include <labdev/interface.hh>
 #include <labdev/exceptions.hh>
@@ -16,7 +17,7 @@
 #endif
 
 namespace labdev {
-    class visa_interface : public interface {
+    class visa_interface final : public interface {
     public:
         visa_interface();
         visa_interface(std::string visa_id);
@@ -32,6 +33,19 @@ namespace labdev {
 
         int write_raw(const uint8_t* data, size_t len) override;
         int read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms) override;
+        io_result<size_t> try_read_raw(uint8_t* data, size_t max_len,
+            unsigned timeout_ms) override;
+        // END indicator received with the last read
+        bool end_of_message() const override { return m_end; }
+
+        // Asynchronous I/O, buffers must stay valid until the job completed
+        ViJobId write_async(const uint8_t* data, size_t len);
+        ViJobId read_async(uint8_t* data, size_t max_len);
+        // Blocks until the job has completed, returns number of bytes
+        // transferred
+        size_t wait_async(ViJobId job, unsigned timeout_ms = s_dflt_timeout_ms);
+        // Aborts a pending job, wait_async() then throws bad_io for the job
+        void cancel_async(ViJobId job);
 
         Interface_type type() const override { return visa; }
 
@@ -52,8 +66,17 @@ namespace labdev {
         std::string m_visa_id;
         bool m_connected;
         unsigned m_timeout;
+        bool m_end;
+
+        // Completion events are queued once the first job was started; results
+        // of jobs completed while waiting for others are stored (status, count)
+        bool m_async_enabled;
+        std::map<ViJobId, std::pair<ViStatus, ViUInt32>> m_completed_jobs;
 
         void init();
+
+        // Enables queueing of I/O completion events
+        void enable_async();
         void check_and_throw(ViStatus stat, const std::string &msg) const;
     };
 }
@@ -65,7 +88,7 @@ namespace labdev {
  */
 
 namespace labdev {
-    class visa_interface : public interface {
+    class visa_interface final : public interface {
     public:
         visa_interface() {
             fprintf(stderr, "labdev compiled without VISA support. To enable recompile using 'make VISA=1'.\n");
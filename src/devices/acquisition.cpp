@@ -0,0 +1,185 @@
+#include <labdev/devices/acquisition.hh>
+#include <labdev/exceptions.hh>
+#include "ld_debug.hh"
+
+#include <unistd.h>
+
+namespace labdev {
+
+    acquisition::acquisition(oscilloscope* osc,
+    const std::vector<unsigned>& channels, size_t nframes):
+    m_osc(osc),
+    m_channels(channels),
+    m_frames(nframes),
+    m_free(nframes),
+    m_filled(nframes),
+    m_policy(BLOCK),
+    m_poll_interval_ms(s_dflt_poll_interval_ms),
+    m_producer(),
+    m_running(false),
+    m_ntriggers(0),
+    m_nacquired(0),
+    m_ndropped(0),
+    m_error(),
+    m_pending(nullptr) {
+        if ( !osc || channels.empty() || (nframes == 0) ) {
+            fprintf(stderr, "Invalid acquisition setup\n");
+            abort();
+        }
+        for (size_t i = 0; i < nframes; i++)
+            m_free.push(&m_frames[i]);
+        return;
+    }
+
+    acquisition::~acquisition() {
+        this->stop();
+        return;
+    }
+
+    void acquisition::set_overflow_policy(Overflow_policy policy) {
+        if ( this->running() ) {
+            fprintf(stderr, "Cannot change overflow policy while running\n");
+            abort();
+        }
+        m_policy = policy;
+        return;
+    }
+
+    void acquisition::set_poll_interval(unsigned interval_ms) {
+        if ( this->running() ) {
+            fprintf(stderr, "Cannot change poll interval while running\n");
+            abort();
+        }
+        m_poll_interval_ms = interval_ms;
+        return;
+    }
+
+    void acquisition::start() {
+        if ( this->running() )
+            return;
+        // Join a producer that terminated with an error
+        if ( m_producer.joinable() )
+            m_producer.join();
+        m_error = nullptr;
+        m_ntriggers = 0;
+        m_nacquired = 0;
+        m_ndropped = 0;
+        debug_print("Starting acquisition of %zu channels\n",
+            m_channels.size());
+        m_running = true;
+        m_producer = std::thread(&acquisition::produce, this);
+        return;
+    }
+
+    void acquisition::stop() {
+        m_running = false;
+        if ( m_producer.joinable() )
+            m_producer.join();
+        debug_print("Acquisition stopped (%lu triggers, %lu dropped)\n",
+            (unsigned long)m_ntriggers.load(),
+            (unsigned long)m_ndropped.load());
+        return;
+    }
+
+    acquisition_frame* acquisition::next(unsigned timeout_ms) {
+        struct timeval tsta, tnow;
+        gettimeofday(&tsta, NULL);
+        // Short sleeps first, frames are usually already waiting
+        unsigned sleep_us = 50;
+        acquisition_frame* frame = nullptr;
+        while ( !m_filled.pop(frame) ) {
+            if ( !this->running() && m_error ) {
+                std::exception_ptr error = m_error;
+                m_error = nullptr;
+                std::rethrow_exception(error);
+            }
+            gettimeofday(&tnow, NULL);
+            long elapsed_ms = (tnow.tv_sec - tsta.tv_sec) * 1000 +
+                (tnow.tv_usec - tsta.tv_usec) / 1000;
+            if (elapsed_ms >= (long)timeout_ms)
+                return nullptr;
+            usleep(sleep_us);
+            if (sleep_us < 1000)
+                sleep_us *= 2;
+        }
+        return frame;
+    }
+
+    void acquisition::release(acquisition_frame* frame) {
+        if ( (frame < m_frames.data()) ||
+             (frame >= m_frames.data() + m_frames.size()) ) {
+            fprintf(stderr, "Frame does not belong to this acquisition\n");
+            abort();
+        }
+        m_free.push(frame);
+        return;
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    void acquisition::produce() {
+        acquisition_frame* frame = nullptr;
+        try {
+            while ( this->running() ) {
+                frame = this->get_free_frame();
+                if ( !this->running() )
+                    break;
+
+                if ( !this->wait_stopped() )
+                    break;
+                uint64_t trigger = m_ntriggers++;
+                if (!frame) {
+                    debug_print("No free frame, dropped trigger %lu\n",
+                        (unsigned long)trigger);
+                    m_ndropped++;
+                    continue;
+                }
+
+                m_osc->read_channels(m_channels, frame->wfs);
+                frame->trigger = trigger;
+                gettimeofday(&frame->time, NULL);
+                m_filled.push(frame);
+                frame = nullptr;
+                m_nacquired++;
+            }
+        } catch (...) {
+            m_error = std::current_exception();
+            debug_print("%s\n", "Acquisition terminated by an error");
+        }
+        // Only the consumer returns frames to the free queue, an unused
+        // frame is kept for the next start()
+        m_pending = frame;
+        m_running = false;
+        return;
+    }
+
+    acquisition_frame* acquisition::get_free_frame() {
+        acquisition_frame* frame = m_pending;
+        m_pending = nullptr;
+        if (frame)
+            return frame;
+        while ( !m_free.pop(frame) ) {
+            if ( (m_policy == DROP) || !this->running() )
+                return nullptr;
+            usleep(m_poll_interval_ms * 1000);
+        }
+        return frame;
+    }
+
+    bool acquisition::wait_stopped() {
+        // Right after single_shot() the status can still be the STOP of the
+        // previous acquisition, which would be read again as a new trigger;
+        // the start is confirmed before polling for the stop
+        if ( !m_osc->single_shot_sync(s_start_timeout_ms) )
+            debug_print("%s\n", "Acquisition did not start, assuming it has "
+                "already completed");
+        while ( !m_osc->wait_for_stop(s_stop_check_ms) ) {
+            if ( !this->running() )
+                return false;
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,322 @@
+#include <labdev/devices/generic_scpi_device.hh>
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/utils/scpi_cmd.hh>
+#include <labdev/exceptions.hh>
+#include "ld_debug.hh"
+
+#include <fstream>
+#include <sstream>
+
+namespace labdev {
+
+    static const char* s_type_names[] = {"int", "double", "bool", "enum",
+        "string"};
+
+    generic_scpi_device::generic_scpi_device(interface* comm,
+    const std::string& desc_path):
+    scpi_device(comm),
+    m_nchannels(0) {
+        this->load(desc_path);
+        return;
+    }
+
+    void generic_scpi_device::load(const std::string& desc_path) {
+        std::ifstream file(desc_path, std::ifstream::in);
+        debug_print("Reading device description '%s'\n", desc_path.c_str());
+        if ( file.fail() ) {
+            fprintf(stderr, "Cannot open file %s\n", desc_path.c_str());
+            abort();
+        }
+
+        m_params.clear();
+        m_param_ids.clear();
+        m_nchannels = 0;
+        this->invalidate_cache();
+
+        std::string line;
+        unsigned lineno = 0;
+        while ( getline(file, line) ) {
+            lineno++;
+            // Skip empty lines and comments
+            size_t sta = line.find_first_not_of(" \t\r");
+            if ( (sta == std::string::npos) || (line.at(sta) == '#') )
+                continue;
+            this->parse_line(line, lineno);
+        }
+        debug_print("Loaded %zu parameters\n", m_params.size());
+        return;
+    }
+
+    size_t generic_scpi_device::get_param(const std::string& name) const {
+        std::map<std::string, size_t>::const_iterator it =
+            m_param_ids.find(name);
+        if ( it == m_param_ids.end() ) {
+            fprintf(stderr, "Unknown parameter '%s'\n", name.c_str());
+            abort();
+        }
+        return it->second;
+    }
+
+    const std::string& generic_scpi_device::get_name(size_t param) const {
+        return m_params.at(param).name;
+    }
+
+    generic_scpi_device::Param_type generic_scpi_device::get_type(
+    size_t param) const {
+        return m_params.at(param).type;
+    }
+
+    const std::string& generic_scpi_device::get_unit(size_t param) const {
+        return m_params.at(param).unit;
+    }
+
+    void generic_scpi_device::set_int(size_t param, int64_t val,
+    unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_INT, channel);
+        this->check_range(par, val);
+        this->write_param(par, channel, (long long)val);
+        return;
+    }
+
+    int64_t generic_scpi_device::get_int(size_t param, unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_INT, channel);
+        return parse_int( this->query_param(par, channel) );
+    }
+
+    void generic_scpi_device::set_double(size_t param, double val,
+    unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_DOUBLE, channel);
+        this->check_range(par, val);
+        this->write_param(par, channel, val);
+        return;
+    }
+
+    double generic_scpi_device::get_double(size_t param, unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_DOUBLE, channel);
+        return parse_double( this->query_param(par, channel) );
+    }
+
+    void generic_scpi_device::set_bool(size_t param, bool val,
+    unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_BOOL, channel);
+        this->write_param(par, channel, val);
+        return;
+    }
+
+    bool generic_scpi_device::get_bool(size_t param, unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_BOOL, channel);
+        return parse_bool( this->query_param(par, channel) );
+    }
+
+    void generic_scpi_device::set_enum(size_t param, const std::string& val,
+    unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_ENUM, channel);
+        bool valid = false;
+        for (size_t i = 0; i < par.values.size(); i++)
+            valid |= (par.values[i] == val);
+        if (!valid) {
+            fprintf(stderr, "Invalid value '%s' for %s\n", val.c_str(),
+                par.name.c_str());
+            abort();
+        }
+        this->write_param(par, channel, val);
+        return;
+    }
+
+    std::string generic_scpi_device::get_enum(size_t param, unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_ENUM, channel);
+        std::string resp = this->query_param(par, channel);
+        scpi_parser parser(resp);
+        const char* str;
+        size_t len;
+        if ( !parser.read_chars(str, len) )
+            throw bad_protocol("Received invalid character data");
+        return std::string(str, len);
+    }
+
+    void generic_scpi_device::set_string(size_t param, const std::string& val,
+    unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_STRING, channel);
+        // Quotes inside the string are doubled
+        std::string quoted("\"");
+        for (size_t i = 0; i < val.size(); i++) {
+            if (val[i] == '"')
+                quoted.push_back('"');
+            quoted.push_back(val[i]);
+        }
+        quoted.push_back('"');
+        this->write_param(par, channel, quoted);
+        return;
+    }
+
+    std::string generic_scpi_device::get_string(size_t param,
+    unsigned channel) {
+        const param_desc& par = this->check_param(param, PARAM_STRING, channel);
+        std::string resp = this->query_param(par, channel);
+        scpi_parser parser(resp);
+        const char* str;
+        size_t len;
+        if ( !parser.read_string(str, len) )
+            throw bad_protocol("Received invalid string data");
+        // Doubled quotes are unescaped like set_string() escaped them, str
+        // follows the opening quote
+        char quote = str[-1];
+        std::string ret;
+        ret.reserve(len);
+        for (size_t i = 0; i < len; i++) {
+            ret.push_back(str[i]);
+            if ( (str[i] == quote) && (i + 1 < len) && (str[i+1] == quote) )
+                i++;
+        }
+        return ret;
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    void generic_scpi_device::parse_line(const std::string& line,
+    unsigned lineno) {
+        std::stringstream line_stream(line);
+        std::string name, type, header;
+        line_stream >> name;
+
+        if (name == "channels") {
+            if ( !(line_stream >> m_nchannels) ) {
+                fprintf(stderr, "Line %u: invalid number of channels\n",
+                    lineno);
+                abort();
+            }
+            return;
+        }
+
+        if ( !(line_stream >> type >> header) ) {
+            fprintf(stderr, "Line %u: missing type or header of '%s'\n",
+                lineno, name.c_str());
+            abort();
+        }
+        if ( m_param_ids.count(name) ) {
+            fprintf(stderr, "Line %u: parameter '%s' defined twice\n", lineno,
+                name.c_str());
+            abort();
+        }
+
+        param_desc par;
+        par.name = name;
+        par.has_range = false;
+        par.min = 0;
+        par.max = 0;
+        size_t ntypes = sizeof(s_type_names)/sizeof(s_type_names[0]);
+        size_t itype = 0;
+        while ( (itype < ntypes) && (type != s_type_names[itype]) )
+            itype++;
+        if (itype == ntypes) {
+            fprintf(stderr, "Line %u: unknown type '%s'\n", lineno,
+                type.c_str());
+            abort();
+        }
+        par.type = (Param_type)itype;
+
+        // Formats are prepared once, channel placeholder is kept for scpi_cmd
+        size_t nplaceholders = scpi_cmd::count_placeholders(header.c_str());
+        if (nplaceholders > 1) {
+            fprintf(stderr, "Line %u: more than one channel placeholder\n",
+                lineno);
+            abort();
+        }
+        par.per_channel = (nplaceholders == 1);
+        par.set_fmt = header + " {}\n";
+        par.query_fmt = header + "?\n";
+
+        // Optional range or enum values followed by optional unit
+        std::vector<std::string> args;
+        std::string arg;
+        while (line_stream >> arg)
+            args.push_back(arg);
+        size_t iunit = 0;
+        if (par.type == PARAM_ENUM) {
+            if ( args.empty() ) {
+                fprintf(stderr, "Line %u: missing values of '%s'\n", lineno,
+                    name.c_str());
+                abort();
+            }
+            std::stringstream values(args[0]);
+            std::string val;
+            while ( getline(values, val, ',') )
+                par.values.push_back(val);
+            iunit = 1;
+        } else if ( ((par.type == PARAM_INT) || (par.type == PARAM_DOUBLE)) &&
+                    (args.size() >= 2) ) {
+            double min, max;
+            scpi_parser range(args[0] + "," + args[1]);
+            if ( !range.read_double(min) || !range.read_double(max) ||
+                 (min > max) ) {
+                fprintf(stderr, "Line %u: invalid range of '%s'\n", lineno,
+                    name.c_str());
+                abort();
+            }
+            par.has_range = true;
+            par.min = min;
+            par.max = max;
+            iunit = 2;
+        }
+        if (args.size() > iunit)
+            par.unit = args[iunit];
+
+        debug_print("  %s (%s): '%s'\n", name.c_str(), type.c_str(),
+            header.c_str());
+        m_param_ids[name] = m_params.size();
+        m_params.push_back(par);
+        return;
+    }
+
+    const generic_scpi_device::param_desc&
+    generic_scpi_device::check_param(size_t id, Param_type type,
+    unsigned channel) const {
+        if (id >= m_params.size()) {
+            fprintf(stderr, "Invalid parameter handle %zu\n", id);
+            abort();
+        }
+        const param_desc& par = m_params[id];
+        if (par.type != type) {
+            fprintf(stderr, "Parameter '%s' is of type %s\n",
+                par.name.c_str(), s_type_names[par.type]);
+            abort();
+        }
+        if ( par.per_channel && ((channel == 0) ||
+             (m_nchannels && (channel > m_nchannels))) ) {
+            fprintf(stderr, "Invalid channel %u\n", channel);
+            abort();
+        }
+        return par;
+    }
+
+    void generic_scpi_device::check_range(const param_desc& par,
+    double val) const {
+        if ( par.has_range && ((val < par.min) || (val > par.max)) ) {
+            fprintf(stderr, "%s %g %s out of range\n", par.name.c_str(), val,
+                par.unit.c_str());
+            abort();
+        }
+        return;
+    }
+
+    template<typename T>
+    void generic_scpi_device::write_param(const param_desc& par,
+    unsigned channel, const T& val) {
+        if (par.per_channel)
+            this->send_cached( scpi_cmd(par.set_fmt.c_str(), channel, val) );
+        else
+            this->send_cached( scpi_cmd(par.set_fmt.c_str(), val) );
+        return;
+    }
+
+    std::string generic_scpi_device::query_param(const param_desc& par,
+    unsigned channel) {
+        if (par.per_channel)
+            return this->query_cached( scpi_cmd(par.query_fmt.c_str(),
+                channel) );
+        return this->query_cached( scpi_cmd(par.query_fmt.c_str()) );
+    }
+
+}
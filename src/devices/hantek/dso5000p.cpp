@@ -122,8 +122,8 @@ namespace labdev {
         return false;
     };
 
-    void dso5000p::read_sample_data(unsigned channel,  
-    std::vector<double> &horz_data, std::vector<double> &vert_data) {
+    void dso5000p::read_waveform(unsigned channel, waveform& wf) {
+        wf.clear();
         return;
     }
     
@@ -589,7 +589,7 @@ namespace labdev {
 
     int dso5000p::read_pkg(uint8_t mark, uint8_t cmd, uint8_t* payload,
     int timeout_ms) {
-        uint8_t packet[MAX_BUF_SIZE];
+        uint8_t* packet = comm->get_transfer_buffer(MAX_BUF_SIZE);
         uint8_t marker = 0x00, command = 0x00;
         int pkt_len = comm->read_bulk(packet, MAX_BUF_SIZE, timeout_ms);
         int payload_len = this->extract_pkt(packet, pkt_len, marker, command,
@@ -619,11 +619,12 @@ namespace labdev {
     }
 
     void dso5000p::flush_buffer() {
-        uint8_t buf[MAX_BUF_SIZE];
+        uint8_t* buf = comm->get_transfer_buffer(MAX_BUF_SIZE);
         // Read until nothing left to be read...
-        try {
-            while ( comm->read_bulk(buf, MAX_BUF_SIZE, 100) > 0) { }
-        } catch (const timeout& ex) { }
+        io_result<int> nbytes;
+        do {
+            nbytes = comm->try_read_bulk(buf, MAX_BUF_SIZE, 100);
+        } while ( nbytes && (nbytes.value > 0) );
         return;
     }
 
@@ -279,10 +279,7 @@ namespace labdev {
 
     void xenax_xvi_75v8::flush_buffer() {
         debug_print("%s\n", "flushing read buffer...");
-        while (true) {
-            try { comm->read(200); }
-            catch (const timeout &ex) { break; }
-        }
+        while ( comm->try_read(200) ) { }
         m_input_buffer.clear();
         debug_print("%s\n", "buffer flushed");
         return;
@@ -1,6 +1,102 @@
 #include <labdev/devices/oscilloscope.hh>
+#include <labdev/exceptions.hh>
 #include "ld_debug.hh"
 
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+
 namespace labdev {
 
-}
\ No newline at end of file
+    void oscilloscope::read_sample_data(unsigned channel,
+    std::vector<double> &horz_data, std::vector<double> &vert_data) {
+        waveform wf;
+        this->read_waveform(channel, wf);
+        wf.to_vectors(horz_data, vert_data);
+        return;
+    }
+
+    bool oscilloscope::single_shot_sync(unsigned timeout_ms) {
+        this->single_shot();
+        return this->wait_for_start(timeout_ms);
+    }
+
+    bool oscilloscope::wait_for_trigger(unsigned timeout_ms) {
+        // A fast single shot passes TD between two polls
+        return this->poll_until(&oscilloscope::triggered_or_stopped,
+            timeout_ms);
+    }
+
+    bool oscilloscope::wait_for_stop(unsigned timeout_ms) {
+        return this->poll_until(&oscilloscope::stopped, timeout_ms);
+    }
+
+    bool oscilloscope::wait_for_start(unsigned timeout_ms) {
+        return this->poll_until(&oscilloscope::running, timeout_ms);
+    }
+
+    void oscilloscope::read_channels(const std::vector<unsigned>& channels,
+    std::vector<waveform>& wfs) {
+        // All channels have to come from the same trigger
+        this->stop_acquisition();
+        wfs.resize(channels.size());
+        for (size_t i = 0; i < channels.size(); i++) {
+            this->read_waveform(channels[i], wfs[i]);
+            if ( (wfs[i].size() != wfs[0].size()) ||
+                 (wfs[i].get_xincr() != wfs[0].get_xincr()) ||
+                 (wfs[i].get_xorg() != wfs[0].get_xorg()) ) {
+                debug_print("Channel %u is not aligned with channel %u\n",
+                    channels[i], channels[0]);
+                throw device_error("Channels have different time axes");
+            }
+        }
+        return;
+    }
+
+    /*
+     *      P R O T E C T E D   M E T H O D S
+     */
+
+    double oscilloscope::get_acquisition_time() {
+        return this->get_horz_base() * s_n_horz_div;
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    bool oscilloscope::poll_until(bool (oscilloscope::*cond)(),
+    unsigned timeout_ms) {
+        struct timeval tsta, tnow;
+        gettimeofday(&tsta, NULL);
+
+        // Short acquisitions are polled fast for low latency, long ones
+        // slowly to leave the instrument alone; the interval never exceeds
+        // one acquisition time, unknown timebases (<= 0) start at the minimum
+        // interval
+        double acq_us = this->get_acquisition_time() * 1e6;
+        unsigned min_us = s_min_poll_interval_us;
+        unsigned max_us = s_max_poll_interval_us;
+        if (acq_us / 10. > min_us)
+            min_us = (acq_us / 10. < max_us) ? acq_us / 10. : max_us;
+        if (acq_us > 0.)
+            max_us = std::min<double>(max_us, std::max<double>(min_us, acq_us));
+        debug_print("Polling every %u to %u us\n", min_us, max_us);
+
+        unsigned interval_us = min_us;
+        while ( !(this->*cond)() ) {
+            gettimeofday(&tnow, NULL);
+            double elapsed_us = (tnow.tv_sec - tsta.tv_sec) * 1e6 +
+                (tnow.tv_usec - tsta.tv_usec);
+            double remaining_us = timeout_ms * 1e3 - elapsed_us;
+            if (remaining_us <= 0)
+                return false;
+            usleep( (interval_us < remaining_us) ? interval_us :
+                (unsigned)remaining_us );
+            interval_us = (2 * interval_us < max_us) ? 2 * interval_us :
+                max_us;
+        }
+        return true;
+    }
+
+}
@@ -1,9 +1,11 @@
 #include <labdev/devices/rigol/dg4000.hh>
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/utils/scpi_cmd.hh>
 #include <labdev/exceptions.hh>
 #include "ld_debug.hh"
 
-#include <sstream>
 #include <unistd.h>
+#include <sys/time.h>   // gettimeofday()
 
 namespace labdev {
 
@@ -37,15 +39,20 @@ namespace labdev {
         return;
     }
 
+    dg4000::dg4000(usbtmc_kernel_interface* usbtmc) : scpi_device(usbtmc) {
+        // Endpoints are configured by the kernel driver
+        init();
+        return;
+    }
+
     dg4000::~dg4000() {
         return;
     }
 
     void dg4000::enable_channel(unsigned channel, bool enable) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":OUTP" << channel << ":STAT" << (enable? " ON" : " OFF") << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD(":OUTP{}:STAT {}\n", channel,
+            enable ? "ON" : "OFF") );
         return;
     }
 
@@ -56,9 +63,10 @@ namespace labdev {
             abort();
         }
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":APPL:" << waveform_string[wvfm] << "\n";
-        this->write_at_least(msg.str(), 5);
+        this->write_at_least( SCPI_CMD(":SOUR{}:APPL:{}\n", channel,
+            waveform_string[wvfm]), 5 );
+        // Applying a waveform changes the other settings of the channel
+        this->invalidate_cache();
 
         return;
     }
@@ -69,9 +77,8 @@ namespace labdev {
             fprintf(stderr, "Invalid frequency %f\n", freq_hz);
             abort();
         }
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":FREQ " << freq_hz << "\n";
-        this->write_at_least(msg.str(), 5);
+        this->write_at_least( SCPI_CMD(":SOUR{}:FREQ {}\n", channel,
+            freq_hz), 5 );
 
         return;
     }
@@ -82,9 +89,8 @@ namespace labdev {
             fprintf(stderr, "Invalid duty cycle %f\n", dcl);
             abort();
         }
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":PULS:DCYC " << 100*dcl << "\n";
-        this->write_at_least(msg.str(), 5);
+        this->write_at_least( SCPI_CMD(":SOUR{}:PULS:DCYC {}\n", channel,
+            100*dcl), 5 );
         return;
     };
 
@@ -94,9 +100,8 @@ namespace labdev {
             fprintf(stderr, "Invalid phase %f\n", phase_deg);
             abort();
         }
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":PHAS " << phase_deg << "\n";
-        this->write_at_least(msg.str(), 5);
+        this->write_at_least( SCPI_CMD(":SOUR{}:PHAS {}\n", channel,
+            phase_deg), 5 );
         return;
     };
 
@@ -106,9 +111,8 @@ namespace labdev {
             fprintf(stderr, "Amplitude %f out of range\n", ampl_v);
             abort();
         }
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":VOLT " << ampl_v << "\n";
-        this->write_at_least(msg.str(), 5);
+        this->write_at_least( SCPI_CMD(":SOUR{}:VOLT {}\n", channel,
+            ampl_v), 5 );
 
         return;
     };
@@ -119,64 +123,57 @@ namespace labdev {
             fprintf(stderr, "Offset %f out of range\n", offset_v);
             abort();
         }
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":VOLT:OFFS " << offset_v << "\n";
-        this->write_at_least(msg.str(), 5);
+        this->write_at_least( SCPI_CMD(":SOUR{}:VOLT:OFFS {}\n", channel,
+            offset_v), 5 );
         return;
     };
 
     std::string dg4000::get_waveform(int channel) {
         this->check_channel(channel);
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":APPL?\n";
-        std::string resp = comm->query(msg.str());
+        std::string resp = this->query_cached(
+            SCPI_CMD(":SOUR{}:APPL?\n", channel) );
         return resp.substr(1, resp.find(",") - 1);
     }
 
     double dg4000::get_freq(unsigned channel) {
         this->check_channel(channel);
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":FREQ?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp);
+        std::string resp = this->query_cached(
+            SCPI_CMD(":SOUR{}:FREQ?\n", channel) );
+        return parse_double(resp);
     }
 
     double dg4000::get_duty_cycle(unsigned channel) {
         this->check_channel(channel);
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":PULS:DCYC?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp)/100.;
+        std::string resp = this->query_cached(
+            SCPI_CMD(":SOUR{}:PULS:DCYC?\n", channel) );
+        return parse_double(resp)/100.;
     }
 
     double dg4000::get_phase(unsigned channel) {
         this->check_channel(channel);
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":PHAS?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp);
+        std::string resp = this->query_cached(
+            SCPI_CMD(":SOUR{}:PHAS?\n", channel) );
+        return parse_double(resp);
     }
 
     double dg4000::get_ampl(unsigned channel) {
         this->check_channel(channel);
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":VOLT?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp);
+        std::string resp = this->query_cached(
+            SCPI_CMD(":SOUR{}:VOLT?\n", channel) );
+        return parse_double(resp);
     }
 
     double dg4000::get_offset(unsigned channel) {
         this->check_channel(channel);
 
-        std::stringstream msg("");
-        msg << ":SOUR" << channel << ":VOLT:OFFS?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp);
+        std::string resp = this->query_cached(
+            SCPI_CMD(":SOUR{}:VOLT:OFFS?\n", channel) );
+        return parse_double(resp);
     }
 
     /*
@@ -197,7 +194,7 @@ namespace labdev {
         return;
     }
 
-    void dg4000::write_at_least(std::string msg, unsigned time_ms) {
+    void dg4000::write_at_least(const scpi_cmd& cmd, unsigned time_ms) {
 
         /*
          * Known issue: while processing queries the DG4000 apparently ignores
@@ -206,9 +203,14 @@ namespace labdev {
          *  least a few milliseconds before returning.
          */
 
+        // Unchanged settings are not written at all
+        if ( this->cache_hit(cmd) )
+            return;
+
         struct timeval sta, sto;
         gettimeofday(&sta, NULL);
-        comm->write(msg);
+        this->send(cmd);
+        this->cache_store(cmd);
         gettimeofday(&sto, NULL);
 
         int diff_ms = (sto.tv_sec - sta.tv_sec)*1000
@@ -1,8 +1,9 @@
 #include <labdev/devices/rigol/ds1000z.hh>
-#include <labdev/utils/utils.hh>
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/utils/scpi_cmd.hh>
 #include "ld_debug.hh"
 
-#include <sstream>
+#include <algorithm>
 #include <unistd.h>
 
 namespace labdev {
@@ -41,62 +42,68 @@ namespace labdev {
         return;
     }
 
+    ds1000z::ds1000z(usbtmc_kernel_interface* usbtmc):
+    oscilloscope(4), 
+    scpi_device(usbtmc) {
+        // Endpoints are configured by the kernel driver
+        init();
+        return;
+    }
+
+    ds1000z::ds1000z(interface* comm):
+    oscilloscope(4),
+    scpi_device(comm) {
+        init();
+        return;
+    }
+
     ds1000z::~ds1000z() {
         return;
     }
 
     void ds1000z::enable_channel(unsigned channel, bool enable) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":CHAN" << channel << ":DISP ";
-        if (enable) msg << "1\n";
-        else msg << "0\n";
-        comm->write(msg.str());
+        this->send_cached( SCPI_CMD(":CHAN{}:DISP {}\n", channel, enable) );
         return;
     }
 
     void ds1000z::set_atten(unsigned channel, double att) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":CHAN" << channel << ":PROB " << att << "\n";
-        comm->write(msg.str());
+        this->send_cached( SCPI_CMD(":CHAN{}:PROB {}\n", channel, att) );
+        // The vertical scale is rescaled by the probe ratio
+        this->invalidate_cache( SCPI_CMD(":CHAN{}:SCAL", channel).str() );
         return;
     }
 
     double ds1000z::get_atten(unsigned channel) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":CHAN" << channel << ":PROB?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp);
+        std::string resp = this->query_cached(
+            SCPI_CMD(":CHAN{}:PROB?\n", channel) );
+        return parse_double(resp);
     }
 
     void ds1000z::set_vert_base(unsigned channel, double volts_per_div) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":CHAN" << channel << ":SCAL " << volts_per_div << "\n";
-        comm->write(msg.str());
+        this->send_cached( SCPI_CMD(":CHAN{}:SCAL {}\n", channel,
+            volts_per_div) );
         return;
     }
 
     double ds1000z::get_vert_base(unsigned channel) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":CHAN" << channel << ":SCAL?\n";
-        std::string resp = comm->query(msg.str());
-        return std::stof(resp);
+        std::string resp = this->query_cached(
+            SCPI_CMD(":CHAN{}:SCAL?\n", channel) );
+        return parse_double(resp);
     }
 
     void ds1000z::set_horz_base(double sec_per_div) {
-        std::stringstream msg("");
-        msg << ":TIM:SCAL " << sec_per_div << "\n";
-        comm->write(msg.str());
+        this->send_cached( SCPI_CMD(":TIM:SCAL {}\n", sec_per_div) );
         return;
     }
 
     double ds1000z::get_horz_base() {
-        std::string msg = comm->query(":TIM:SCAL?\n");
-        return std::stof(msg);
+        std::string msg = this->query_cached( scpi_cmd(":TIM:SCAL?\n") );
+        return parse_double(msg);
     }
 
     void ds1000z::start_acquisition() {
@@ -114,44 +121,42 @@ namespace labdev {
         return;
     }
 
+    bool ds1000z::single_shot_sync(unsigned timeout_ms) {
+        comm->write(":SING\n");
+        return this->operation_complete(timeout_ms);
+    }
+
     void ds1000z::set_trigger_type(trigger_type trig) {
-        std::stringstream msg("");
-        msg << ":TRIG:MODE EDGE\n";
-        comm->write(msg.str().c_str());
+        this->send_cached( scpi_cmd(":TRIG:MODE EDGE\n") );
 
-        msg.str("");
-        msg << ":TRIG:EDG:SLOP ";
+        const char* slope;
         switch (trig) {
         case RISE: 
-            msg << "POS\n"; 
+            slope = "POS"; 
             break;
         case FALL: 
-            msg << "NEG\n"; 
+            slope = "NEG"; 
             break;
         case BOTH: 
-            msg << "RFAL\n"; 
+            slope = "RFAL"; 
             break;
         default:
             fprintf(stderr, "Invalid trigger type received: %02X\n", trig);
             abort();
         }
-        comm->write(msg.str().c_str());
+        this->send_cached( SCPI_CMD(":TRIG:EDG:SLOP {}\n", slope) );
 
         return;
     }
 
     void ds1000z::set_trigger_level(double level) {
-        std::stringstream msg("");
-        msg << ":TRIG:EDG:LEV " << level << "\n";
-        comm->write(msg.str().c_str());
+        this->send_cached( SCPI_CMD(":TRIG:EDG:LEV {}\n", level) );
         return;
     }
 
     void ds1000z::set_trigger_source(unsigned channel) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << ":TRIG:EDG:SOUR CHAN" << channel << "\n";
-        comm->write(msg.str().c_str());
+        this->send_cached( SCPI_CMD(":TRIG:EDG:SOUR CHAN{}\n", channel) );
         return;
     }
 
@@ -170,63 +175,56 @@ namespace labdev {
         return false;
     }
     
-    void ds1000z::read_sample_data(unsigned channel,
-    std::vector<double> &horz_data, std::vector<double> &vert_data) {
+    void ds1000z::read_waveform(unsigned channel, waveform& wf) {
         // Switch channel
         this->check_channel(channel);
         comm->write(":WAV:SOUR CHAN" + std::to_string(channel) + "\n");
-
-        // Clear vectors
-        horz_data.clear();
-        vert_data.clear();
+        wf.clear();
 
         // Get waveform preamble
         std::string data = comm->query(":WAV:PRE?\n");
-        std::vector<std::string> preamble = split(data, ",", 10);
-        if (preamble.size() != 10) {
-            debug_print("Received wrong preamble size: %s (%lu)\n",
-                data.c_str(), preamble.size());
+        scpi_parser preamble(data);
+        if ( !this->read_preamble(preamble, wf) || !preamble.at_end() ) {
+            debug_print("Received wrong preamble: %s\n", data.c_str());
             throw device_error("Received incomplete preamble.", -1);
         }
 
-        // Extract data from preamble
-        m_npts  = std::stoi( preamble.at(2) );
-        m_xincr = std::stof( preamble.at(4) );
-        m_xorg  = std::stof( preamble.at(5) );
-        m_xref  = std::stof( preamble.at(6) );
-        m_yinc  = std::stof( preamble.at(7) );
-        m_yorg  = std::stoi( preamble.at(8) );
-        m_yref  = std::stoi( preamble.at(9) );
-
-        debug_print("pts = %i\n", m_npts);
-        debug_print("xincr = %e\n", m_xincr);
-        debug_print("xorg = %e\n", m_xorg);
-        debug_print("xref = %e\n", m_xref);
-        debug_print("yinc = %e\n", m_yinc);
-        debug_print("yorg = %i\n", m_yorg);
-        debug_print("yref = %i\n", m_yref);
+        this->read_samples(wf);
+        return;
+    }
 
-        // Read waveform in chunks of 250kSa
-        std::vector<uint8_t> mem_data, temp;
-        unsigned start = 1, stop = 250000;
-        while (mem_data.size() < m_npts) {
-            temp = this->read_mem_data(start, stop);
-            start += temp.size();
-            stop += temp.size();
-            if (stop > m_npts) stop = m_npts;
-            mem_data.insert(mem_data.end(), temp.begin(), temp.end());
+    void ds1000z::read_channels(const std::vector<unsigned>& channels,
+    std::vector<waveform>& wfs) {
+        for (unsigned ch : channels)
+            this->check_channel(ch);
+        this->stop_acquisition();
+        wfs.resize(channels.size());
+
+        // Preambles of all channels with one query, the responses are
+        // separated by ';'
+        std::string batch("");
+        for (size_t i = 0; i < channels.size(); i++) {
+            batch.append( SCPI_CMD("{}:WAV:SOUR CHAN{};:WAV:PRE?",
+                i ? ";" : "", channels[i]).str() );
         }
-        debug_print("Total points read from memory: %lu\n", mem_data.size());
-
-        // Convert byte data using preamble
-        double xval, yval;
-        for (int i = 0; i < mem_data.size(); i++) {
-            xval = i*m_xincr + m_xorg; 
-            yval = (mem_data.at(i) - m_yref - m_yorg) * m_yinc;
-            vert_data.push_back(xval);
-            horz_data.push_back(yval);
+        batch.push_back('\n');
+        std::string data = comm->query(batch);
+
+        // Size all waveforms before the first transfer
+        scpi_parser preamble(data);
+        for (size_t i = 0; i < wfs.size(); i++) {
+            if ( !this->read_preamble(preamble, wfs[i]) ) {
+                debug_print("Received wrong preamble: %s\n", data.c_str());
+                throw device_error("Received incomplete preamble.", -1);
+            }
         }
+        if ( !preamble.at_end() )
+            throw device_error("Received too many preambles.", -1);
 
+        for (size_t i = 0; i < channels.size(); i++) {
+            comm->write(":WAV:SOUR CHAN" + std::to_string(channels[i]) + "\n");
+            this->read_samples(wfs[i]);
+        }
         return;
     }
 
@@ -239,24 +237,17 @@ namespace labdev {
     unsigned item) {
         this->check_channel(channel1);
         this->check_channel(channel2);
-        std::stringstream msg("");
-        msg << ":MEAS:STAT:ITEM " << s_meas_item_string[item]
-            << ",CHAN" << channel1 << ",CHAN" << channel2 << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD(":MEAS:STAT:ITEM {},CHAN{},CHAN{}\n",
+            s_meas_item_string[item], channel1, channel2) );
         return;
     }
 
     double ds1000z::get_measurement(unsigned channel1, unsigned channel2,
     unsigned item, unsigned type) {
         this->check_channel(channel1);
-        std::stringstream msg("");
-        msg << ":MEAS:STAT:ITEM? "
-            << s_meas_type_string[type] << ","
-            << s_meas_item_string[item] << ",CHAN"
-            << channel1 << ",CHAN"
-            << channel2 << "\n";
-        std::string resp = comm->query(msg.str());
-        return std::stod(resp);
+        std::string resp = this->query( measurement_query(channel1, channel2,
+            item, type) );
+        return parse_double(resp);
     }
 
     double ds1000z::get_measurement(unsigned channel, unsigned item,
@@ -308,28 +299,89 @@ namespace labdev {
         return;
     }
 
-    std::vector<uint8_t> ds1000z::read_mem_data(unsigned sta, unsigned sto) {
+    scpi_cmd ds1000z::measurement_query(unsigned channel1, unsigned channel2,
+    unsigned item, unsigned type) {
+        return SCPI_CMD(":MEAS:STAT:ITEM? {},{},CHAN{},CHAN{}\n",
+            s_meas_type_string[type], s_meas_item_string[item], channel1,
+            channel2);
+    }
+
+    std::string ds1000z::read_setup(unsigned timeout_ms) {
+        comm->write(":SYST:SET?\n");
+        std::vector<uint8_t> setup;
+        this->read_block(setup, timeout_ms);
+
+        // Kept as definite length block to be written back unchanged
+        std::string len = std::to_string(setup.size());
+        std::string ret = "#" + std::to_string(len.size()) + len;
+        ret.append(setup.begin(), setup.end());
+        return ret;
+    }
+
+    void ds1000z::write_setup(const std::string& setup) {
+        comm->write(":SYST:SET " + setup + "\n");
+        return;
+    }
+
+    bool ds1000z::read_preamble(scpi_parser& preamble, waveform& wf) {
+        // Preamble fields: format, type, points, count, xincrement, xorigin,
+        // xreference, yincrement, yorigin, yreference
+        int64_t npts, yorg, yref;
+        if ( !preamble.skip() || !preamble.skip() ||
+             !preamble.read_int(npts) || !preamble.skip() ||
+             !preamble.read_double(m_xincr) || !preamble.read_double(m_xorg) ||
+             !preamble.read_double(m_xref) || !preamble.read_double(m_yinc) ||
+             !preamble.read_int(yorg) || !preamble.read_int(yref) ||
+             (npts < 0) )
+            return false;
+        m_npts = npts;
+        m_yorg = yorg;
+        m_yref = yref;
+
+        debug_print("pts = %i\n", m_npts);
+        debug_print("xincr = %e\n", m_xincr);
+        debug_print("xorg = %e\n", m_xorg);
+        debug_print("xref = %e\n", m_xref);
+        debug_print("yinc = %e\n", m_yinc);
+        debug_print("yorg = %i\n", m_yorg);
+        debug_print("yref = %i\n", m_yref);
+
+        // Voltage is (code - yref - yorg) * yinc, converted on demand
+        wf.resize(waveform::UINT8, m_npts);
+        wf.set_horz_scale(m_xincr, m_xorg, m_xref);
+        wf.set_vert_scale(m_yinc, 0., m_yref + m_yorg);
+        return true;
+    }
+
+    void ds1000z::read_samples(waveform& wf) {
+        // Read waveform of the current source in chunks of 250kSa directly
+        // into the sample buffer
+        uint8_t* mem_data = wf.raw_data();
+        unsigned npts = wf.size();
+        unsigned start = 1, stop = std::min(250000u, npts);
+        size_t pos = 0;
+        while (pos < npts) {
+            size_t nbytes = this->read_mem_data(start, stop, &mem_data[pos],
+                npts - pos);
+            if (nbytes == 0)
+                throw device_error("Device returned empty waveform block");
+            pos += nbytes;
+            start += nbytes;
+            stop = std::min<unsigned>(stop + nbytes, npts);
+        }
+        debug_print("Total points read from memory: %zu\n", pos);
+        return;
+    }
+
+    size_t ds1000z::read_mem_data(unsigned sta, unsigned sto, uint8_t* data,
+    size_t max_len) {
         // Set start and stop address
         comm->write(":WAV:STAR " + std::to_string(sta) + "\n");
         comm->write(":WAV:STOP " + std::to_string(sto) + "\n");
 
         // Read data block
-        std::string data = comm->query(":WAV:DATA?\n");
-        // Extract header
-        int len = 0;
-        std::string header = data.substr(0, 11);
-        sscanf(header.c_str(), "#9%9d", &len);
-        debug_print("len = %i\n", len);
-
-        // Read the waveform
-        while (data.size() < len)
-            data.append( comm->read() );
-
-        std::vector<uint8_t> ret;
-        for (int i = 0; i < len; i++)
-            ret.push_back( (uint8_t)data.at(i + header.size()) );
-
-        return ret;   
+        comm->write(":WAV:DATA?\n");
+        return this->read_block(data, max_len);
     }
 
 }
\ No newline at end of file
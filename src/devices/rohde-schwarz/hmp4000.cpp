@@ -1,7 +1,8 @@
 #include <labdev/devices/rohde-schwarz/hmp4000.hh>
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/utils/scpi_cmd.hh>
 #include "ld_debug.hh"
 
-#include <sstream>
 #include <unistd.h>
 
 namespace labdev {
@@ -40,9 +41,7 @@ namespace labdev {
     }
 
     void hmp4000::enable_outputs(bool ena) {
-        std::stringstream msg("");
-        msg << "OUTP:GEN " << (ena? "1" : "0") << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD("OUTP:GEN {}\n", ena) );
         return;
     }
 
@@ -53,9 +52,7 @@ namespace labdev {
             fprintf(stderr, "Voltage %f V out of range\n", volts);
             abort();
         }
-        std::stringstream msg("");
-        msg << "VOLT " << volts << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD("VOLT {}\n", volts) );
         return;
     }
 
@@ -63,7 +60,7 @@ namespace labdev {
         // Switch channel
         this->select_channel(channel);
         std::string resp = comm->query("VOLT?\n");
-        return std::stod(resp);
+        return parse_double(resp);
     }
 
     void hmp4000::set_current(int channel, double amps) {
@@ -74,9 +71,7 @@ namespace labdev {
             fprintf(stderr, "Current %f A out of range\n", amps);
             abort();
         }
-        std::stringstream msg("");
-        msg << "CURR " << amps << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD("CURR {}\n", amps) );
         return;
     }
 
@@ -84,19 +79,19 @@ namespace labdev {
         // Switch channel
         this->select_channel(channel);
         std::string resp = comm->query("CURR?\n");
-        return std::stod(resp);
+        return parse_double(resp);
     }
 
     double hmp4000::measure_voltage(int channel) {
         this->select_channel(channel);
         std::string resp = comm->query("MEAS:VOLT?\n");
-        return std::stod(resp);
+        return parse_double(resp);
     };
 
     double hmp4000::measure_current(int channel) {
         this->select_channel(channel);
         std::string resp = comm->query("MEAS:CURR?\n");
-        return std::stod(resp);
+        return parse_double(resp);
     };
 
     void hmp4000::set_ovp(int channel, double volts) {
@@ -107,9 +102,7 @@ namespace labdev {
             fprintf(stderr, "Voltage %f V out of range\n", volts);
             abort();
         }
-        std::stringstream msg("");
-        msg << "VOLT:PROT " << volts << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD("VOLT:PROT {}\n", volts) );
         return;
     }
 
@@ -134,7 +127,7 @@ namespace labdev {
 
     void hmp4000::init() {
         this->clear_status();
-        cur_ch = 0;
+        this->invalidate_cache();
         return;
     }
 
@@ -145,21 +138,13 @@ namespace labdev {
             abort();
         }
 
-        // Check current channel and switch if necessary
-        if (cur_ch != channel) {
-            cur_ch = channel;
-            debug_print("Switching to channel %i...\n", channel);
-            std::stringstream msg("");
-            msg << "INST OUTP" << channel << "\n";
-            comm->write(msg.str());
-        }
+        // Only switched if a different channel is selected
+        this->send_cached( SCPI_CMD("INST OUTP{}\n", channel) );
         return;
     }
 
     void hmp4000::activate(bool ena) {
-        std::stringstream msg("");
-        msg << "OUTP:SEL " << (ena? "1" : "0") << "\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD("OUTP:SEL {}\n", ena) );
 
         return;
     }
@@ -40,6 +40,14 @@ namespace labdev {
         return;
     }
 
+    rta4000::rta4000(usbtmc_kernel_interface* usbtmc):
+    oscilloscope(4), 
+    scpi_device(usbtmc) {
+        // Endpoints are configured by the kernel driver
+        init();
+        return;
+    }
+
     rta4000::rta4000(serial_interface* serial):
     oscilloscope(4), 
     scpi_device(serial) {
@@ -108,8 +116,8 @@ namespace labdev {
         return false;
     };
 
-    void rta4000::read_sample_data(unsigned channel, 
-    std::vector<double> &horz_data, std::vector<double> &vert_data) {
+    void rta4000::read_waveform(unsigned channel, waveform& wf) {
+        wf.clear();
         return;
     };
 
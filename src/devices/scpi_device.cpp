@@ -1,11 +1,112 @@
 #include <labdev/devices/scpi_device.hh>
 #include <labdev/exceptions.hh>
+#include <labdev/utils/scpi_parser.hh>
+#include "ld_debug.hh"
 
 #include <sys/time.h>   // struct timeval
+#include <unistd.h>     // usleep()
+#include <string.h>     // memchr(), strncmp()
+#include <set>
 
 namespace labdev {
 
+    // Milliseconds passed since tsta
+    static double elapsed_ms(const struct timeval& tsta) {
+        struct timeval tsto;
+        gettimeofday(&tsto, NULL);
+        return (tsto.tv_sec - tsta.tv_sec) * 1000.
+            + (tsto.tv_usec - tsta.tv_usec)/1000.;
+    }
+
+    // Splits a single setting command into header and value, returns false
+    // for compound commands
+    static bool split_setting(const scpi_cmd& cmd, std::string& header,
+    std::string& value) {
+        const char* str = cmd.c_str();
+        size_t len = cmd.size();
+        while ( (len > 0) && ((str[len-1] == '\n') || (str[len-1] == '\r') ||
+                (str[len-1] == ' ')) )
+            len--;
+        if ( memchr(str, ';', len) )
+            return false;
+        const char* sep = (const char*)memchr(str, ' ', len);
+        if (!sep) {
+            header.assign(str, len);
+            value.clear();
+            return true;
+        }
+        header.assign(str, sep - str);
+        while ( (sep < str + len) && (*sep == ' ') )
+            sep++;
+        value.assign(sep, str + len - sep);
+        return true;
+    }
+
+    // Returns the header of a setting query without parameters (":TIM:SCAL?"
+    // -> ":TIM:SCAL"), false for any other query
+    static bool split_query(const scpi_cmd& cmd, std::string& header) {
+        const char* str = cmd.c_str();
+        const char* qm = strchr(str, '?');
+        if (!qm)
+            return false;
+        for (const char* pos = qm + 1; *pos != '\0'; pos++) {
+            if ( (*pos != '\n') && (*pos != '\r') && (*pos != ' ') )
+                return false;
+        }
+        header.assign(str, qm - str);
+        return true;
+    }
+
+    // Splits a program message (e.g. a *LRN? response) into commands with
+    // absolute headers; headers following ';' are relative to the path of
+    // the preceding header
+    static void split_program(const std::string& prog,
+    std::vector<std::string>& cmds) {
+        std::string path("");
+        size_t pos = 0, len = prog.size();
+        while ( (len > 0) && ((prog[len-1] == '\n') || (prog[len-1] == '\r')) )
+            len--;
+
+        while (pos < len) {
+            // Find end of command, separators in strings do not count
+            size_t end = pos;
+            char quote = 0;
+            for (; end < len; end++) {
+                if (quote) {
+                    if (prog[end] == quote)
+                        quote = 0;
+                } else if ( (prog[end] == '"') || (prog[end] == '\'') )
+                    quote = prog[end];
+                else if (prog[end] == ';')
+                    break;
+            }
+            std::string cmd = prog.substr(pos, end - pos);
+            pos = end + 1;
+            size_t sta = cmd.find_first_not_of(" \t\r\n");
+            if (sta == std::string::npos)
+                continue;
+            cmd.erase(0, sta);
+
+            if ( (cmd[0] != ':') && (cmd[0] != '*') )
+                cmd.insert(0, path.empty() ? ":" : path);
+            // Path of the next relative header
+            if (cmd[0] == ':') {
+                size_t hdr_end = cmd.find(' ');
+                path = cmd.substr(0, cmd.rfind(':', hdr_end) + 1);
+            }
+            cmds.push_back(cmd);
+        }
+        return;
+    }
+
     scpi_device::scpi_device(interface* interface):
+    m_in_transaction(false),
+    m_transaction_len(s_dflt_transaction_len),
+    m_transaction(""),
+    m_completion(OPC_AUTO),
+    m_cache_enabled(true),
+    m_error_check(ERR_CHECK_DEFERRED),
+    m_err_all(ERR_ALL_UNKNOWN),
     m_error(0),
     m_strerror("No error") {
         if (!interface) {
@@ -42,26 +143,28 @@ namespace labdev {
     }
 
     void scpi_device::wait_to_complete(unsigned timeout_ms) {
-        // timeout setup
-        struct timeval tsta, tsto;
-        gettimeofday(&tsta, NULL);
-        double tdiff;
+        Completion_strategy strategy = m_completion;
+        if (strategy == OPC_AUTO)
+            strategy = this->select_completion_strategy();
 
-        // Check status event status register for OPC-flag
-        comm->write("*OPC\n");
-        while ( (this->get_event_status_register(timeout_ms) & OPC) == 0) {
-            // Check for timeout
-            gettimeofday(&tsto, NULL);
-            tdiff = (tsto.tv_sec - tsta.tv_sec) * 1000.
-                + (tsto.tv_usec - tsta.tv_usec)/1000.;
-            if (tdiff > timeout_ms)
-                throw timeout("*OPC timeout occurred");
+        switch (strategy) {
+        case OPC_SRQ:
+            this->wait_for_srq_completion(timeout_ms);
+            break;
+        case OPC_POLL:
+            this->poll_completion(timeout_ms);
+            break;
+        default:
+            // The read timeout of *OPC? is the completion timeout
+            if ( !this->operation_complete(timeout_ms) )
+                throw bad_protocol("Invalid *OPC? response");
         }
         return;
     }
 
     void scpi_device::reset() {
         comm->write("*RST\n");
+        this->invalidate_cache();
         return;
     }
 
@@ -78,14 +181,545 @@ namespace labdev {
 
     int scpi_device::get_error() {
         std::string msg = comm->query("SYST:ERR?\n");
-        m_error = std::stoi( msg.substr(0, msg.find(',')) );
-        m_strerror = msg.substr(msg.find('"') + 1,
-            msg.rfind('"') - msg.find('"') - 1);
+        // Error number followed by error description (<NR1>,<string>)
+        scpi_parser parser(msg);
+        int64_t err;
+        const char* str;
+        size_t len;
+        if ( !parser.read_int(err) || !parser.read_string(str, len) )
+            throw bad_protocol("Received invalid error queue entry");
+        m_error = err;
+        m_strerror.assign(str, len);
+        // A rejected command leaves the setting unknown
+        if (m_error != 0)
+            this->invalidate_cache();
         return m_error;
     }
 
+    void scpi_device::begin_transaction(size_t max_len) {
+        if (m_in_transaction) {
+            fprintf(stderr, "Transaction already in progress\n");
+            abort();
+        }
+        m_in_transaction = true;
+        m_transaction_len = max_len;
+        m_transaction.clear();
+        return;
+    }
+
+    void scpi_device::commit(unsigned timeout_ms) {
+        if (!m_in_transaction) {
+            fprintf(stderr, "No transaction in progress\n");
+            abort();
+        }
+        m_in_transaction = false;
+        if ( m_transaction.empty() )
+            return;
+
+        // Completion query is sent with the last commands
+        const char opc[] = "*OPC?";
+        if (m_transaction.size() + sizeof(opc) >= m_transaction_len)
+            this->flush_transaction();
+        if ( !m_transaction.empty() )
+            m_transaction.push_back(';');
+        m_transaction.append(opc);
+        this->flush_transaction();
+        std::string resp = comm->read(timeout_ms);
+        if (resp.find("1") == std::string::npos)
+            throw bad_protocol("Invalid *OPC? response");
+
+        if (m_error_check != ERR_CHECK_OFF)
+            this->check_errors();
+        return;
+    }
+
+    void scpi_device::discard_transaction() {
+        m_in_transaction = false;
+        m_transaction.clear();
+        // Queued settings have not been written
+        this->invalidate_cache();
+        return;
+    }
+
+    void scpi_device::enable_cache(bool enable) {
+        m_cache_enabled = enable;
+        if (!enable)
+            this->invalidate_cache();
+        return;
+    }
+
+    void scpi_device::invalidate_cache() {
+        if ( !m_cache.empty() )
+            debug_print("%s\n", "Invalidating settings cache");
+        m_cache.clear();
+        return;
+    }
+
+    void scpi_device::invalidate_cache(const std::string& header) {
+        if ( m_cache.erase(header) )
+            debug_print("Invalidating cached setting '%s'\n", header.c_str());
+        return;
+    }
+
+    std::vector<scpi_device::scpi_error> scpi_device::read_errors() {
+        std::vector<scpi_error> errors;
+
+        // Find out once if the whole queue can be read with one query, the
+        // probe itself adds an 'Undefined header' error on other devices
+        bool probed = false;
+        if (m_err_all == ERR_ALL_UNKNOWN) {
+            io_result<std::string> resp = comm->try_query("SYST:ERR:ALL?\n",
+                500);
+            if ( resp ) {
+                m_err_all = ERR_ALL_YES;
+                this->parse_errors(resp.value, errors);
+            } else {
+                debug_print("%s\n", "SYST:ERR:ALL? not supported");
+                while ( comm->try_read(s_probe_flush_timeout_ms) )
+                    debug_print("%s\n", "Discarded late response to probe");
+                m_err_all = ERR_ALL_NO;
+                probed = true;
+            }
+        } else if (m_err_all == ERR_ALL_YES) {
+            this->parse_errors(comm->query("SYST:ERR:ALL?\n"), errors);
+        }
+
+        if (m_err_all == ERR_ALL_NO) {
+            // Read queue in batches until "No error" is returned
+            std::string batch("");
+            for (unsigned i = 0; i < s_err_batch_size; i++)
+                batch.append(i ? ";SYST:ERR?" : "SYST:ERR?");
+            batch.push_back('\n');
+            while ( this->parse_errors(comm->query(batch), errors) );
+            if ( probed && !errors.empty() && (errors.back().code == -113) )
+                errors.pop_back();
+        }
+
+        if ( errors.empty() ) {
+            m_error = 0;
+            m_strerror = "No error";
+        } else {
+            m_error = errors.front().code;
+            m_strerror = errors.front().msg;
+            this->invalidate_cache();
+        }
+        return errors;
+    }
+
+    void scpi_device::check_errors() {
+        std::vector<scpi_error> errors = this->read_errors();
+        if ( !errors.empty() ) {
+            #ifdef LD_DEBUG
+            for (size_t i = 0; i < errors.size(); i++)
+                debug_print("Device error %i, %s\n", errors[i].code,
+                    errors[i].msg.c_str());
+            #endif
+            throw device_error(m_strerror, m_error);
+        }
+        return;
+    }
+
+    void scpi_device::save_snapshot(const std::string& name,
+    unsigned timeout_ms) {
+        m_snapshots[name] = this->read_setup(timeout_ms);
+        debug_print("Saved snapshot '%s' (%zu bytes)\n", name.c_str(),
+            m_snapshots[name].size());
+        return;
+    }
+
+    void scpi_device::restore_snapshot(const std::string& name, bool diff,
+    unsigned timeout_ms) {
+        const std::string& setup = this->get_snapshot(name);
+
+        // Binary setups can only be restored as a whole
+        if ( !diff || setup.empty() || (setup[0] == '#') ) {
+            this->write_setup(setup);
+            this->invalidate_cache();
+            return;
+        }
+
+        std::vector<std::string> target, current;
+        split_program(setup, target);
+        split_program(this->read_setup(timeout_ms), current);
+        std::set<std::string> unchanged(current.begin(), current.end());
+
+        std::vector<std::string> changed;
+        for (size_t i = 0; i < target.size(); i++) {
+            if ( !unchanged.count(target[i]) )
+                changed.push_back(target[i]);
+        }
+        debug_print("Restoring snapshot '%s': %zu of %zu commands changed\n",
+            name.c_str(), changed.size(), target.size());
+        this->write_program(changed);
+        this->invalidate_cache();
+        return;
+    }
+
+    const std::string& scpi_device::get_snapshot(const std::string& name)
+    const {
+        std::map<std::string, std::string>::const_iterator it =
+            m_snapshots.find(name);
+        if ( it == m_snapshots.end() ) {
+            fprintf(stderr, "Unknown snapshot '%s'\n", name.c_str());
+            abort();
+        }
+        return it->second;
+    }
+
+    void scpi_device::save_setup(unsigned slot) {
+        this->send( SCPI_CMD("*SAV {}\n", slot) );
+        return;
+    }
+
+    void scpi_device::recall_setup(unsigned slot) {
+        this->send( SCPI_CMD("*RCL {}\n", slot) );
+        // All settings may have changed
+        this->invalidate_cache();
+        return;
+    }
+
     uint8_t scpi_device::get_event_status_register(unsigned timeout_ms) {
-        return (uint8_t)std::stoi( comm->query("*ESR?\n", timeout_ms) );
+        return (uint8_t)parse_int( comm->query("*ESR?\n", timeout_ms) );
+    }
+
+    size_t scpi_device::read_block(uint8_t* data, size_t max_len,
+    unsigned timeout_ms) {
+        long len = this->read_block_header(timeout_ms);
+
+        // Definite length: read exactly the announced number of bytes
+        if (len >= 0) {
+            if ((size_t)len > max_len) {
+                debug_print("Block of %li bytes exceeds buffer (%zu bytes)\n",
+                    len, max_len);
+                throw bad_protocol("Block does not fit into buffer", len);
+            }
+            this->read_exactly(data, len, timeout_ms);
+            this->read_block_terminator();
+            return len;
+        }
+
+        // Indefinite length: read until the response is terminated by NL
+        size_t pos = 0;
+        while ( (pos == 0) || (data[pos-1] != '\n') ) {
+            if (pos >= max_len)
+                throw bad_protocol("Block does not fit into buffer", pos);
+            pos += comm->read_raw(data + pos, max_len - pos, timeout_ms);
+        }
+        return pos - 1;
+    }
+
+    size_t scpi_device::read_block(std::vector<uint8_t>& data,
+    unsigned timeout_ms) {
+        long len = this->read_block_header(timeout_ms);
+
+        if (len >= 0) {
+            data.resize(len);
+            this->read_exactly(data.data(), len, timeout_ms);
+            this->read_block_terminator();
+            return len;
+        }
+
+        // Indefinite length blocks are read in chunks of the default size
+        size_t pos = 0;
+        data.clear();
+        while ( (pos == 0) || (data[pos-1] != '\n') ) {
+            data.resize(pos + interface::s_dflt_buf_size);
+            pos += comm->read_raw(data.data() + pos, interface::s_dflt_buf_size,
+                timeout_ms);
+        }
+        data.resize(pos - 1);
+        return pos - 1;
+    }
+
+    /*
+     *      P R O T E C T E D   M E T H O D S
+     */
+
+    scpi_device::Completion_strategy scpi_device::select_completion_strategy() {
+        // Service requests do not use the message pipe at all
+        if ( comm->srq_supported() )
+            return OPC_SRQ;
+        // A USBTMC read timing out has to be aborted on the device, long
+        // blocking reads are avoided
+        if (comm->type() == usbtmc)
+            return OPC_POLL;
+        return OPC_BLOCKING;
+    }
+
+    void scpi_device::wait_for_srq_completion(unsigned timeout_ms) {
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+
+        // OPC sets ESB which raises an SRQ; the enable masks of the caller
+        // are restored afterwards
+        int ese = parse_int( comm->query("*ESE?\n", timeout_ms) );
+        int sre = parse_int( comm->query("*SRE?\n", timeout_ms) );
+        scpi_cmd restore = SCPI_CMD("*ESE {};*SRE {}\n", ese, sre);
+        comm->write("*ESE 1;*SRE 32;*OPC\n");
+
+        bool complete = false;
+        try {
+            double tdiff = 0;
+            do {
+                if ( !comm->wait_for_srq(timeout_ms - tdiff) )
+                    break;
+                // Earlier service requests might still be pending
+                complete = this->get_event_status_register(timeout_ms) & OPC;
+                tdiff = elapsed_ms(tsta);
+            } while ( !complete && (tdiff < timeout_ms) );
+        } catch (...) {
+            comm->write_raw((const uint8_t*)restore.data(), restore.size());
+            throw;
+        }
+        comm->write_raw((const uint8_t*)restore.data(), restore.size());
+        if (!complete)
+            throw timeout("*OPC timeout occurred");
+        return;
+    }
+
+    void scpi_device::poll_completion(unsigned timeout_ms) {
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+
+        // Check event status register for OPC-flag, the polling interval is
+        // doubled each time to leave the device time to work
+        unsigned interval_ms = s_min_poll_interval_ms;
+        comm->write("*OPC\n");
+        while ( (this->get_event_status_register(timeout_ms) & OPC) == 0) {
+            double tdiff = elapsed_ms(tsta);
+            if (tdiff > timeout_ms)
+                throw timeout("*OPC timeout occurred");
+            if (interval_ms > timeout_ms - tdiff)
+                interval_ms = timeout_ms - tdiff + 1;
+            usleep(interval_ms * 1000);
+            interval_ms *= 2;
+            if (interval_ms > s_max_poll_interval_ms)
+                interval_ms = s_max_poll_interval_ms;
+        }
+        return;
+    }
+
+    void scpi_device::send(const scpi_cmd& cmd) {
+        this->write_cmd(cmd);
+        if ( (m_error_check == ERR_CHECK_IMMEDIATE) && !m_in_transaction )
+            this->check_errors();
+        return;
+    }
+
+    std::string scpi_device::query(const scpi_cmd& cmd, unsigned timeout_ms) {
+        // Queued commands have to be executed before the query
+        if (m_in_transaction) {
+            this->flush_transaction();
+            comm->write_raw((const uint8_t*)cmd.data(), cmd.size());
+        } else
+            this->write_cmd(cmd);
+        std::string resp = comm->read(timeout_ms);
+        if ( (m_error_check == ERR_CHECK_IMMEDIATE) && !m_in_transaction )
+            this->check_errors();
+        return resp;
+    }
+
+    void scpi_device::write_cmd(const scpi_cmd& cmd) {
+        if (m_in_transaction) {
+            // Strip terminator, the compound message is terminated once
+            size_t len = cmd.size();
+            while ( (len > 0) && ((cmd.data()[len-1] == '\n') ||
+                    (cmd.data()[len-1] == '\r')) )
+                len--;
+            if (len == 0)
+                return;
+            // Headers following ';' are relative to the previous command
+            bool root = (cmd.data()[0] != ':') && (cmd.data()[0] != '*');
+            // Separator or terminator and optional root prefix
+            size_t add = len + (root ? 1 : 0) + 1;
+            if ( !m_transaction.empty() &&
+                 (m_transaction.size() + add >= m_transaction_len) )
+                this->flush_transaction();
+            if ( !m_transaction.empty() )
+                m_transaction.push_back(';');
+            if (root)
+                m_transaction.push_back(':');
+            m_transaction.append(cmd.data(), len);
+        } else {
+            comm->write_raw((const uint8_t*)cmd.data(), cmd.size());
+            debug_print("Sent command '%.*s'\n", (int)cmd.size(),
+                cmd.c_str());
+        }
+        // Device settings are reset or restored
+        if ( (strncmp(cmd.c_str(), "*RST", 4) == 0) ||
+             (strncmp(cmd.c_str(), "*RCL", 4) == 0) )
+            this->invalidate_cache();
+        return;
+    }
+
+    bool scpi_device::parse_errors(const std::string& resp,
+    std::vector<scpi_error>& errors) {
+        // List of <NR1>,<string> pairs separated by ',' or ';'
+        scpi_parser parser(resp);
+        while ( !parser.at_end() ) {
+            int64_t code;
+            const char* str;
+            size_t len;
+            if ( !parser.read_int(code) || !parser.read_string(str, len) )
+                throw bad_protocol("Received invalid error queue entry");
+            if (code == 0)
+                return false;
+            scpi_error err;
+            err.code = code;
+            err.msg.assign(str, len);
+            errors.push_back(err);
+        }
+        return true;
+    }
+
+    void scpi_device::flush_transaction() {
+        if ( m_transaction.empty() )
+            return;
+        m_transaction.push_back('\n');
+        comm->write(m_transaction);
+        m_transaction.clear();
+        return;
+    }
+
+    std::string scpi_device::read_setup(unsigned timeout_ms) {
+        // Long learn strings arrive in several reads
+        comm->write("*LRN?\n");
+        std::string setup = comm->read(timeout_ms);
+        while ( setup.empty() || (setup.back() != '\n') )
+            setup.append( comm->read(timeout_ms) );
+        return setup;
+    }
+
+    void scpi_device::write_setup(const std::string& setup) {
+        // The learn string is a valid program message
+        if ( setup.empty() || (setup.back() != '\n') )
+            comm->write(setup + "\n");
+        else
+            comm->write(setup);
+        return;
+    }
+
+    void scpi_device::write_program(const std::vector<std::string>& cmds) {
+        std::string msg("");
+        for (size_t i = 0; i < cmds.size(); i++) {
+            if ( !msg.empty() &&
+                 (msg.size() + cmds[i].size() + 1 >= m_transaction_len) ) {
+                msg.push_back('\n');
+                comm->write(msg);
+                msg.clear();
+            }
+            if ( !msg.empty() )
+                msg.push_back(';');
+            msg.append(cmds[i]);
+        }
+        if ( !msg.empty() ) {
+            msg.push_back('\n');
+            comm->write(msg);
+        }
+        return;
+    }
+
+    void scpi_device::send_cached(const scpi_cmd& cmd) {
+        if ( this->cache_hit(cmd) ) {
+            debug_print("Skipping cached command '%.*s'\n", (int)cmd.size(),
+                cmd.c_str());
+            return;
+        }
+        this->send(cmd);
+        this->cache_store(cmd);
+        return;
+    }
+
+    std::string scpi_device::query_cached(const scpi_cmd& cmd,
+    unsigned timeout_ms) {
+        std::string header;
+        if ( !m_cache_enabled || !split_query(cmd, header) )
+            return this->query(cmd, timeout_ms);
+
+        std::map<std::string, cache_entry>::iterator it = m_cache.find(header);
+        if ( (it != m_cache.end()) && it->second.has_read ) {
+            debug_print("Cached response for '%s?'\n", header.c_str());
+            return it->second.read;
+        }
+        std::string resp = this->query(cmd, timeout_ms);
+        cache_entry& entry = m_cache[header];
+        entry.has_read = true;
+        entry.read = resp;
+        return resp;
+    }
+
+    bool scpi_device::cache_hit(const scpi_cmd& cmd) const {
+        std::string header, value;
+        if ( !m_cache_enabled || !split_setting(cmd, header, value) )
+            return false;
+        std::map<std::string, cache_entry>::const_iterator it =
+            m_cache.find(header);
+        return (it != m_cache.end()) && it->second.has_written &&
+            (it->second.written == value);
+    }
+
+    void scpi_device::cache_store(const scpi_cmd& cmd) {
+        std::string header, value;
+        if ( !m_cache_enabled || !split_setting(cmd, header, value) )
+            return;
+        cache_entry& entry = m_cache[header];
+        if ( entry.has_written && (entry.written == value) )
+            return;
+        entry.has_written = true;
+        entry.written = value;
+        // The device has to be asked once for the value it actually applied
+        entry.has_read = false;
+        entry.read.clear();
+        return;
+    }
+
+    void scpi_device::read_exactly(uint8_t* data, size_t len,
+    unsigned timeout_ms) {
+        size_t pos = 0;
+        while (pos < len) {
+            int nbytes = comm->read_raw(data + pos, len - pos, timeout_ms);
+            if (nbytes <= 0)
+                throw bad_protocol("Block transfer ended early", pos);
+            pos += nbytes;
+        }
+        return;
+    }
+
+    long scpi_device::read_block_header(unsigned timeout_ms) {
+        // '#' followed by number of length digits
+        uint8_t hdr[10];
+        this->read_exactly(hdr, 2, timeout_ms);
+        if ( (hdr[0] != '#') || (hdr[1] < '0') || (hdr[1] > '9') ) {
+            debug_print("Invalid block header 0x%02X 0x%02X\n", hdr[0],
+                hdr[1]);
+            throw bad_protocol("Invalid block header");
+        }
+        int ndigits = hdr[1] - '0';
+        if (ndigits == 0)
+            return -1;
+
+        this->read_exactly(hdr, ndigits, timeout_ms);
+        long len = 0;
+        for (int i = 0; i < ndigits; i++) {
+            if ( (hdr[i] < '0') || (hdr[i] > '9') )
+                throw bad_protocol("Invalid block length");
+            len = 10 * len + (hdr[i] - '0');
+        }
+        debug_print("Block of %li bytes\n", len);
+        return len;
+    }
+
+    void scpi_device::read_block_terminator() {
+        // Nothing follows if the block ended the message (e.g. USBTMC EOM);
+        // a timed out read would abort the transfer on some transports
+        if ( comm->end_of_message() )
+            return;
+        // The terminator follows the block immediately, devices not sending
+        // one only delay the read by s_block_term_timeout_ms
+        uint8_t term;
+        if ( !comm->try_read_raw(&term, 1, s_block_term_timeout_ms) )
+            debug_print("%s\n", "No terminator after block");
+        return;
     }
 
 }
\ No newline at end of file
@@ -1,9 +1,8 @@
 #include <labdev/devices/tektronix/dpo5000b.hh>
-#include <labdev/utils/utils.hh>
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/utils/scpi_cmd.hh>
 #include "ld_debug.hh"
 
-#include <sstream>
-
 namespace labdev {
 
     dpo5000b::dpo5000b():
@@ -42,17 +41,20 @@ namespace labdev {
         return;
     }
 
+    dpo5000b::dpo5000b(usbtmc_kernel_interface* usbtmc) : scpi_device(usbtmc) {
+        // Endpoints are configured by the kernel driver
+        usbtmc->clear_buffer();
+        this->init();
+        return;
+    }
+
     dpo5000b::~dpo5000b() {
         return;
     }
 
     void dpo5000b::enable_channel(unsigned channel, bool enable) {
         this->check_channel(channel);
-        std::stringstream msg("");
-        msg << "SEL:CH" << channel;
-        if (enable) msg << " 1\n";
-        else msg << " 0\n";
-        comm->write(msg.str());
+        this->send( SCPI_CMD("SEL:CH{} {}\n", channel, enable) );
         return;
     }
 
@@ -68,7 +70,7 @@ namespace labdev {
     void dpo5000b::set_edge_trigger(unsigned channel, double level, uint8_t edge) {
         this->check_channel(channel);
         // Check edge
-        std::string edge_str("");
+        const char* edge_str;
         switch (edge) {
             case RISE:
                 edge_str = "RIS";
@@ -85,19 +87,13 @@ namespace labdev {
             abort();
         }
         // Set trigger source
-        std::stringstream msg("");
-        msg << "TRIG:A:EDGE:SOU CH" << channel << "\n";
-        comm->write( msg.str() );
+        this->send( SCPI_CMD("TRIG:A:EDGE:SOU CH{}\n", channel) );
 
         // Set edge trigger slope
-        msg.str("");
-        msg << "TRIG:A:EDGE:SLO " << edge_str << "\n";
-        comm->write( msg.str() );
+        this->send( SCPI_CMD("TRIG:A:EDGE:SLO {}\n", edge_str) );
 
         // Set trigger level
-        msg.str("");
-        msg << "TRIG:A:LEV " << level << "\n";
-        comm->write( msg.str() );
+        this->send( SCPI_CMD("TRIG:A:LEV {}\n", level) );
 
         return;
     }
@@ -111,38 +107,38 @@ namespace labdev {
     }
 
     void dpo5000b::set_sample_rate(int samples_per_sec) {
-        std::stringstream msg("");
-        msg << "HOR:MODE:SAMPLER " << samples_per_sec << "\n";
-        comm->write( msg.str() );
+        this->send_cached( SCPI_CMD("HOR:MODE:SAMPLER {}\n", samples_per_sec) );
+        // Record length and scale follow the sample rate
+        this->invalidate_cache("HOR:MODE:RECO");
+        this->invalidate_cache("HOR:MODE:SCA");
         return;
     }
 
     int dpo5000b::get_sample_rate() {
         int sample_rate = -1;
-        std::string msg = comm->query("HOR:MODE:SAMPLER?\n");
+        std::string msg = this->query_cached( scpi_cmd("HOR:MODE:SAMPLER?\n") );
         if ( !msg.empty() )
-            sample_rate = std::stoi(msg);
+            sample_rate = parse_int(msg);
         return sample_rate;
     }
 
     void dpo5000b::set_sample_len(int rec_len) {
-        std::stringstream msg("");
         // Set record length
-        msg << "HOR:MODE:RECO " << rec_len << "\n";
-        comm->write( msg.str() );
-        // Set sample start and stop
-        msg.str("");
-        msg << "DAT:STOP  " << rec_len << "\n";
-        comm->write("DAT:STAR 1\n");
-        comm->write( msg.str() );
+        this->send_cached( SCPI_CMD("HOR:MODE:RECO {}\n", rec_len) );
+        this->invalidate_cache("HOR:MODE:SAMPLER");
+        this->invalidate_cache("HOR:MODE:SCA");
+        // Set sample start and stop; not cached, "DAT SNA" (sample_screen())
+        // resets both
+        this->send( scpi_cmd("DAT:STAR 1\n") );
+        this->send( SCPI_CMD("DAT:STOP {}\n", rec_len) );
         return;
     }
 
     int dpo5000b::get_sample_len() {
         int sample_len = -1;
-        std::string msg = comm->query("HOR:MODE:RECO?\n");
+        std::string msg = this->query_cached( scpi_cmd("HOR:MODE:RECO?\n") );
         if ( !msg.empty() )
-            sample_len = std::stoi(msg);
+            sample_len = parse_int(msg);
         return sample_len;
     }
 
@@ -153,32 +149,40 @@ namespace labdev {
 
     void dpo5000b::read_sample_data(unsigned channel,
         std::vector<double> &horz_data, std::vector<double> &vert_data) {
+        waveform wf;
+        this->read_waveform(channel, wf);
+        wf.to_vectors(horz_data, vert_data);
+        return;
+    }
+
+    void dpo5000b::read_waveform(unsigned channel, waveform& wf) {
         this->check_channel(channel);
         // Set channel as source
         comm->write(":DAT:SOU CH" + std::to_string(channel) + "\n");
-
-        // Clear vectors
-        horz_data.clear();
-        vert_data.clear();
+        wf.clear();
 
         // Read preamble
         std::string data = comm->query("WFMO?\n");
-        std::vector<std::string> preamble = split(data, ";");
-        if (preamble.size() != 16) {
+
+        // Extract data from preamble (16 fields separated by ';', skipped
+        // fields are encoding, format, byte order, waveform id, point
+        // format, and units)
+        scpi_parser preamble(data);
+        int64_t nbyte, nbits, rec_len;
+        if ( !preamble.read_int(nbyte) || !preamble.read_int(nbits) ||
+             !preamble.skip() || !preamble.skip() || !preamble.skip() ||
+             !preamble.skip() || !preamble.read_int(rec_len) ||
+             !preamble.skip() || !preamble.skip() ||
+             !preamble.read_double(m_xincr) || !preamble.read_double(m_xzero) ||
+             !preamble.read_double(m_xoff) || !preamble.skip() ||
+             !preamble.read_double(m_ymult) || !preamble.read_double(m_yzero) ||
+             !preamble.read_double(m_yoff) || !preamble.at_end() ) {
             debug_print("Received wrong preamble: %s\n", data.c_str());
             throw bad_protocol("Received incomplete preamble.\n", -1);
         }
-
-        // Extract data from preamble
-        m_nbyte   = std::stoi( preamble.at(0) );
-        m_nbits   = std::stoi( preamble.at(1) );
-        m_npts    = std::stoi( preamble.at(6) );
-        m_xincr   = std::stof( preamble.at(9) );
-        m_xzero   = std::stof( preamble.at(10) );
-        m_xoff    = std::stof( preamble.at(11) );
-        m_ymult   = std::stof( preamble.at(13) );
-        m_yzero   = std::stof( preamble.at(14) );
-        m_yoff    = std::stof( preamble.at(15) );
+        m_nbyte = nbyte;
+        m_nbits = nbits;
+        m_npts  = rec_len;
 
         debug_print("nbyte = %i\n", m_nbyte);
         debug_print("nbits = %i\n", m_nbits);
@@ -189,34 +193,22 @@ namespace labdev {
         debug_print("xincr = %e\n", m_xincr);
         debug_print("xzero = %e\n", m_xzero);
 
-        // Get waveform
-        data.clear();
-        data = comm->query("CURV?\n", 5000);
-        // Remove header
-        int hdr_len = 2 + std::stoi( data.substr(1,1) );
-        int npts = data.size() - hdr_len - 1;
-        // Read until all points ar read
-        while (npts < m_npts) {
-            data.append( comm->read() );
-            npts = data.size() - hdr_len - 1;
-            debug_print("Number of points read %i\n", npts);
-        }
+        // Get waveform (signed 8 bit samples, see init()) directly into the
+        // sample buffer
+        wf.resize(waveform::INT8, m_npts);
+        comm->write("CURV?\n");
+        size_t npts = this->read_block(wf.raw_data(), wf.raw_size(), 5000);
+        wf.resize(waveform::INT8, npts);
+        debug_print("Number of points read %zu\n", npts);
 
-        double xval, yval;
-        for (int i = 0; i < npts; i++) {
-            xval = (i - m_xoff) * m_xincr + m_xzero;
-            yval = ((int8_t)data.at(i + hdr_len) - m_yzero) * m_ymult + m_yoff;
-            vert_data.push_back(xval);
-            horz_data.push_back(yval);
-        }
+        wf.set_horz_scale(m_xincr, m_xzero, m_xoff);
+        wf.set_vert_scale(m_ymult, m_yoff, m_yzero);
         return;
     }
 
     void dpo5000b::set_vert_base(unsigned channel, double volts_per_div) {
         this->check_channel(channel);
-        std::stringstream msg;
-        msg << "CH" << channel << ":SCA " << volts_per_div << "\n";
-        comm->write( msg.str() );
+        this->send_cached( SCPI_CMD("CH{}:SCA {}\n", channel, volts_per_div) );
         return;
     }
 
@@ -224,26 +216,25 @@ namespace labdev {
         this->check_channel(channel);
 
         double volts_per_div = -1;
-        std::stringstream msg;
-        msg << "CH" << channel << ":SCA?" << "\n";
-        std::string resp = comm->query( msg.str() );
+        std::string resp = this->query_cached(
+            SCPI_CMD("CH{}:SCA?\n", channel) );
         if ( !resp.empty() )
-            volts_per_div = std::stof(resp);
+            volts_per_div = parse_double(resp);
         return volts_per_div;
     }
 
     void dpo5000b::set_horz_base(double sec_per_div) {
-        std::stringstream msg;
-        msg << "HOR:MODE:SCA " << sec_per_div << "\n";
-        comm->write( msg.str() );
+        this->send_cached( SCPI_CMD("HOR:MODE:SCA {}\n", sec_per_div) );
+        this->invalidate_cache("HOR:MODE:SAMPLER");
+        this->invalidate_cache("HOR:MODE:RECO");
         return;
     }
 
     double dpo5000b::get_horz_base() {
         double sec_per_div = -1;
-        std::string msg = comm->query("HOR:MODE:SCA?\n");
+        std::string msg = this->query_cached( scpi_cmd("HOR:MODE:SCA?\n") );
         if ( !msg.empty() )
-            sec_per_div = std::stof(msg);
+            sec_per_div = parse_double(msg);
         return sec_per_div;
     }
 
@@ -6,48 +6,52 @@ using std::string;
 
 namespace labdev{
 
-    void interface::write(const string& msg) {
-        uint8_t wbuf[s_dflt_buf_size] = {0};
-        std::copy(msg.begin(), msg.end(), std::begin(wbuf));
-        this->write_raw(wbuf, msg.size());
-
-        debug_print("%s", "Sent message '");
+    // Verbose debug print of a received message
+    static void print_msg(const string& msg) {
+        debug_print("Read %zu bytes: '", msg.size());
         #ifdef LD_DEBUG
-        size_t nbytes = msg.size();
         if (msg.size() > 100) {
             for (int i = 0; i < 50; i++)
                 printf("%c", msg.at(i));
             printf(" [...] ");
-            for (int i = nbytes-50; i < nbytes; i++)
+            for (size_t i = msg.size()-50; i < msg.size(); i++)
                 printf("%c", msg.at(i));
         } else {
             printf("%s", msg.c_str());
         }
         printf("'\n");
         #endif
-
         return;
     }
 
-    string interface::read(unsigned timeout_ms) {
-        uint8_t rbuf[s_dflt_buf_size] = {0};
-        ssize_t nbytes = this->read_raw(rbuf, s_dflt_buf_size, timeout_ms);
-        string ret((char*)rbuf, nbytes);
+    void interface::write(const string& msg) {
+        this->write_raw((const uint8_t*)msg.data(), msg.size());
 
-        debug_print("Read %zi bytes: ", nbytes);
+        debug_print("%s", "Sent message '");
         #ifdef LD_DEBUG
-        if (ret.size() > 100) {
+        size_t nbytes = msg.size();
+        if (msg.size() > 100) {
             for (int i = 0; i < 50; i++)
-                printf("%c", ret.at(i));
+                printf("%c", msg.at(i));
             printf(" [...] ");
             for (int i = nbytes-50; i < nbytes; i++)
-                printf("%c", ret.at(i));
+                printf("%c", msg.at(i));
         } else {
-            printf("%s", ret.c_str());
+            printf("%s", msg.c_str());
         }
         printf("'\n");
         #endif
 
+        return;
+    }
+
+    string interface::read(unsigned timeout_ms) {
+        // No need to clear the buffer, only the received bytes are copied;
+        // timeouts of the transport are passed on unchanged
+        uint8_t rbuf[s_dflt_buf_size];
+        int nbytes = this->read_raw(rbuf, s_dflt_buf_size, timeout_ms);
+        string ret((char*)rbuf, nbytes);
+        print_msg(ret);
         return ret;
     }
 
@@ -74,4 +78,35 @@ namespace labdev{
         return read(timeout_ms);
     }
 
-}
\ No newline at end of file
+    io_result<size_t> interface::try_read_raw(uint8_t* data, size_t max_len,
+    unsigned timeout_ms) {
+        io_result<size_t> ret;
+        try {
+            ret.value = this->read_raw(data, max_len, timeout_ms);
+            ret.status = io_ok;
+        } catch (const timeout& ex) {
+            ret.value = 0;
+            ret.status = io_timeout;
+        }
+        return ret;
+    }
+
+    io_result<string> interface::try_read(unsigned timeout_ms) {
+        io_result<string> ret;
+        uint8_t rbuf[s_dflt_buf_size];
+        io_result<size_t> nbytes = this->try_read_raw(rbuf, s_dflt_buf_size,
+            timeout_ms);
+        // Bytes received before a timeout are returned as well
+        ret.status = nbytes.status;
+        ret.value.assign((char*)rbuf, nbytes.value);
+        print_msg(ret.value);
+        return ret;
+    }
+
+    io_result<string> interface::try_query(const string& msg,
+    unsigned timeout_ms) {
+        write(msg);
+        return try_read(timeout_ms);
+    }
+
+}
@@ -123,7 +123,17 @@ namespace labdev {
         return bytes_written;
     }
 
-    int serial_interface::read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms) {
+    int serial_interface::read_raw(uint8_t* data, size_t max_len,
+    unsigned timeout_ms) {
+        io_result<size_t> ret = this->try_read_raw(data, max_len, timeout_ms);
+        if ( !ret )
+            throw timeout("Read timeout occurred", ETIMEDOUT);
+        return ret.value;
+    }
+
+    io_result<size_t> serial_interface::try_read_raw(uint8_t* data,
+    size_t max_len, unsigned timeout_ms) {
+        io_result<size_t> ret = {io_timeout, 0};
         if (m_update_settings) this->apply_settings();
 
         // Wait for I/O
@@ -137,7 +147,7 @@ namespace labdev {
         int stat = select(m_fd + 1, &rfd_set, NULL, NULL, &m_timeout);
         check_and_throw(stat, "No data available");
         if (stat ==  0)
-            throw timeout("Read timeout occurred", errno);
+            return ret;
 
         // Data is available!
         ssize_t nbytes;
@@ -160,7 +170,9 @@ namespace labdev {
         printf("\n");
         #endif
 
-        return nbytes;
+        ret.status = io_ok;
+        ret.value = nbytes;
+        return ret;
     }
 
 
@@ -100,6 +100,15 @@ namespace labdev {
 
     int tcpip_interface::read_raw(uint8_t* data, size_t max_len,
     unsigned timeout_ms) {
+        io_result<size_t> ret = this->try_read_raw(data, max_len, timeout_ms);
+        if ( !ret )
+            throw timeout("Read timeout occurred", ETIMEDOUT);
+        return ret.value;
+    }
+
+    io_result<size_t> tcpip_interface::try_read_raw(uint8_t* data,
+    size_t max_len, unsigned timeout_ms) {
+        io_result<size_t> ret = {io_timeout, 0};
         // Wait for I/O
         fd_set rfd_set;
         FD_ZERO(&rfd_set);
@@ -111,7 +120,7 @@ namespace labdev {
         int stat = select(m_socket_fd + 1, &rfd_set, NULL, NULL, &m_timeout);
         check_and_throw(stat, "No data available");
         if (stat ==  0)
-            throw timeout("Read timeout occurred", errno);
+            return ret;
 
         ssize_t nbytes = recv(m_socket_fd, data, max_len, 0);
         check_and_throw(nbytes, "Failed to read from device");
@@ -131,7 +140,9 @@ namespace labdev {
         printf("\n");
         #endif
 
-        return nbytes;
+        ret.status = io_ok;
+        ret.value = nbytes;
+        return ret;
     }
 
     void tcpip_interface::set_buffer_size(size_t size) {
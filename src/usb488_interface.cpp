@@ -0,0 +1,174 @@
+#include <labdev/usb488_interface.hh>
+#include <labdev/exceptions.hh>
+#include "ld_debug.hh"
+
+#include <sys/time.h>   // gettimeofday()
+
+namespace labdev {
+
+    // Milliseconds passed since tsta
+    static double elapsed_ms(const struct timeval& tsta) {
+        struct timeval tsto;
+        gettimeofday(&tsto, NULL);
+        return (tsto.tv_sec - tsta.tv_sec) * 1000.
+            + (tsto.tv_usec - tsta.tv_usec)/1000.;
+    }
+
+    usb488_interface::usb488_interface() : usbtmc_interface() {
+        this->init();
+        return;
+    }
+
+    usb488_interface::usb488_interface(uint16_t vendor_id, uint16_t product_id,
+    std::string serial_number):
+    usbtmc_interface(vendor_id, product_id, serial_number) {
+        this->init();
+        return;
+    }
+
+    usb488_interface::usb488_interface(uint8_t bus_address,
+    uint8_t device_address):
+    usbtmc_interface(bus_address, device_address) {
+        this->init();
+        return;
+    }
+
+    usb488_interface::~usb488_interface() {
+        return;
+    }
+
+    uint8_t usb488_interface::read_status_byte() {
+        uint8_t tag = m_stb_tag;
+        m_stb_tag = (m_stb_tag >= 127) ? 2 : m_stb_tag + 1;
+
+        uint8_t resp[3] = {0};
+        this->control_request(READ_STATUS_BYTE, tag, resp, sizeof(resp));
+        if (this->get_endpoint_interrupt_in() == 0) {
+            debug_print("Status byte 0x%02X\n", resp[2]);
+            return resp[2];
+        }
+
+        // Devices with interrupt-IN endpoint return STB as notification,
+        // pending SRQ notifications are stored on the way
+        uint8_t notify[2];
+        while ( this->read_notification(notify, s_dflt_timeout_ms) ) {
+            if (notify[0] == (s_notify_stb | tag)) {
+                debug_print("Status byte 0x%02X\n", notify[1]);
+                return notify[1];
+            }
+        }
+        throw timeout("No status byte received from interrupt endpoint");
+    }
+
+    bool usb488_interface::srq_supported() {
+        // Service requests need an interrupt-IN endpoint and SR1 capability
+        return (this->get_endpoint_interrupt_in() != 0) &&
+               (m_caps[15] & 0x04);
+    }
+
+    bool usb488_interface::wait_for_srq(unsigned timeout_ms) {
+        if ( !this->srq_supported() ) {
+            fprintf(stderr, "Device does not support service requests\n");
+            abort();
+        }
+
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+
+        // Status byte reads are answered on the same endpoint, skip them;
+        // each read only waits for the rest of timeout_ms
+        uint8_t notify[2];
+        unsigned remaining_ms = timeout_ms;
+        while (!m_srq_pending) {
+            if ( !this->read_notification(notify, remaining_ms) )
+                return false;
+            // Less than 1ms left (a timeout of zero waits forever)
+            double tdiff = elapsed_ms(tsta);
+            if ( !m_srq_pending && (tdiff + 1 > timeout_ms) )
+                return false;
+            remaining_ms = timeout_ms - tdiff;
+        }
+        m_srq_pending = false;
+        debug_print("Service request, status byte 0x%02X\n", m_srq_stb);
+        return true;
+    }
+
+    void usb488_interface::remote_enable(bool enable) {
+        uint8_t resp[1];
+        this->control_request(REN_CONTROL, enable ? 1 : 0, resp, sizeof(resp));
+        return;
+    }
+
+    void usb488_interface::go_to_local() {
+        uint8_t resp[1];
+        this->control_request(GO_TO_LOCAL, 0, resp, sizeof(resp));
+        return;
+    }
+
+    void usb488_interface::local_lockout() {
+        uint8_t resp[1];
+        this->control_request(LOCAL_LOCKOUT, 0, resp, sizeof(resp));
+        return;
+    }
+
+    void usb488_interface::trigger() {
+        debug_print("%s\n", "Sending trigger message");
+        this->write_msg_out(TRIGGER, nullptr, 0, 0x00);
+        return;
+    }
+
+    void usb488_interface::claim_interface(int int_no, int alt_setting) {
+        usbtmc_interface::claim_interface(int_no, alt_setting);
+        // Check for USB488 interface
+        if (this->get_interface_protocol() != USB488_PROTOCOL) {
+            fprintf(stderr, "Interface %i does not support USB488\n", int_no);
+            abort();
+        }
+        debug_print("%s\n", "Device supports USB488");
+        return;
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    void usb488_interface::init() {
+        m_stb_tag = 2;
+        m_srq_pending = false;
+        m_srq_stb = 0;
+        return;
+    }
+
+    int usb488_interface::control_request(uint8_t request, uint16_t value,
+    uint8_t* data, int len) {
+        int nbytes = this->read_control(
+            LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE, request,
+            value, this->get_interface_number(), data, len);
+        if ( (nbytes < 1) || (data[0] != STATUS_SUCCESS) ) {
+            debug_print("Request 0x%02X failed (USBTMC_status 0x%02X)\n",
+                request, (nbytes < 1) ? 0 : data[0]);
+            throw device_error("USB488 control request failed",
+                (nbytes < 1) ? -1 : data[0]);
+        }
+        return nbytes;
+    }
+
+    bool usb488_interface::read_notification(uint8_t* notify,
+    unsigned timeout_ms) {
+        int nbytes;
+        try {
+            nbytes = this->read_interrupt(notify, 2, timeout_ms);
+        } catch (const timeout& ex) {
+            return false;
+        }
+        if (nbytes < 2)
+            throw bad_protocol("Incomplete interrupt-IN notification");
+
+        if (notify[0] == s_notify_srq) {
+            m_srq_pending = true;
+            m_srq_stb = notify[1];
+        }
+        return true;
+    }
+
+}
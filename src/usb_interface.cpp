@@ -15,7 +15,20 @@ namespace labdev {
     m_cur_interface_no(-1),
     m_cur_ep_in_addr(0),
     m_cur_ep_out_addr(0),
+    m_cur_ep_int_in_addr(0),
+    m_cur_ep_int_out_addr(0),
+    m_max_packet_size(0),
+    m_ep_bulk_in_addr(0),
+    m_ep_bulk_out_addr(0),
     m_connected(false),
+    m_xfer_buf(NULL),
+    m_xfer_buf_len(0),
+    m_xfer_buf_devmem(false),
+    m_xfer_buf_allow_devmem(true),
+    m_capture(),
+    m_replay(),
+    m_replaying(false),
+    m_capture_start(),
     m_dev_class(0),
     m_dev_subclass(0),
     m_dev_protocol(0),
@@ -154,7 +167,18 @@ namespace labdev {
     }
 
     void usb_interface::close() {
+        this->stop_capture();
+        // Replay does not use libusb, nothing else to release
+        if (m_replaying) {
+            m_replay.close();
+            m_replaying = false;
+            m_connected = false;
+            m_cur_interface_no = s_no_interface;
+            this->free_transfer_buffer();
+            return;
+        }
         // Release claimed interfaces and device
+        this->free_transfer_buffer();
         if (m_cur_interface_no != s_no_interface)
             libusb_release_interface(m_usb_handle, m_cur_interface_no);
         if (m_usb_handle)
@@ -171,6 +195,58 @@ namespace labdev {
         return;
     }
 
+    void usb_interface::open_replay(const std::string& path) {
+        if (m_connected)
+            throw bad_io("Interface is already opened");
+
+        m_replay.open(path, std::ifstream::in | std::ifstream::binary);
+        if ( m_replay.fail() )
+            throw bad_io("Failed to open capture file '" + path + "'");
+
+        // Check file header and extract device information
+        uint8_t hdr[s_capture_hdr_len];
+        m_replay.read((char*)hdr, s_capture_hdr_len);
+        uint16_t version = hdr[8] | (hdr[9] << 8);
+        if ( m_replay.fail() || (memcmp(hdr, "LDUSBCAP", 8) != 0) ||
+             (version != s_capture_version) ) {
+            m_replay.close();
+            throw bad_protocol("Invalid capture file '" + path + "'");
+        }
+        m_vid = hdr[10] | (hdr[11] << 8);
+        m_pid = hdr[12] | (hdr[13] << 8);
+        m_serial_no = "-1";
+        debug_print("Replaying '%s' (ID 0x%04X:0x%04X)\n", path.c_str(),
+            m_vid, m_pid);
+
+        m_replaying = true;
+        m_connected = true;
+        return;
+    }
+
+    void usb_interface::start_capture(const std::string& path) {
+        this->stop_capture();
+        m_capture.open(path, std::ofstream::out | std::ofstream::binary |
+            std::ofstream::trunc);
+        if ( m_capture.fail() )
+            throw bad_io("Failed to open capture file '" + path + "'");
+
+        uint8_t hdr[s_capture_hdr_len] = {'L', 'D', 'U', 'S', 'B', 'C', 'A', 'P',
+            0xFF & s_capture_version, 0xFF & (s_capture_version >> 8),
+            (uint8_t)(0xFF & m_vid), (uint8_t)(0xFF & (m_vid >> 8)),
+            (uint8_t)(0xFF & m_pid), (uint8_t)(0xFF & (m_pid >> 8)),
+            0x00, 0x00};
+        m_capture.write((const char*)hdr, s_capture_hdr_len);
+        gettimeofday(&m_capture_start, NULL);
+        debug_print("Capturing USB transfers to '%s'\n", path.c_str());
+        return;
+    }
+
+    void usb_interface::stop_capture() {
+        if ( m_capture.is_open() )
+            m_capture.close();
+        return;
+    }
+
     int usb_interface::write_raw(const uint8_t* data, size_t len) {
         this->check_interface();
         size_t bytes_left = len;
@@ -203,43 +279,40 @@ namespace labdev {
     };
 
     int usb_interface::read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms) {
-        this->check_interface();
-        ssize_t nbytes = 0;
-        uint8_t rbuf[s_dflt_buf_size] = {'\0'};
-        nbytes = this->read_bulk(rbuf, sizeof(rbuf), timeout_ms);
-        check_and_throw(nbytes, "Failed to read from device");
-
-        debug_print("Read %zi bytes: ", nbytes);
-        #ifdef LD_DEBUG
-        if (nbytes > 20) {
-            for (int i = 0; i < 10; i++)
-                printf("0x%02X ", data[i]);
-            printf("[...] ");
-            for (int i = nbytes-10; i < nbytes; i++)
-                printf("0x%02X ", data[i]);
-        } else {
-            for (int i = 0; i < nbytes; i++)
-                printf("0x%02X ", data[i]);
-        }
-        printf("\n");
-        #endif
-
-        return nbytes;
+        // Read directly into the callers buffer, no intermediate copy
+        return this->read_bulk(data, max_len, timeout_ms);
     };
 
+    io_result<size_t> usb_interface::try_read_raw(uint8_t* data,
+    size_t max_len, unsigned timeout_ms) {
+        io_result<int> nbytes = this->try_read_bulk(data, max_len, timeout_ms);
+        io_result<size_t> ret = {nbytes.status, (size_t)nbytes.value};
+        return ret;
+    }
+
     int usb_interface::write_control(uint8_t request_type, uint8_t request,
     uint16_t value, uint16_t index, const uint8_t* data, int len) {
         this->check_interface();
 
-        int nbytes = libusb_control_transfer(
-            m_usb_handle,
-            LIBUSB_ENDPOINT_OUT | request_type,
-            request,
-            value,
-            index,
-            (uint8_t*)data,
-            len,
-            1000);
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+        int nbytes;
+        if (m_replaying)
+            nbytes = this->replay(CAP_CONTROL_OUT, request, value, index,
+                (uint8_t*)data, len);
+        else
+            nbytes = libusb_control_transfer(
+                m_usb_handle,
+                LIBUSB_ENDPOINT_OUT | request_type,
+                request,
+                value,
+                index,
+                (uint8_t*)data,
+                len,
+                1000);
+        if ( m_capture.is_open() )
+            this->capture(CAP_CONTROL_OUT, request, request_type, value, index,
+                nbytes, data, len, tsta);
         check_and_throw(nbytes, "Control transfer failed to send data");
 
         // Verbose debug print
@@ -257,15 +330,25 @@ namespace labdev {
     const uint8_t* data, int len) {
         this->check_interface();
 
-        int nbytes = libusb_control_transfer(
-            m_usb_handle,
-            LIBUSB_ENDPOINT_IN | request_type,
-            request,
-            value,
-            index,
-            (uint8_t*)data,
-            len,
-            1000);
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+        int nbytes;
+        if (m_replaying)
+            nbytes = this->replay(CAP_CONTROL_IN, request, value, index,
+                (uint8_t*)data, len);
+        else
+            nbytes = libusb_control_transfer(
+                m_usb_handle,
+                LIBUSB_ENDPOINT_IN | request_type,
+                request,
+                value,
+                index,
+                (uint8_t*)data,
+                len,
+                1000);
+        if ( m_capture.is_open() )
+            this->capture(CAP_CONTROL_IN, request, request_type, value, index,
+                nbytes, data, nbytes, tsta);
         check_and_throw(nbytes, "Control transfer failed to read data");
 
         // Verbose debug print
@@ -283,14 +366,23 @@ namespace labdev {
     int usb_interface::write_bulk(const uint8_t* data, int len) {
         this->check_interface();
 
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
         int nbytes = -1, stat;
-        stat = libusb_bulk_transfer(
-            m_usb_handle,
-            LIBUSB_ENDPOINT_OUT | m_cur_ep_out_addr,
-            (uint8_t*)data,
-            len,
-            &nbytes,
-            1000);
+        if (m_replaying)
+            stat = nbytes = this->replay(CAP_BULK_OUT, m_cur_ep_out_addr, 0, 0,
+                (uint8_t*)data, len);
+        else
+            stat = libusb_bulk_transfer(
+                m_usb_handle,
+                LIBUSB_ENDPOINT_OUT | m_cur_ep_out_addr,
+                (uint8_t*)data,
+                len,
+                &nbytes,
+                1000);
+        if ( m_capture.is_open() )
+            this->capture(CAP_BULK_OUT, m_cur_ep_out_addr, 0, 0, 0,
+                (stat < 0) ? stat : nbytes, data, len, tsta);
         check_and_throw(stat, "Bulk transfer failed to send data");
 
         // Verbose debug print
@@ -313,16 +405,38 @@ namespace labdev {
     }
 
     int usb_interface::read_bulk(uint8_t* data, int max_len, int timeout_ms) {
+        io_result<int> ret = this->try_read_bulk(data, max_len, timeout_ms);
+        if ( !ret )
+            check_and_throw(LIBUSB_ERROR_TIMEOUT,
+                "Bulk transfer failed to read data");
+        return ret.value;
+    }
+
+    io_result<int> usb_interface::try_read_bulk(uint8_t* data, int max_len,
+    int timeout_ms) {
         this->check_interface();
 
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
         int nbytes = 0, stat;
-        stat = libusb_bulk_transfer(
-            m_usb_handle,
-            LIBUSB_ENDPOINT_IN | m_cur_ep_in_addr,
-            data,
-            max_len,
-            &nbytes,
-            timeout_ms);
+        if (m_replaying)
+            stat = this->replay(CAP_BULK_IN, m_cur_ep_in_addr, 0, 0, data,
+                max_len, &nbytes);
+        else
+            stat = libusb_bulk_transfer(
+                m_usb_handle,
+                LIBUSB_ENDPOINT_IN | m_cur_ep_in_addr,
+                data,
+                max_len,
+                &nbytes,
+                timeout_ms);
+        if ( m_capture.is_open() )
+            this->capture(CAP_BULK_IN, m_cur_ep_in_addr, 0, 0, 0,
+                (stat < 0) ? stat : nbytes, data, nbytes, tsta);
+        // Timeouts are returned with the number of bytes received so far
+        io_result<int> ret = {io_timeout, (nbytes < 0) ? 0 : nbytes};
+        if (stat == LIBUSB_ERROR_TIMEOUT)
+            return ret;
         check_and_throw(stat, "Bulk transfer failed to read data");
 
         // Verbose byte-wise debug print
@@ -341,23 +455,87 @@ namespace labdev {
         printf("\n");
         #endif
 
-        return nbytes;
+        ret.status = io_ok;
+        return ret;
     }
 
     int usb_interface::write_interrupt(const uint8_t* data, int len) {
-        // TODO
-        return 0;
+        this->check_interface();
+
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+        int nbytes = -1, stat;
+        if (m_replaying)
+            stat = nbytes = this->replay(CAP_INTERRUPT_OUT,
+                m_cur_ep_int_out_addr, 0, 0, (uint8_t*)data, len);
+        else
+            stat = libusb_interrupt_transfer(
+                m_usb_handle,
+                LIBUSB_ENDPOINT_OUT | m_cur_ep_int_out_addr,
+                (uint8_t*)data,
+                len,
+                &nbytes,
+                1000);
+        if ( m_capture.is_open() )
+            this->capture(CAP_INTERRUPT_OUT, m_cur_ep_int_out_addr, 0, 0, 0,
+                (stat < 0) ? stat : nbytes, data, len, tsta);
+        check_and_throw(stat, "Interrupt transfer failed to send data");
+
+        debug_print("Sent %i bytes via interrupt endpoint\n", nbytes);
+        return nbytes;
     }
 
     int usb_interface::read_interrupt(uint8_t* data, int max_len,
         int timeout_ms) {
-        // TODO
-        return 0;
+        this->check_interface();
+
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+        int nbytes = 0, stat;
+        if (m_replaying)
+            stat = this->replay(CAP_INTERRUPT_IN, m_cur_ep_int_in_addr, 0, 0,
+                data, max_len, &nbytes);
+        else
+            stat = libusb_interrupt_transfer(
+                m_usb_handle,
+                LIBUSB_ENDPOINT_IN | m_cur_ep_int_in_addr,
+                data,
+                max_len,
+                &nbytes,
+                timeout_ms);
+        if ( m_capture.is_open() )
+            this->capture(CAP_INTERRUPT_IN, m_cur_ep_int_in_addr, 0, 0, 0,
+                (stat < 0) ? stat : nbytes, data, nbytes, tsta);
+        check_and_throw(stat, "Interrupt transfer failed to read data");
+
+        debug_print("Read %i bytes via interrupt endpoint\n", nbytes);
+        return nbytes;
     }
 
     void usb_interface::claim_interface(int interface_no, int alt_setting) {
         int stat;
         char buf[100];
+        // Interface information is stored in the capture file
+        if (m_replaying) {
+            uint8_t info[s_claim_info_len];
+            stat = this->replay(CAP_CLAIM, interface_no, alt_setting, 0, info,
+                sizeof(info));
+            sprintf(buf, "Failed to claim interface %i", interface_no);
+            check_and_throw(stat, buf);
+            m_cur_interface_no = interface_no;
+            m_cur_alt_setting = alt_setting;
+            m_interface_class = info[0];
+            m_interface_subclass = info[1];
+            m_interface_protocol = info[2];
+            m_cur_ep_int_in_addr = info[3];
+            m_cur_ep_int_out_addr = info[4];
+            m_max_packet_size = info[5] | (info[6] << 8);
+            m_ep_bulk_in_addr = info[7];
+            m_ep_bulk_out_addr = info[8];
+            debug_print("Replayed claim of interface %i\n", m_cur_interface_no);
+            return;
+        }
+
         // Release current interface
         if ( (interface_no != m_cur_interface_no) &&
              (m_cur_interface_no != s_no_interface) ) {
@@ -389,19 +567,111 @@ namespace labdev {
         }
 
         this->gather_interface_information();
+
+        if ( m_capture.is_open() ) {
+            struct timeval tsta;
+            gettimeofday(&tsta, NULL);
+            uint8_t info[s_claim_info_len] = {m_interface_class,
+                m_interface_subclass, m_interface_protocol,
+                m_cur_ep_int_in_addr, m_cur_ep_int_out_addr,
+                (uint8_t)(0xFF & m_max_packet_size),
+                (uint8_t)(0xFF & (m_max_packet_size >> 8)),
+                m_ep_bulk_in_addr, m_ep_bulk_out_addr};
+            this->capture(CAP_CLAIM, interface_no, 0, alt_setting, 0,
+                sizeof(info), info, sizeof(info), tsta);
+        }
+        return;
+    }
+
+    uint8_t* usb_interface::get_transfer_buffer(size_t len) {
+        // Reuse current buffer if it is large enough
+        if (m_xfer_buf && (m_xfer_buf_len >= len))
+            return m_xfer_buf;
+        this->free_transfer_buffer();
+
+        // Round up to full pages, kernel-mapped memory is page-aligned anyway
+        len = (len + s_page_size - 1) & ~(s_page_size - 1);
+
+        // Try to get memory mapped by usbfs (Linux only, libusb >= 1.0.21);
+        // data is then transferred by DMA without copies to/from kernel space
+        #if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+        if (m_usb_handle && m_xfer_buf_allow_devmem)
+            m_xfer_buf = libusb_dev_mem_alloc(m_usb_handle, len);
+        #endif
+
+        if (m_xfer_buf) {
+            m_xfer_buf_devmem = true;
+            debug_print("Allocated %zu bytes of kernel-mapped memory\n", len);
+        } else {
+            // Fallback to normal user space memory
+            m_xfer_buf = new uint8_t[len];
+            m_xfer_buf_devmem = false;
+            debug_print("Allocated %zu bytes of user space memory\n", len);
+        }
+        m_xfer_buf_len = len;
+
+        return m_xfer_buf;
+    }
+
+    void usb_interface::set_zero_copy(bool enable) {
+        if (enable == m_xfer_buf_allow_devmem)
+            return;
+        this->free_transfer_buffer();
+        m_xfer_buf_allow_devmem = enable;
+        return;
+    }
+
+    void usb_interface::clear_halt(uint8_t ep_addr) {
+        this->check_interface();
+
+        struct timeval tsta;
+        gettimeofday(&tsta, NULL);
+        int stat;
+        if (m_replaying)
+            stat = this->replay(CAP_CLEAR_HALT, ep_addr, 0, 0, NULL, 0);
+        else
+            stat = libusb_clear_halt(m_usb_handle, ep_addr);
+        if ( m_capture.is_open() )
+            this->capture(CAP_CLEAR_HALT, ep_addr, 0, 0, 0, stat, NULL, 0, tsta);
+        check_and_throw(stat, "Failed to clear halt condition");
+
+        debug_print("Cleared halt condition of endpoint 0x%02X\n", ep_addr);
         return;
     }
 
     void usb_interface::set_endpoint_in(uint8_t ep_addr) {
+        // The captured driver has to use the same endpoints
+        if ( m_replaying && m_ep_bulk_in_addr &&
+             (ep_addr != m_ep_bulk_in_addr) ) {
+            debug_print("Bulk-IN endpoint 0x%02X, captured 0x%02X\n", ep_addr,
+                m_ep_bulk_in_addr);
+            throw bad_protocol("Bulk-IN endpoint does not match capture file");
+        }
         m_cur_ep_in_addr = ep_addr;
         return;
     }
 
     void usb_interface::set_endpoint_out(uint8_t ep_addr) {
+        if ( m_replaying && m_ep_bulk_out_addr &&
+             (ep_addr != m_ep_bulk_out_addr) ) {
+            debug_print("Bulk-OUT endpoint 0x%02X, captured 0x%02X\n",
+                ep_addr, m_ep_bulk_out_addr);
+            throw bad_protocol("Bulk-OUT endpoint does not match capture file");
+        }
         m_cur_ep_out_addr = ep_addr;
         return;
     }
 
+    void usb_interface::set_endpoint_interrupt_in(uint8_t ep_addr) {
+        m_cur_ep_int_in_addr = ep_addr;
+        return;
+    }
+
+    void usb_interface::set_endpoint_interrupt_out(uint8_t ep_addr) {
+        m_cur_ep_int_out_addr = ep_addr;
+        return;
+    }
+
     /*
      *      P R I V A T E   M E T H O D S
      */
@@ -464,10 +734,157 @@ namespace labdev {
         m_interface_subclass = int_desc->bInterfaceSubClass;
         m_interface_protocol = int_desc->bInterfaceProtocol;
 
+        // Get interrupt endpoints, bulk endpoints and bulk packet size
+        m_cur_ep_int_in_addr = 0;
+        m_cur_ep_int_out_addr = 0;
+        m_ep_bulk_in_addr = 0;
+        m_ep_bulk_out_addr = 0;
+        m_max_packet_size = 0;
+        for (int iep = 0; iep < int_desc->bNumEndpoints; iep++) {
+            const libusb_endpoint_descriptor* ep_desc = &int_desc->endpoint[iep];
+            uint8_t ep_addr = ep_desc->bEndpointAddress;
+            uint16_t pkt_size = ep_desc->wMaxPacketSize & 0x07FF;
+            switch (ep_desc->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) {
+            case LIBUSB_TRANSFER_TYPE_INTERRUPT:
+                if (ep_addr & LIBUSB_ENDPOINT_IN)
+                    m_cur_ep_int_in_addr = ep_addr & ~LIBUSB_ENDPOINT_DIR_MASK;
+                else
+                    m_cur_ep_int_out_addr = ep_addr;
+                break;
+            case LIBUSB_TRANSFER_TYPE_BULK:
+                if (pkt_size > m_max_packet_size)
+                    m_max_packet_size = pkt_size;
+                // First bulk endpoint of each direction
+                if ( (ep_addr & LIBUSB_ENDPOINT_IN) && !m_ep_bulk_in_addr )
+                    m_ep_bulk_in_addr = ep_addr & ~LIBUSB_ENDPOINT_DIR_MASK;
+                else if ( !(ep_addr & LIBUSB_ENDPOINT_IN) &&
+                          !m_ep_bulk_out_addr )
+                    m_ep_bulk_out_addr = ep_addr;
+                break;
+            }
+        }
+        libusb_free_config_descriptor(cfg_desc);
+
         debug_print("bInterfaceClass\t0x%02X\n", m_interface_class);
         debug_print("bInterfaceSubClass\t0x%02X\n", m_interface_subclass);
         debug_print("bInterfaceProtocol\t0x%02X\n", m_interface_protocol);
+        debug_print("Interrupt endpoints\tIN 0x%02X OUT 0x%02X\n",
+            m_cur_ep_int_in_addr, m_cur_ep_int_out_addr);
+        debug_print("Bulk endpoints\tIN 0x%02X OUT 0x%02X\n", m_ep_bulk_in_addr,
+            m_ep_bulk_out_addr);
+        debug_print("wMaxPacketSize\t%u\n", m_max_packet_size);
+
+        return;
+    }
+
+    void usb_interface::capture(uint8_t type, uint8_t addr,
+    uint8_t request_type, uint16_t value, uint16_t index, int status,
+    const uint8_t* data, int len, const struct timeval& tsta) {
+        struct timeval tsto;
+        gettimeofday(&tsto, NULL);
+        uint32_t t_us = (tsta.tv_sec - m_capture_start.tv_sec) * 1000000
+            + (tsta.tv_usec - m_capture_start.tv_usec);
+        uint32_t dur_us = (tsto.tv_sec - tsta.tv_sec) * 1000000
+            + (tsto.tv_usec - tsta.tv_usec);
+        uint32_t ustat = (uint32_t)status;
+        uint32_t ulen = (len > 0) ? len : 0;
+
+        uint8_t hdr[s_record_hdr_len] = {type, addr, request_type, 0x00,
+            (uint8_t)(0xFF & value), (uint8_t)(0xFF & (value >> 8)),
+            (uint8_t)(0xFF & index), (uint8_t)(0xFF & (index >> 8))};
+        for (int i = 0; i < 4; i++) {
+            hdr[ 8 + i] = 0xFF & (ustat >> 8*i);
+            hdr[12 + i] = 0xFF & (t_us >> 8*i);
+            hdr[16 + i] = 0xFF & (dur_us >> 8*i);
+            hdr[20 + i] = 0xFF & (ulen >> 8*i);
+        }
+        m_capture.write((const char*)hdr, s_record_hdr_len);
+        if (ulen > 0)
+            m_capture.write((const char*)data, ulen);
+        if ( m_capture.fail() )
+            throw bad_io("Failed to write to capture file");
+        return;
+    }
 
+    int usb_interface::replay(uint8_t type, uint8_t addr, uint16_t value,
+    uint16_t index, uint8_t* data, int len, int* nbytes) {
+        uint8_t hdr[s_record_hdr_len];
+        m_replay.read((char*)hdr, s_record_hdr_len);
+        if ( m_replay.fail() )
+            throw bad_io("End of capture file reached");
+
+        uint32_t ustat = 0, ulen = 0;
+        for (int i = 0; i < 4; i++) {
+            ustat |= (uint32_t)hdr[ 8 + i] << 8*i;
+            ulen  |= (uint32_t)hdr[20 + i] << 8*i;
+        }
+        int status = (int)ustat;
+        debug_print("Replaying record type 0x%02X, addr 0x%02X, status %i, "
+            "length %u\n", hdr[0], hdr[1], status, ulen);
+
+        // The driver has to request exactly the same transfer sequence
+        if ( (hdr[0] != type) || (hdr[1] != addr) ||
+             ((hdr[4] | (hdr[5] << 8)) != value) ||
+             ((hdr[6] | (hdr[7] << 8)) != index) ) {
+            debug_print("Expected record type 0x%02X, addr 0x%02X\n",
+                type, addr);
+            throw bad_protocol("Transfer does not match capture file");
+        }
+
+        switch (type) {
+        case CAP_CONTROL_IN:
+        case CAP_BULK_IN:
+        case CAP_INTERRUPT_IN:
+        case CAP_CLAIM:
+            if ( ulen > (uint32_t)len ) {
+                m_replay.seekg(ulen, std::ifstream::cur);
+                if (nbytes)
+                    *nbytes = 0;
+                return LIBUSB_ERROR_OVERFLOW;
+            }
+            // Data received before an error (e.g. a timeout) is returned too
+            m_replay.read((char*)data, ulen);
+            if (nbytes)
+                *nbytes = ulen;
+            break;
+
+        default: {
+            // Compare written data with capture
+            bool match = ( ulen == (uint32_t)len );
+            uint8_t cbuf[256];
+            uint32_t pos = 0;
+            while (pos < ulen) {
+                uint32_t chunk = std::min<uint32_t>(ulen - pos, sizeof(cbuf));
+                m_replay.read((char*)cbuf, chunk);
+                if ( match && (memcmp(cbuf, &data[pos], chunk) != 0) )
+                    match = false;
+                pos += chunk;
+            }
+            if (!match)
+                throw bad_protocol("Written data does not match capture file");
+            break;
+        }
+        }
+        if ( m_replay.fail() )
+            throw bad_io("Capture file truncated");
+
+        return status;
+    }
+
+    void usb_interface::free_transfer_buffer() {
+        if (!m_xfer_buf)
+            return;
+        #if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+        if (m_xfer_buf_devmem)
+            libusb_dev_mem_free(m_usb_handle, m_xfer_buf, m_xfer_buf_len);
+        else
+            delete[] m_xfer_buf;
+        #else
+        delete[] m_xfer_buf;
+        #endif
+        m_xfer_buf = NULL;
+        m_xfer_buf_len = 0;
+        m_xfer_buf_devmem = false;
         return;
     }
 
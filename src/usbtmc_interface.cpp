@@ -2,6 +2,10 @@
 #include <labdev/exceptions.hh>
 #include "ld_debug.hh"
 
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>     // usleep()
+
 namespace labdev {
 
     usbtmc_interface::usbtmc_interface() : usb_interface() {
@@ -36,64 +40,61 @@ namespace labdev {
         return this->read_dev_dep_msg(timeout_ms);
     }
 
-    int usbtmc_interface::write_dev_dep_msg(std::string msg,
+    int usbtmc_interface::write_dev_dep_msg(const std::string& msg,
     uint8_t transfer_attr) {
-        // add space for header + total length must be multiple of 4
-        size_t tot_len = s_header_len + msg.size() + 4 - msg.size()%4;
-        uint8_t* usbtmc_message = new uint8_t[tot_len];
-        this->create_usbtmc_header(usbtmc_message, DEV_DEP_MSG_OUT,
-            transfer_attr, msg.size());
-
-        // Append data
-        for (int i = s_header_len; i < tot_len; i++) {
-            usbtmc_message[i] = msg.c_str()[i-s_header_len];
-            if (i > msg.size()+s_header_len)
-                usbtmc_message[i] = 0x00;   // zero padding
-        }
-
         debug_print("Writing message '%s'\n", msg.c_str());
-        int nbytes = this->write_bulk((const uint8_t*)usbtmc_message, tot_len);
-        // cleanup
-        delete[] usbtmc_message;
+        return this->write_dev_dep_msg((const uint8_t*)msg.data(), msg.size(),
+            transfer_attr);
+    }
 
-        return nbytes;
+    int usbtmc_interface::write_dev_dep_msg(const uint8_t* data, size_t len,
+    uint8_t transfer_attr) {
+        // Split message into transfers fitting the device input buffer, only
+        // the last transfer has the EOM bit set (if requested)
+        size_t pos = 0;
+        do {
+            size_t chunk = std::min<size_t>(len - pos, m_max_write_size);
+            bool last = (pos + chunk == len);
+            this->write_msg_out(DEV_DEP_MSG_OUT, data + pos, chunk,
+                last ? transfer_attr : (transfer_attr & ~EOM));
+            pos += chunk;
+        } while (pos < len);
+
+        return len;
+    }
+
+    int usbtmc_interface::write_raw(const uint8_t* data, size_t len) {
+        return this->write_dev_dep_msg(data, len);
     }
 
     std::string usbtmc_interface::read_dev_dep_msg(int timeout_ms,
     uint8_t transfer_attr, uint8_t term_char) {
-        uint8_t read_request[s_header_len];
-        uint8_t rbuf[s_dflt_buf_size] = { 0x00 };
-
-        // Send read request
-        debug_print("%s\n", "Sending read request\n");
-        this->create_usbtmc_header(read_request, REQUEST_DEV_DEP_MSG_IN,
-            transfer_attr, sizeof(rbuf), term_char);
-        this->write_bulk((const uint8_t*)read_request, s_header_len);
-
-        // Read from bulk endpoint
-        debug_print("%s\n", "Reading...\n");
-        int len = this->read_bulk(rbuf, sizeof(rbuf), timeout_ms);
-
-        // If an empty message was received, return immediatly
-        if (len == 0)
-            return "";
-
-        // Check header
-        int transfer_size = check_usbtmc_header(rbuf, DEV_DEP_MSG_IN);
-        // Remove header from return value
-        len -= s_header_len;
-        std::string ret((const char*)rbuf + s_header_len, len);
-
-        // If more data than received was anounced in the header, keep reading
-        int bytes_left = transfer_size - len;
-        while (bytes_left > 0) {
-            int nbytes = this->read_bulk(rbuf, sizeof(rbuf), timeout_ms);
-            ret.append((char*)rbuf, std::min(bytes_left, nbytes));
-            bytes_left -= nbytes;
+        std::string ret("");
+        bool eom = false;
+        m_eom = false;
+
+        // Messages may be split into several transfers; read until EOM is set
+        while (!eom) {
+            debug_print("%s\n", "Sending read request");
+            this->request_msg_in(REQUEST_DEV_DEP_MSG_IN, m_max_read_size,
+                transfer_attr, term_char);
+            size_t nfirst = 0;
+            io_result<uint32_t> transfer_size = this->read_msg_in_header(
+                DEV_DEP_MSG_IN, m_max_read_size, timeout_ms, eom, nfirst);
+            if ( !transfer_size )
+                throw timeout(s_timeout_msg, LIBUSB_ERROR_TIMEOUT);
+
+            // Allocate result once and stream packets straight into it
+            size_t offset = ret.size();
+            ret.resize(offset + transfer_size.value);
+            transfer_size = this->read_msg_in_payload((uint8_t*)&ret[offset],
+                transfer_size.value, nfirst, timeout_ms);
+            if ( !transfer_size )
+                throw timeout(s_timeout_msg, LIBUSB_ERROR_TIMEOUT);
+            ret.resize(offset + transfer_size.value);
         }
 
-        // Increase bTag for next communication
-        m_cur_tag++;
+        m_eom = true;
 
         debug_print("Read %zi bytes: ", ret.size());
         #ifdef LD_DEBUG
@@ -113,58 +114,74 @@ namespace labdev {
         return ret;
     }
 
-    int usbtmc_interface::write_vendor_specific(std::string msg) {
-        // add space for header + total length must be multiple of 4
-        size_t tot_len = s_header_len + msg.size() + 4 - msg.size()%4;
-        uint8_t* usbtmc_message = new uint8_t[tot_len];
-        this->create_usbtmc_header(usbtmc_message, VENDOR_SPECIFIC_OUT, 0x00,
-            msg.size());
+    int usbtmc_interface::read_dev_dep_msg(uint8_t* data, size_t max_len,
+    int timeout_ms, uint8_t transfer_attr, uint8_t term_char) {
+        io_result<size_t> ret = this->try_read_dev_dep_msg(data, max_len,
+            timeout_ms, transfer_attr, term_char);
+        if ( !ret )
+            throw timeout(s_timeout_msg, LIBUSB_ERROR_TIMEOUT);
+        return ret.value;
+    }
 
-        // Append data
-        for (int i = s_header_len; i < tot_len; i++) {
-            usbtmc_message[i] = msg.c_str()[i-s_header_len];
-            if (i > msg.size()+s_header_len)
-                usbtmc_message[i] = 0x00;   // zero padding
-        }
+    io_result<size_t> usbtmc_interface::try_read_dev_dep_msg(uint8_t* data,
+    size_t max_len, int timeout_ms, uint8_t transfer_attr, uint8_t term_char) {
+        // Request at most max_len bytes, the rest of the message (if any) is
+        // returned by following reads
+        debug_print("Sending read request for %zu bytes\n", max_len);
+        m_eom = false;
+        this->request_msg_in(REQUEST_DEV_DEP_MSG_IN, max_len, transfer_attr,
+            term_char);
+        bool eom = false;
+        size_t nfirst = 0;
+        io_result<uint32_t> transfer_size = this->read_msg_in_header(
+            DEV_DEP_MSG_IN, max_len, timeout_ms, eom, nfirst);
+        if (transfer_size)
+            transfer_size = this->read_msg_in_payload(data,
+                transfer_size.value, nfirst, timeout_ms);
+        m_eom = transfer_size.ok() && eom;
+
+        io_result<size_t> ret = {transfer_size.status, transfer_size.value};
+        return ret;
+    }
 
-        int nbytes = this->write_bulk((const uint8_t*)usbtmc_message, tot_len);
-        // cleanup
-        delete[] usbtmc_message;
+    int usbtmc_interface::read_raw(uint8_t* data, size_t max_len,
+    unsigned timeout_ms) {
+        return this->read_dev_dep_msg(data, max_len, timeout_ms);
+    }
 
-        return nbytes;
+    io_result<size_t> usbtmc_interface::try_read_raw(uint8_t* data,
+    size_t max_len, unsigned timeout_ms) {
+        // Not the raw bulk read of usb_interface, the message header has to
+        // be parsed and a timed out transfer aborted
+        return this->try_read_dev_dep_msg(data, max_len, timeout_ms);
+    }
+
+    int usbtmc_interface::write_vendor_specific(const std::string& msg) {
+        debug_print("Writing vendor specific message '%s'\n", msg.c_str());
+        this->write_msg_out(VENDOR_SPECIFIC_OUT, (const uint8_t*)msg.data(),
+            msg.size(), 0x00);
+        return msg.size();
     }
 
     std::string usbtmc_interface::read_vendor_specific(int timeout_ms) {
-        uint8_t read_request[s_header_len], rbuf[s_dflt_buf_size];
         // Send read request
-        debug_print("%s\n", "Sending vendor specific read request\n");
-        this->create_usbtmc_header(read_request, REQUEST_VENDOR_SPECIFIC_IN,
-            0x00, sizeof(rbuf), 0x00);
-        this->write_bulk((const uint8_t*)read_request, s_header_len);
-
-        // Read from bulk endpoint
-        debug_print("%s\n", "Reading...\n");
-        int len = this->read_bulk(rbuf, sizeof(rbuf), timeout_ms);
-
-        // If an empty message was received, return immediatly
-        if (len == 0)
-            return "";
-
-        // Check header
-        int transfer_size = check_usbtmc_header(rbuf, DEV_DEP_MSG_IN);
-        // Remove header from return value
-        len -= s_header_len;
-        std::string ret((const char*)rbuf + s_header_len, len);
-
-        // If more data than received was anounced in the header, keep reading
-        int bytes_left = transfer_size - len;
-        while (bytes_left > 0) {
-            int nbytes = this->read_bulk(rbuf, sizeof(rbuf), timeout_ms);
-            ret.append((char*)rbuf, std::min(bytes_left, nbytes));
-            bytes_left -= nbytes;
-        }
-        // Increase bTag for next communication
-        m_cur_tag++;
+        debug_print("%s\n", "Sending vendor specific read request");
+        this->request_msg_in(REQUEST_VENDOR_SPECIFIC_IN, m_max_read_size, 0x00,
+            0x00);
+        bool eom = false;
+        size_t nfirst = 0;
+        io_result<uint32_t> transfer_size = this->read_msg_in_header(
+            VENDOR_SPECIFIC_IN, m_max_read_size, timeout_ms, eom, nfirst);
+        if ( !transfer_size )
+            throw timeout(s_timeout_msg, LIBUSB_ERROR_TIMEOUT);
+
+        // Allocate result once and stream packets straight into it
+        std::string ret(transfer_size.value, '\0');
+        transfer_size = this->read_msg_in_payload((uint8_t*)&ret[0],
+            transfer_size.value, nfirst, timeout_ms);
+        if ( !transfer_size )
+            throw timeout(s_timeout_msg, LIBUSB_ERROR_TIMEOUT);
+        ret.resize(transfer_size.value);
         debug_print("Received vendor specific message (%lu) '%s'\n",
             ret.size(), ret.c_str());
 
@@ -172,10 +189,109 @@ namespace labdev {
     }
 
     void usbtmc_interface::clear_buffer() {
-        uint8_t buf[1];
-        this->write_control(LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE,
-        INITIATE_CLEAR, 0x0000, 0x0000, buf, 0x0001);
-        // TODO: check return value!
+        debug_print("%s\n", "Clearing device buffers");
+        uint8_t resp[2];
+        uint8_t stat = this->class_request(LIBUSB_RECIPIENT_INTERFACE,
+            INITIATE_CLEAR, 0x0000, this->get_interface_number(), resp, 1);
+        if (stat != STATUS_SUCCESS)
+            throw device_error("INITIATE_CLEAR failed", stat);
+
+        // Poll clear status, Bulk-IN data still queued has to be read
+        for (unsigned i = 0; i < s_max_status_polls; i++) {
+            stat = this->class_request(LIBUSB_RECIPIENT_INTERFACE,
+                CHECK_CLEAR_STATUS, 0x0000, this->get_interface_number(), resp,
+                2);
+            if (stat == STATUS_PENDING) {
+                if (resp[1] & 0x01)
+                    this->drain_bulk_in();
+                else
+                    usleep(1000);
+                continue;
+            }
+            if (stat != STATUS_SUCCESS)
+                throw device_error("CHECK_CLEAR_STATUS failed", stat);
+
+            this->clear_halt(LIBUSB_ENDPOINT_OUT | this->get_endpoint_out());
+            return;
+        }
+        throw timeout("USBTMC clear did not complete");
+    }
+
+    void usbtmc_interface::abort_bulk_in() {
+        uint8_t ep = LIBUSB_ENDPOINT_IN | this->get_endpoint_in();
+        debug_print("Aborting Bulk-IN transfer (bTag 0x%02X)\n", m_cur_tag);
+        uint8_t resp[8];
+        uint8_t stat = this->class_request(LIBUSB_RECIPIENT_ENDPOINT,
+            INITIATE_ABORT_BULK_IN, m_cur_tag, ep, resp, 2);
+        // No transfer in progress and nothing queued, nothing to abort
+        if (stat == STATUS_FAILED) {
+            this->next_tag();
+            return;
+        }
+        if (stat != STATUS_SUCCESS)
+            throw device_error("INITIATE_ABORT_BULK_IN failed", stat);
+
+        // Read remaining data until the device has completed the abort
+        this->drain_bulk_in();
+        for (unsigned i = 0; i < s_max_status_polls; i++) {
+            stat = this->class_request(LIBUSB_RECIPIENT_ENDPOINT,
+                CHECK_ABORT_BULK_IN_STATUS, 0x0000, ep, resp, 8);
+            if (stat == STATUS_PENDING) {
+                if (resp[1] & 0x01)
+                    this->drain_bulk_in();
+                else
+                    usleep(1000);
+                continue;
+            }
+            if (stat != STATUS_SUCCESS)
+                throw device_error("CHECK_ABORT_BULK_IN_STATUS failed", stat);
+
+            this->next_tag();
+            return;
+        }
+        throw timeout("Bulk-IN abort did not complete");
+    }
+
+    void usbtmc_interface::abort_bulk_out() {
+        uint8_t ep = LIBUSB_ENDPOINT_OUT | this->get_endpoint_out();
+        debug_print("Aborting Bulk-OUT transfer (bTag 0x%02X)\n", m_cur_tag);
+        uint8_t resp[8];
+        uint8_t stat = this->class_request(LIBUSB_RECIPIENT_ENDPOINT,
+            INITIATE_ABORT_BULK_OUT, m_cur_tag, ep, resp, 2);
+        if (stat == STATUS_FAILED) {
+            this->next_tag();
+            return;
+        }
+        if (stat != STATUS_SUCCESS)
+            throw device_error("INITIATE_ABORT_BULK_OUT failed", stat);
+
+        for (unsigned i = 0; i < s_max_status_polls; i++) {
+            stat = this->class_request(LIBUSB_RECIPIENT_ENDPOINT,
+                CHECK_ABORT_BULK_OUT_STATUS, 0x0000, ep, resp, 8);
+            if (stat == STATUS_PENDING) {
+                usleep(1000);
+                continue;
+            }
+            if (stat != STATUS_SUCCESS)
+                throw device_error("CHECK_ABORT_BULK_OUT_STATUS failed", stat);
+
+            this->clear_halt(ep);
+            this->next_tag();
+            return;
+        }
+        throw timeout("Bulk-OUT abort did not complete");
+    }
+
+    void usbtmc_interface::indicator_pulse() {
+        if ( !this->indicator_pulse_supported() ) {
+            fprintf(stderr, "Device does not support INDICATOR_PULSE\n");
+            abort();
+        }
+        uint8_t resp[1];
+        uint8_t stat = this->class_request(LIBUSB_RECIPIENT_INTERFACE,
+            INDICATOR_PULSE, 0x0000, this->get_interface_number(), resp, 1);
+        if (stat != STATUS_SUCCESS)
+            throw device_error("INDICATOR_PULSE failed", stat);
         return;
     }
 
@@ -188,6 +304,18 @@ namespace labdev {
             abort();
         }
         debug_print("%s\n", "Device supports USBTMC");
+
+        // Read capabilities once, older devices might not answer
+        memset(m_caps, 0, s_caps_len);
+        uint8_t stat = this->class_request(LIBUSB_RECIPIENT_INTERFACE,
+            GET_CAPABILITIES, 0x0000, int_no, m_caps, s_caps_len);
+        if (stat != STATUS_SUCCESS) {
+            debug_print("GET_CAPABILITIES failed (USBTMC_status 0x%02X)\n",
+                stat);
+            memset(m_caps, 0, s_caps_len);
+        }
+        debug_print("bcdUSBTMC 0x%04X, interface 0x%02X, device 0x%02X\n",
+            this->get_usbtmc_version(), m_caps[4], m_caps[5]);
         return;
     }
 
@@ -197,10 +325,216 @@ namespace labdev {
 
     void usbtmc_interface::init() {
         m_cur_tag = 0x01;
-        m_eom_cap = true;
+        m_eom = false;
+        memset(m_caps, 0, s_caps_len);
+        m_max_read_size = s_dflt_read_size;
+        m_max_write_size = s_dflt_buf_size;
         return;
     }
 
+    uint8_t usbtmc_interface::class_request(uint8_t recipient, uint8_t request,
+    uint16_t value, uint16_t index, uint8_t* data, int len) {
+        int nbytes = this->read_control(LIBUSB_REQUEST_TYPE_CLASS | recipient,
+            request, value, index, data, len);
+        if (nbytes < 1)
+            throw bad_protocol("Empty USBTMC control response");
+        return data[0];
+    }
+
+    void usbtmc_interface::drain_bulk_in() {
+        size_t pkt_size = this->packet_size();
+        uint8_t* pkt = this->get_transfer_buffer(s_dflt_buf_size);
+        io_result<int> nbytes;
+        do {
+            nbytes = this->try_read_bulk(pkt, s_dflt_buf_size, 100);
+            if ( !nbytes )
+                return;
+            debug_print("Discarded %i bytes\n", nbytes.value);
+        } while ( (nbytes.value > 0) && ((nbytes.value % pkt_size) == 0) );
+        return;
+    }
+
+    void usbtmc_interface::next_tag() {
+        // bTag must not be zero
+        m_cur_tag++;
+        if (m_cur_tag == 0x00)
+            m_cur_tag = 0x01;
+        return;
+    }
+
+    size_t usbtmc_interface::packet_size() {
+        // Fallback to USB 2.0 high speed packet size if unknown
+        size_t pkt_size = this->get_max_packet_size();
+        if ( (pkt_size == 0) || (pkt_size > s_max_packet_size) )
+            pkt_size = 512;
+        return pkt_size;
+    }
+
+    void usbtmc_interface::write_msg_out(uint8_t message_id,
+    const uint8_t* data, size_t len, uint8_t transfer_attr) {
+        size_t pkt_size = this->packet_size();
+        size_t pad = (4 - len % 4) % 4;
+
+        // The header and the start of the payload are sent from the scratch
+        // area as one packet...
+        this->create_usbtmc_header(m_out_pkt, message_id, transfer_attr, len);
+        size_t nfirst = std::min<size_t>(len, pkt_size - s_header_len);
+        if (nfirst > 0)
+            memcpy(m_out_pkt + s_header_len, data, nfirst);
+
+        try {
+            // ... short messages fit completely into the first packet
+            if (s_header_len + len + pad <= pkt_size) {
+                memset(m_out_pkt + s_header_len + len, 0x00, pad);
+                this->write_bulk(m_out_pkt, s_header_len + len + pad);
+                this->next_tag();
+                return;
+            }
+            this->write_bulk(m_out_pkt, pkt_size);
+
+            // Full packets are gathered directly from the callers memory; as
+            // long as only full packets are sent the device sees one transfer
+            size_t pos = nfirst;
+            size_t direct_end = pos + (len - pos) / pkt_size * pkt_size;
+            while (pos < direct_end)
+                pos += this->write_bulk(data + pos, direct_end - pos);
+
+            // Last short packet including alignment bytes is sent from scratch
+            if (pos < len) {
+                memcpy(m_out_pkt, data + pos, len - pos);
+                memset(m_out_pkt + len - pos, 0x00, pad);
+                this->write_bulk(m_out_pkt, len - pos + pad);
+            }
+        } catch (const timeout& ex) {
+            // Device stopped accepting data, abandon the transfer
+            this->abort_bulk_out();
+            throw;
+        }
+
+        debug_print("Sent %zu bytes in %zu packets\n", len,
+            (s_header_len + len + pad + pkt_size - 1) / pkt_size);
+        this->next_tag();
+        return;
+    }
+
+    void usbtmc_interface::request_msg_in(uint8_t message_id, uint32_t max_len,
+    uint8_t transfer_attr, uint8_t term_char) {
+        // Only request termination character if the device supports it
+        if ( !this->term_char_supported() )
+            transfer_attr &= ~TERM_CHAR;
+        uint8_t read_request[s_header_len];
+        this->create_usbtmc_header(read_request, message_id, transfer_attr,
+            max_len, term_char);
+        this->write_bulk((const uint8_t*)read_request, s_header_len);
+        return;
+    }
+
+    io_result<uint32_t> usbtmc_interface::read_msg_in_header(
+    uint8_t message_id, uint32_t max_len, int timeout_ms, bool& eom,
+    size_t& nfirst) {
+        // The first packet contains the header and the start of the payload;
+        // reading exactly one packet does not require a large buffer
+        size_t pkt_size = this->packet_size();
+        uint8_t* pkt = this->get_transfer_buffer(pkt_size);
+        io_result<uint32_t> ret = {io_ok, 0};
+        nfirst = 0;
+        io_result<int> len = this->try_read_bulk(pkt, pkt_size, timeout_ms);
+        if ( !len ) {
+            // Withdraw the pending request, next transfer starts in sync
+            this->abort_bulk_in();
+            ret.status = io_timeout;
+            return ret;
+        }
+
+        // Empty message, nothing more to read
+        if (len.value < (int)s_header_len) {
+            debug_print("Received short message (%i bytes)\n", len.value);
+            eom = true;
+            return ret;
+        }
+
+        // An invalid header or more data than requested (e.g. a corrupt
+        // TransferSize) leaves the rest of the transfer in the pipe, it has
+        // to be discarded before the next transfer
+        try {
+            ret.value = this->check_usbtmc_header(pkt, message_id);
+            if (ret.value > max_len) {
+                debug_print("TransferSize %u exceeds requested %u bytes\n",
+                    ret.value, max_len);
+                throw bad_protocol("Device sent more data than requested",
+                    ret.value);
+            }
+        } catch (const bad_protocol& ex) {
+            this->abort_bulk_in();
+            throw;
+        }
+        eom = (message_id != DEV_DEP_MSG_IN) || (pkt[8] & EOM);
+        nfirst = len.value - s_header_len;
+        return ret;
+    }
+
+    io_result<uint32_t> usbtmc_interface::read_msg_in_payload(uint8_t* data,
+    uint32_t transfer_size, size_t nfirst, int timeout_ms) {
+        size_t pkt_size = this->packet_size();
+        uint8_t* pkt = this->get_transfer_buffer(pkt_size);
+
+        // Payload of first packet (might include alignment bytes)
+        size_t pos = std::min<size_t>(nfirst, transfer_size);
+        memcpy(data, pkt + s_header_len, pos);
+
+        // Full packets are transferred directly into the destination...
+        bool short_pkt = (nfirst + s_header_len < pkt_size);
+        size_t direct_end = pos + (transfer_size - pos) / pkt_size * pkt_size;
+        io_result<int> nbytes = {io_ok, 0};
+        while ( !short_pkt && (pos < direct_end) ) {
+            nbytes = this->try_read_bulk(data + pos, direct_end - pos,
+                timeout_ms);
+            pos += nbytes.value;
+            if ( !nbytes )
+                break;
+            // A short packet terminates the transfer
+            short_pkt = (nbytes.value % pkt_size != 0) || (nbytes.value == 0);
+        }
+
+        // ... only the last packet containing alignment bytes is copied
+        if ( nbytes && !short_pkt && (pos < transfer_size) ) {
+            nbytes = this->try_read_bulk(pkt, pkt_size, timeout_ms);
+            size_t ncopy = std::min<size_t>(nbytes.value, transfer_size - pos);
+            memcpy(data + pos, pkt, ncopy);
+            pos += ncopy;
+            short_pkt = (nbytes.value < (int)pkt_size);
+        }
+
+        // Abandon stalled transfer instead of leaving the device out of sync,
+        // the data received so far is returned
+        io_result<uint32_t> ret = {nbytes.status, (uint32_t)pos};
+        if ( !nbytes ) {
+            debug_print("Transfer stalled after %zu of %u bytes\n", pos,
+                transfer_size);
+            this->abort_bulk_in();
+            return ret;
+        }
+
+        // A transfer ending on a packet boundary is terminated by a
+        // zero-length packet, it would be read as the next message
+        if (!short_pkt) {
+            nbytes = this->try_read_bulk(pkt, pkt_size, s_zlp_timeout_ms);
+            if ( !nbytes )
+                debug_print("%s\n", "No zero-length packet after transfer");
+            else if (nbytes.value > 0)
+                debug_print("Discarded %i bytes after transfer\n",
+                    nbytes.value);
+        }
+
+        if (pos < transfer_size)
+            debug_print("Transfer ended early (%zu of %u bytes)\n", pos,
+                transfer_size);
+
+        // Increase bTag for next communication
+        this->next_tag();
+        return ret;
+    }
+
     void usbtmc_interface::create_usbtmc_header(uint8_t* header,
     uint8_t message_id, uint8_t transfer_attr, uint32_t transfer_size,
     uint8_t term_char) {
@@ -232,6 +566,7 @@ namespace labdev {
 
             case VENDOR_SPECIFIC_OUT:
             case REQUEST_VENDOR_SPECIFIC_IN:
+            default:
                 header[8] = 0x00;
                 header[9] = 0x00;
                 header[10] = 0x00;
@@ -0,0 +1,248 @@
+#include <labdev/usbtmc_kernel_interface.hh>
+#include "ld_debug.hh"
+
+#ifdef __linux__
+
+#include <fcntl.h>          // open()
+#include <unistd.h>         // close(), read(), write()
+#include <errno.h>          // errno, strerror()
+#include <poll.h>           // poll()
+#include <sys/ioctl.h>      // ioctl()
+#include <linux/usb/tmc.h>  // USBTMC ioctls
+
+namespace labdev {
+
+    usbtmc_kernel_interface::usbtmc_kernel_interface():
+        interface(),
+        m_fd(-1),
+        m_path(""),
+        m_connected(false),
+        m_timeout(0),
+        m_caps488(0),
+        m_short_read(false) {
+        return;
+    }
+
+    usbtmc_kernel_interface::usbtmc_kernel_interface(const std::string& path):
+        usbtmc_kernel_interface() {
+        this->open(path);
+        return;
+    }
+
+    usbtmc_kernel_interface::~usbtmc_kernel_interface() {
+        if (m_connected)
+            this->close();
+        return;
+    }
+
+    void usbtmc_kernel_interface::open(const std::string& path) {
+        debug_print("Opening device '%s'\n", path.c_str());
+        m_fd = ::open(path.c_str(), O_RDWR);
+        check_and_throw(m_fd, "Failed to open device " + path);
+        m_path = path;
+        m_connected = true;
+
+        // USB488 capabilities, plain USBTMC devices report none
+        m_caps488 = 0;
+        if (ioctl(m_fd, USBTMC488_IOCTL_GET_CAPS, &m_caps488) < 0)
+            m_caps488 = 0;
+        debug_print("USB488 capabilities 0x%02X\n", m_caps488);
+
+        m_timeout = 0;
+        this->set_timeout(s_dflt_timeout_ms);
+        return;
+    }
+
+    void usbtmc_kernel_interface::close() {
+        debug_print("Closing device '%s'\n", m_path.c_str());
+        ::close(m_fd);
+        m_fd = -1;
+        m_connected = false;
+        return;
+    }
+
+    int usbtmc_kernel_interface::write_raw(const uint8_t* data, size_t len) {
+        // The driver splits the message into transfers and sets EOM
+        ssize_t nbytes = ::write(m_fd, data, len);
+        check_and_throw(nbytes, "Failed to write to device");
+
+        debug_print("Written %zi bytes\n", nbytes);
+        return nbytes;
+    }
+
+    int usbtmc_kernel_interface::read_raw(uint8_t* data, size_t max_len,
+    unsigned timeout_ms) {
+        io_result<size_t> ret = this->try_read_raw(data, max_len, timeout_ms);
+        if ( !ret )
+            throw timeout("Read timeout occurred", ETIMEDOUT);
+        return ret.value;
+    }
+
+    io_result<size_t> usbtmc_kernel_interface::try_read_raw(uint8_t* data,
+    size_t max_len, unsigned timeout_ms) {
+        this->set_timeout(timeout_ms);
+        // Reads one message of at most max_len bytes directly into data
+        io_result<size_t> ret = {io_timeout, 0};
+        m_short_read = false;
+        ssize_t nbytes = ::read(m_fd, data, max_len);
+        if ( (nbytes < 0) && (errno == ETIMEDOUT) )
+            return ret;
+        check_and_throw(nbytes, "Failed to read from device");
+
+        debug_print("Read %zi bytes: ", nbytes);
+        #ifdef LD_DEBUG
+        if (nbytes > 20) {
+            for (int i = 0; i < 10; i++)
+                printf("0x%02X ", data[i]);
+            printf("[...] ");
+            for (int i = nbytes-10; i < nbytes; i++)
+                printf("0x%02X ", data[i]);
+        } else {
+            for (int i = 0; i < nbytes; i++)
+                printf("0x%02X ", data[i]);
+        }
+        printf("\n");
+        #endif
+
+        // The driver returns less than requested only at the end of a message
+        m_short_read = ((size_t)nbytes < max_len);
+        ret.status = io_ok;
+        ret.value = nbytes;
+        return ret;
+    }
+
+    bool usbtmc_kernel_interface::end_of_message() const {
+        if (m_short_read)
+            return true;
+        #ifdef USBTMC_IOCTL_MSG_IN_ATTR
+        // Drivers since Linux 4.19 report bmTransferAttributes (EOM bit 0)
+        uint8_t attr = 0;
+        if (ioctl(m_fd, USBTMC_IOCTL_MSG_IN_ATTR, &attr) == 0)
+            return attr & 0x01;
+        #endif
+        return false;
+    }
+
+    void usbtmc_kernel_interface::clear_buffer() {
+        int stat = ioctl(m_fd, USBTMC_IOCTL_CLEAR);
+        check_and_throw(stat, "USBTMC clear failed");
+        return;
+    }
+
+    void usbtmc_kernel_interface::abort_bulk_in() {
+        int stat = ioctl(m_fd, USBTMC_IOCTL_ABORT_BULK_IN);
+        check_and_throw(stat, "Bulk-IN abort failed");
+        return;
+    }
+
+    void usbtmc_kernel_interface::abort_bulk_out() {
+        int stat = ioctl(m_fd, USBTMC_IOCTL_ABORT_BULK_OUT);
+        check_and_throw(stat, "Bulk-OUT abort failed");
+        return;
+    }
+
+    void usbtmc_kernel_interface::indicator_pulse() {
+        int stat = ioctl(m_fd, USBTMC_IOCTL_INDICATOR_PULSE);
+        check_and_throw(stat, "Indicator pulse failed");
+        return;
+    }
+
+    uint8_t usbtmc_kernel_interface::read_status_byte() {
+        uint8_t stb = 0;
+        int stat = ioctl(m_fd, USBTMC488_IOCTL_READ_STB, &stb);
+        check_and_throw(stat, "Failed to read status byte");
+        debug_print("Status byte 0x%02X\n", stb);
+        return stb;
+    }
+
+    void usbtmc_kernel_interface::remote_enable(bool enable) {
+        uint8_t val = enable ? 1 : 0;
+        int stat = ioctl(m_fd, USBTMC488_IOCTL_REN_CONTROL, &val);
+        check_and_throw(stat, "REN control failed");
+        return;
+    }
+
+    void usbtmc_kernel_interface::go_to_local() {
+        int stat = ioctl(m_fd, USBTMC488_IOCTL_GOTO_LOCAL);
+        check_and_throw(stat, "Go to local failed");
+        return;
+    }
+
+    void usbtmc_kernel_interface::local_lockout() {
+        int stat = ioctl(m_fd, USBTMC488_IOCTL_LOCAL_LOCKOUT);
+        check_and_throw(stat, "Local lockout failed");
+        return;
+    }
+
+    void usbtmc_kernel_interface::trigger() {
+        int stat = ioctl(m_fd, USBTMC488_IOCTL_TRIGGER);
+        check_and_throw(stat, "Trigger failed");
+        return;
+    }
+
+    bool usbtmc_kernel_interface::srq_supported() {
+        return (m_caps488 & USBTMC488_CAPABILITY_SR1);
+    }
+
+    bool usbtmc_kernel_interface::wait_for_srq(unsigned timeout_ms) {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLPRI;
+        pfd.revents = 0;
+        int stat = poll(&pfd, 1, timeout_ms);
+        check_and_throw(stat, "Failed to wait for service request");
+        if ( (stat == 0) || !(pfd.revents & POLLPRI) )
+            return false;
+
+        // Reading the status byte resets the SRQ flag of the driver
+        uint8_t stb = this->read_status_byte();
+        debug_print("Service request, status byte 0x%02X\n", stb);
+        return true;
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    void usbtmc_kernel_interface::set_timeout(unsigned timeout_ms) {
+        if (timeout_ms == m_timeout)
+            return;
+        // The driver does not accept timeouts below 100ms
+        uint32_t val = (timeout_ms < 100) ? 100 : timeout_ms;
+        int stat = ioctl(m_fd, USBTMC_IOCTL_SET_TIMEOUT, &val);
+        check_and_throw(stat, "Failed to set timeout");
+        m_timeout = timeout_ms;
+        return;
+    }
+
+    void usbtmc_kernel_interface::check_and_throw(int status,
+    const std::string &msg) const {
+        if (status < 0) {
+            int error = errno;
+            char err_msg[256] = {'\0'};
+            sprintf(err_msg, "%s (%s, %i)", msg.c_str(), strerror(error), error);
+            debug_print("%s\n", err_msg);
+
+            switch (error) {
+            case ETIMEDOUT:
+            case EAGAIN:
+                throw timeout(err_msg, error);
+                break;
+
+            case ENODEV:
+            case ENOENT:
+            case EACCES:
+            case ENXIO:
+                throw bad_connection(err_msg, error);
+                break;
+
+            default:
+                throw bad_io(err_msg, error);
+            }
+        }
+        return;
+    }
+
+}
+
+#endif
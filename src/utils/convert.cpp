@@ -0,0 +1,307 @@
+#include <labdev/utils/convert.hh>
+#include "ld_debug.hh"
+
+#include <cstdio>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LD_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Kernels are compiled for their instruction set only, the library itself
+// does not require any -m flags
+#define LD_TARGET(isa) __attribute__((target(isa)))
+
+namespace labdev {
+
+    /*
+     *      Scalar kernels (fallback and tail of the SIMD kernels)
+     */
+
+    template<Sample_format F>
+    static inline int32_t read_code(const uint8_t* in, size_t i);
+
+    template<> inline int32_t read_code<S8>(const uint8_t* in, size_t i)
+        { return (int8_t)in[i]; }
+    template<> inline int32_t read_code<U8>(const uint8_t* in, size_t i)
+        { return in[i]; }
+    template<> inline int32_t read_code<S16_LE>(const uint8_t* in, size_t i)
+        { return (int16_t)(in[2*i] | (in[2*i + 1] << 8)); }
+    template<> inline int32_t read_code<S16_BE>(const uint8_t* in, size_t i)
+        { return (int16_t)((in[2*i] << 8) | in[2*i + 1]); }
+
+    template<Sample_format F, typename T>
+    static void convert_scalar(const uint8_t* in, T* out, size_t n, T scale,
+    T offset) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = (T)read_code<F>(in, i) * scale + offset;
+        return;
+    }
+
+    #ifdef LD_X86_SIMD
+
+    /*
+     *      SSE2 kernels, 8 samples per iteration
+     */
+
+    // Loads 8 samples as two vectors of 4 int32
+    template<Sample_format F>
+    LD_TARGET("sse2") static inline void load8_sse2(const uint8_t* in,
+    __m128i& lo, __m128i& hi) {
+        __m128i w;
+        if (F == U8) {
+            __m128i zero = _mm_setzero_si128();
+            w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)in), zero);
+            lo = _mm_unpacklo_epi16(w, zero);
+            hi = _mm_unpackhi_epi16(w, zero);
+            return;
+        }
+        if (F == S8) {
+            // Sign extension by duplicating the byte and shifting back
+            __m128i x = _mm_loadl_epi64((const __m128i*)in);
+            w = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+        } else {
+            w = _mm_loadu_si128((const __m128i*)in);
+            if (F == S16_BE)
+                w = _mm_or_si128(_mm_slli_epi16(w, 8), _mm_srli_epi16(w, 8));
+        }
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+        return;
+    }
+
+    template<Sample_format F>
+    LD_TARGET("sse2") static void convert_sse2(const uint8_t* in, float* out,
+    size_t n, float scale, float offset) {
+        const __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i lo, hi;
+            load8_sse2<F>(in + i * sample_size(F), lo, hi);
+            _mm_storeu_ps(out + i,
+                _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), s), o));
+            _mm_storeu_ps(out + i + 4,
+                _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), s), o));
+        }
+        convert_scalar<F>(in + i * sample_size(F), out + i, n - i, scale,
+            offset);
+        return;
+    }
+
+    template<Sample_format F>
+    LD_TARGET("sse2") static void convert_sse2(const uint8_t* in, double* out,
+    size_t n, double scale, double offset) {
+        const __m128d s = _mm_set1_pd(scale), o = _mm_set1_pd(offset);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i v[2];
+            load8_sse2<F>(in + i * sample_size(F), v[0], v[1]);
+            for (int j = 0; j < 2; j++) {
+                __m128d d0 = _mm_cvtepi32_pd(v[j]);
+                __m128d d1 = _mm_cvtepi32_pd(_mm_shuffle_epi32(v[j], 0xEE));
+                _mm_storeu_pd(out + i + 4*j,
+                    _mm_add_pd(_mm_mul_pd(d0, s), o));
+                _mm_storeu_pd(out + i + 4*j + 2,
+                    _mm_add_pd(_mm_mul_pd(d1, s), o));
+            }
+        }
+        convert_scalar<F>(in + i * sample_size(F), out + i, n - i, scale,
+            offset);
+        return;
+    }
+
+    /*
+     *      AVX2 kernels, 8 samples per iteration
+     */
+
+    // Loads 8 samples as one vector of 8 int32
+    template<Sample_format F>
+    LD_TARGET("avx2") static inline __m256i load8_avx2(const uint8_t* in) {
+        if (F == S8)
+            return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)in));
+        if (F == U8)
+            return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)in));
+        __m128i w = _mm_loadu_si128((const __m128i*)in);
+        if (F == S16_BE)
+            w = _mm_shuffle_epi8(w, _mm_set_epi8(14, 15, 12, 13, 10, 11, 8,
+                9, 6, 7, 4, 5, 2, 3, 0, 1));
+        return _mm256_cvtepi16_epi32(w);
+    }
+
+    template<Sample_format F>
+    LD_TARGET("avx2") static void convert_avx2(const uint8_t* in, float* out,
+    size_t n, float scale, float offset) {
+        const __m256 s = _mm256_set1_ps(scale), o = _mm256_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 f = _mm256_cvtepi32_ps(
+                load8_avx2<F>(in + i * sample_size(F)));
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(f, s), o));
+        }
+        convert_scalar<F>(in + i * sample_size(F), out + i, n - i, scale,
+            offset);
+        return;
+    }
+
+    template<Sample_format F>
+    LD_TARGET("avx2") static void convert_avx2(const uint8_t* in, double* out,
+    size_t n, double scale, double offset) {
+        const __m256d s = _mm256_set1_pd(scale), o = _mm256_set1_pd(offset);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = load8_avx2<F>(in + i * sample_size(F));
+            __m256d d0 = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+            __m256d d1 = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+            _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(d0, s), o));
+            _mm256_storeu_pd(out + i + 4,
+                _mm256_add_pd(_mm256_mul_pd(d1, s), o));
+        }
+        convert_scalar<F>(in + i * sample_size(F), out + i, n - i, scale,
+            offset);
+        return;
+    }
+
+    /*
+     *      AVX-512 kernels (AVX512F only), 16 samples per iteration
+     */
+
+    // Some GCC versions warn about _mm512_undefined_*() inside the intrinsics
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+    // Loads 16 samples as one vector of 16 int32
+    template<Sample_format F>
+    LD_TARGET("avx512f") static inline __m512i load16_avx512(
+    const uint8_t* in) {
+        if (F == S8)
+            return _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)in));
+        if (F == U8)
+            return _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)in));
+        __m256i w = _mm256_loadu_si256((const __m256i*)in);
+        if (F == S16_BE)
+            w = _mm256_shuffle_epi8(w, _mm256_set_epi8(14, 15, 12, 13, 10, 11,
+                8, 9, 6, 7, 4, 5, 2, 3, 0, 1, 14, 15, 12, 13, 10, 11, 8, 9, 6,
+                7, 4, 5, 2, 3, 0, 1));
+        return _mm512_cvtepi16_epi32(w);
+    }
+
+    template<Sample_format F>
+    LD_TARGET("avx512f") static void convert_avx512(const uint8_t* in,
+    float* out, size_t n, float scale, float offset) {
+        const __m512 s = _mm512_set1_ps(scale), o = _mm512_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512 f = _mm512_cvtepi32_ps(
+                load16_avx512<F>(in + i * sample_size(F)));
+            _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_mul_ps(f, s), o));
+        }
+        convert_scalar<F>(in + i * sample_size(F), out + i, n - i, scale,
+            offset);
+        return;
+    }
+
+    template<Sample_format F>
+    LD_TARGET("avx512f") static void convert_avx512(const uint8_t* in,
+    double* out, size_t n, double scale, double offset) {
+        const __m512d s = _mm512_set1_pd(scale), o = _mm512_set1_pd(offset);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512i v = load16_avx512<F>(in + i * sample_size(F));
+            __m512d d0 = _mm512_cvtepi32_pd(_mm512_castsi512_si256(v));
+            __m512d d1 = _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(v, 1));
+            _mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_mul_pd(d0, s), o));
+            _mm512_storeu_pd(out + i + 8,
+                _mm512_add_pd(_mm512_mul_pd(d1, s), o));
+        }
+        convert_scalar<F>(in + i * sample_size(F), out + i, n - i, scale,
+            offset);
+        return;
+    }
+
+    #pragma GCC diagnostic pop
+
+    #endif
+
+    /*
+     *      Runtime dispatch
+     */
+
+    template<typename T>
+    struct kernel_table {
+        typedef void (*kernel)(const uint8_t*, T*, size_t, T, T);
+        kernel k[4];    // Indexed by Sample_format
+    };
+
+    // Kernels by Simd_level, levels not compiled in use the scalar kernels
+    template<typename T>
+    static const kernel_table<T>& get_kernels(Simd_level level) {
+        static const kernel_table<T> s_kernels[] = {
+            {{ convert_scalar<S8, T>, convert_scalar<U8, T>,
+               convert_scalar<S16_LE, T>, convert_scalar<S16_BE, T> }},
+            #ifdef LD_X86_SIMD
+            {{ convert_sse2<S8>, convert_sse2<U8>, convert_sse2<S16_LE>,
+               convert_sse2<S16_BE> }},
+            {{ convert_avx2<S8>, convert_avx2<U8>, convert_avx2<S16_LE>,
+               convert_avx2<S16_BE> }},
+            {{ convert_avx512<S8>, convert_avx512<U8>, convert_avx512<S16_LE>,
+               convert_avx512<S16_BE> }},
+            #endif
+        };
+        size_t nlevels = sizeof(s_kernels) / sizeof(s_kernels[0]);
+        return s_kernels[(level < nlevels) ? level : 0];
+    }
+
+    static Simd_level& current_level() {
+        static Simd_level s_level = detect_simd_level();
+        return s_level;
+    }
+
+    void convert_samples(const uint8_t* in, Sample_format fmt, float* out,
+    size_t n, float scale, float offset) {
+        get_kernels<float>(current_level()).k[fmt](in, out, n, scale, offset);
+        return;
+    }
+
+    void convert_samples(const uint8_t* in, Sample_format fmt, double* out,
+    size_t n, double scale, double offset) {
+        get_kernels<double>(current_level()).k[fmt](in, out, n, scale,
+            offset);
+        return;
+    }
+
+    Simd_level detect_simd_level() {
+        #ifdef LD_X86_SIMD
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports("avx512f") )
+            return SIMD_AVX512;
+        if ( __builtin_cpu_supports("avx2") )
+            return SIMD_AVX2;
+        if ( __builtin_cpu_supports("sse2") )
+            return SIMD_SSE2;
+        #endif
+        return SIMD_SCALAR;
+    }
+
+    Simd_level get_simd_level() {
+        return current_level();
+    }
+
+    void set_simd_level(Simd_level level) {
+        Simd_level supported = detect_simd_level();
+        current_level() = (level < supported) ? level : supported;
+        debug_print("Using %s sample conversion\n",
+            simd_level_name(current_level()));
+        return;
+    }
+
+    const char* simd_level_name(Simd_level level) {
+        switch (level) {
+        case SIMD_SCALAR: return "scalar";
+        case SIMD_SSE2:   return "SSE2";
+        case SIMD_AVX2:   return "AVX2";
+        case SIMD_AVX512: return "AVX-512";
+        }
+        return "unknown";
+    }
+
+}
@@ -0,0 +1,357 @@
+#include <labdev/utils/measurement.hh>
+#include "ld_debug.hh"
+
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#define LD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace labdev {
+
+    // Indices of ds1000z::measurement_item
+    enum : unsigned { VMAX, VMIN, VPP, VTOP, VBAS, VAMP, VAVG, VRMS, OVER,
+        PRES, MAR, MPAR, PER, FREQ, RTIM, FTIM, PWID, NWID, PDUT, NDUT, RDEL,
+        FDEL, RPH, FPH };
+
+    static const double s_nan = std::numeric_limits<double>::quiet_NaN();
+
+    // Histogram bins between VMIN and VMAX (resolution of VTOP/VBAS)
+    static const unsigned s_nbins = 256;
+    // Minimum fraction of samples in the most frequent bin for a flat
+    // top/base
+    static const double s_min_flat = 0.05;
+    // Edges needed for period, widths and delays
+    static const size_t s_max_edges = 3;
+
+    // Fractional sample indices of the 10%, 50% and 90% crossings, start
+    // and end in the direction of the edge
+    struct edge {
+        double start, mid, end;
+    };
+
+    struct analysis {
+        measurements meas;
+        double rise, fall;      // Time of the first edges, NaN if none
+    };
+
+    /*
+     *      Kernels, float samples use SSE2 if available
+     */
+
+    struct sample_stats {
+        double min, max, sum, sumsq;
+    };
+
+    template<typename T>
+    static void get_stats(const T* v, size_t n, size_t i, sample_stats& st) {
+        for (; i < n; i++) {
+            double x = v[i];
+            st.min = std::min(st.min, x);
+            st.max = std::max(st.max, x);
+            st.sum += x;
+            st.sumsq += x * x;
+        }
+        return;
+    }
+
+    static sample_stats get_stats(const double* v, size_t n) {
+        sample_stats st = {v[0], v[0], 0., 0.};
+        get_stats(v, n, 0, st);
+        return st;
+    }
+
+    static sample_stats get_stats(const float* v, size_t n) {
+        sample_stats st = {v[0], v[0], 0., 0.};
+        size_t i = 0;
+        #ifdef LD_SSE2
+        // Minimum and maximum in float, sums in double to keep the precision
+        // for long records
+        __m128 vmin = _mm_set1_ps(v[0]), vmax = vmin;
+        __m128d sum = _mm_setzero_pd(), sumsq = _mm_setzero_pd();
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(v + i);
+            vmin = _mm_min_ps(vmin, x);
+            vmax = _mm_max_ps(vmax, x);
+            __m128d lo = _mm_cvtps_pd(x);
+            __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+            sum = _mm_add_pd(sum, _mm_add_pd(lo, hi));
+            sumsq = _mm_add_pd(sumsq,
+                _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+        }
+        float fmin[4], fmax[4];
+        double dsum[2], dsumsq[2];
+        _mm_storeu_ps(fmin, vmin);
+        _mm_storeu_ps(fmax, vmax);
+        _mm_storeu_pd(dsum, sum);
+        _mm_storeu_pd(dsumsq, sumsq);
+        for (int k = 0; k < 4; k++) {
+            st.min = std::min(st.min, (double)fmin[k]);
+            st.max = std::max(st.max, (double)fmax[k]);
+        }
+        st.sum = dsum[0] + dsum[1];
+        st.sumsq = dsumsq[0] + dsumsq[1];
+        #endif
+        get_stats(v, n, i, st);
+        return st;
+    }
+
+    // Index of the first sample >= i above (below) level, n if none
+    template<typename T>
+    static size_t find_above(const T* v, size_t n, size_t i, T level) {
+        for (; i < n; i++)
+            if (v[i] > level) return i;
+        return n;
+    }
+
+    template<typename T>
+    static size_t find_below(const T* v, size_t n, size_t i, T level) {
+        for (; i < n; i++)
+            if (v[i] < level) return i;
+        return n;
+    }
+
+    #ifdef LD_SSE2
+    // 16 samples per iteration, the scalar loop locates the sample
+    template<bool ABOVE>
+    static size_t find_sse2(const float* v, size_t n, size_t i,
+    float level) {
+        const __m128 l = _mm_set1_ps(level);
+        for (; i + 16 <= n; i += 16) {
+            __m128 c0, c1, c2, c3;
+            if (ABOVE) {
+                c0 = _mm_cmpgt_ps(_mm_loadu_ps(v + i), l);
+                c1 = _mm_cmpgt_ps(_mm_loadu_ps(v + i + 4), l);
+                c2 = _mm_cmpgt_ps(_mm_loadu_ps(v + i + 8), l);
+                c3 = _mm_cmpgt_ps(_mm_loadu_ps(v + i + 12), l);
+            } else {
+                c0 = _mm_cmplt_ps(_mm_loadu_ps(v + i), l);
+                c1 = _mm_cmplt_ps(_mm_loadu_ps(v + i + 4), l);
+                c2 = _mm_cmplt_ps(_mm_loadu_ps(v + i + 8), l);
+                c3 = _mm_cmplt_ps(_mm_loadu_ps(v + i + 12), l);
+            }
+            __m128 any = _mm_or_ps(_mm_or_ps(c0, c1), _mm_or_ps(c2, c3));
+            if ( _mm_movemask_ps(any) )
+                break;
+        }
+        for (; i < n; i++)
+            if (ABOVE ? v[i] > level : v[i] < level) return i;
+        return n;
+    }
+
+    static size_t find_above(const float* v, size_t n, size_t i, float level)
+        { return find_sse2<true>(v, n, i, level); }
+    static size_t find_below(const float* v, size_t n, size_t i, float level)
+        { return find_sse2<false>(v, n, i, level); }
+    #endif
+
+    // Most frequent level in the bins [first, last), fallback if the top or
+    // base is not flat
+    static double get_mode(const std::vector<size_t>& hist, unsigned first,
+    unsigned last, double vmin, double binw, size_t n, double fallback) {
+        unsigned mode = first;
+        for (unsigned b = first; b < last; b++)
+            if (hist[b] > hist[mode]) mode = b;
+        if (hist[mode] < s_min_flat * n)
+            return fallback;
+        return vmin + mode * binw;
+    }
+
+    // Fractional index where the line from v[i] to v[i+1] crosses level
+    template<typename T>
+    static double cross(const T* v, size_t i, double level) {
+        double dv = (double)v[i+1] - v[i];
+        return (dv == 0.) ? i : i + (level - v[i]) / dv;
+    }
+
+    // Edge ending at sample j, the previous edge ended at sample i
+    template<typename T>
+    static edge get_edge(const T* v, size_t i, size_t j, bool rising,
+    double low, double mid, double high) {
+        edge ret;
+        double start = rising ? low : high, end = rising ? high : low;
+        size_t k = j - 1;
+        ret.end = cross(v, k, end);
+        // Last crossings of the middle and the start level before j
+        while ( (k > i) && (rising ? v[k] >= mid : v[k] <= mid) ) k--;
+        ret.mid = cross(v, k, mid);
+        while ( (k > i) && (rising ? v[k] >= start : v[k] <= start) ) k--;
+        ret.start = cross(v, k, start);
+        return ret;
+    }
+
+    // First s_max_edges rising and falling edges with hysteresis between
+    // low and high
+    template<typename T>
+    static void find_edges(const T* v, size_t n, double low, double mid,
+    double high, std::vector<edge>& rise, std::vector<edge>& fall) {
+        size_t a = find_above(v, n, 0, (T)high);
+        size_t b = find_below(v, n, 0, (T)low);
+        if ( (a == n) && (b == n) )
+            return;
+        bool is_high = (a < b);
+        size_t i = std::min(a, b);
+        while ( (rise.size() < s_max_edges) || (fall.size() < s_max_edges) ) {
+            size_t j = is_high ? find_below(v, n, i, (T)low) :
+                find_above(v, n, i, (T)high);
+            if (j == n)
+                break;
+            if (is_high)
+                fall.push_back(get_edge(v, i, j, false, low, mid, high));
+            else
+                rise.push_back(get_edge(v, i, j, true, low, mid, high));
+            is_high = !is_high;
+            i = j;
+        }
+        return;
+    }
+
+    // Time at fractional sample index x
+    struct time_axis {
+        double xincr, xorg, xref;
+        double at(double x) const { return (x - xref) * xincr + xorg; }
+    };
+
+    template<typename T>
+    static analysis analyse(const T* v, size_t n, const time_axis& t) {
+        analysis ret;
+        double* m = ret.meas.value;
+        std::fill(m, m + measurements::s_n_items, s_nan);
+        ret.rise = ret.fall = s_nan;
+        if (n == 0)
+            return ret;
+
+        sample_stats st = get_stats(v, n);
+        m[VMAX] = st.max;
+        m[VMIN] = st.min;
+        m[VPP] = st.max - st.min;
+        m[VAVG] = st.sum / n;
+        m[VRMS] = sqrt(st.sumsq / n);
+        m[MAR] = st.sum * t.xincr;
+
+        // Top and base from the histogram of both halves
+        std::vector<size_t> hist(s_nbins, 0);
+        double binw = (st.max - st.min) / (s_nbins - 1);
+        T vmin = st.min, scale = (binw > 0.) ? 1. / binw : 0.;
+        for (size_t i = 0; i < n; i++)
+            hist[(unsigned)((v[i] - vmin) * scale + (T)0.5)]++;
+        m[VTOP] = get_mode(hist, s_nbins/2, s_nbins, st.min, binw, n, st.max);
+        m[VBAS] = get_mode(hist, 0, s_nbins/2, st.min, binw, n, st.min);
+        double amp = m[VTOP] - m[VBAS];
+        m[VAMP] = amp;
+        if (amp <= 0.)
+            return ret;
+        m[OVER] = (st.max - m[VTOP]) / amp;
+        m[PRES] = (m[VBAS] - st.min) / amp;
+
+        std::vector<edge> rise, fall;
+        find_edges(v, n, m[VBAS] + 0.1*amp, m[VBAS] + 0.5*amp,
+            m[VBAS] + 0.9*amp, rise, fall);
+        debug_print("Found %zu rising and %zu falling edges\n", rise.size(),
+            fall.size());
+
+        if ( !rise.empty() ) {
+            ret.rise = t.at(rise[0].mid);
+            m[RTIM] = t.at(rise[0].end) - t.at(rise[0].start);
+        }
+        if ( !fall.empty() ) {
+            ret.fall = t.at(fall[0].mid);
+            m[FTIM] = t.at(fall[0].end) - t.at(fall[0].start);
+        }
+
+        // Period between the first two edges of the same direction
+        const std::vector<edge>& per = (rise.size() >= 2) ? rise : fall;
+        if (per.size() >= 2) {
+            m[PER] = t.at(per[1].mid) - t.at(per[0].mid);
+            m[FREQ] = 1. / m[PER];
+            size_t first = ceil(per[0].mid), last = ceil(per[1].mid);
+            double area = 0.;
+            for (size_t i = first; i < last; i++)
+                area += v[i];
+            m[MPAR] = area * t.xincr;
+        }
+
+        // Widths from the first edge to the next one of the other direction
+        for (const auto& f : fall) {
+            if ( rise.empty() || (f.mid <= rise[0].mid) ) continue;
+            m[PWID] = t.at(f.mid) - t.at(rise[0].mid);
+            break;
+        }
+        for (const auto& r : rise) {
+            if ( fall.empty() || (r.mid <= fall[0].mid) ) continue;
+            m[NWID] = t.at(r.mid) - t.at(fall[0].mid);
+            break;
+        }
+        m[PDUT] = m[PWID] / m[PER];
+        m[NDUT] = m[NWID] / m[PER];
+        return ret;
+    }
+
+    static analysis analyse(const waveform& wf) {
+        // Voltages in float, ADC codes have at most 16 bit
+        std::vector<float> volts(wf.size());
+        wf.to_voltage(volts.data(), 0, wf.size());
+        time_axis t = {wf.get_xincr(), wf.get_xorg(), wf.get_xref()};
+        return analyse(volts.data(), volts.size(), t);
+    }
+
+    static void set_delays(analysis& chan, const analysis& ref) {
+        double* m = chan.meas.value;
+        m[RDEL] = ref.rise - chan.rise;
+        m[FDEL] = ref.fall - chan.fall;
+        m[RPH] = m[RDEL] / m[PER] * 360.;
+        m[FPH] = m[FDEL] / m[PER] * 360.;
+        return;
+    }
+
+    /*
+     *      Public functions
+     */
+
+    measurements measure(const waveform& wf, const waveform* ref) {
+        analysis chan = analyse(wf);
+        if (ref)
+            set_delays(chan, analyse(*ref));
+        return chan.meas;
+    }
+
+    measurements measure(const std::vector<double>& horz,
+    const std::vector<double>& vert, const std::vector<double>* ref_vert) {
+        size_t n = std::min(horz.size(), vert.size());
+        time_axis t = {0., 0., 0.};
+        if (n > 0)
+            t.xorg = horz[0];
+        if (n > 1)
+            t.xincr = (horz[n-1] - horz[0]) / (n - 1);
+        analysis chan = analyse(vert.data(), n, t);
+        if (ref_vert)
+            set_delays(chan, analyse(ref_vert->data(),
+                std::min(n, ref_vert->size()), t));
+        return chan.meas;
+    }
+
+    std::vector<measurements> measure(const std::vector<waveform>& wfs,
+    size_t ref) {
+        std::vector<analysis> res(wfs.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < wfs.size(); i++)
+            workers.emplace_back([&res, &wfs, i] { res[i] = analyse(wfs[i]); });
+        if ( !wfs.empty() )
+            res[0] = analyse(wfs[0]);
+        for (auto& w : workers)
+            w.join();
+
+        std::vector<measurements> ret;
+        for (auto& chan : res) {
+            if (ref < res.size())
+                set_delays(chan, res[ref]);
+            ret.push_back(chan.meas);
+        }
+        return ret;
+    }
+
+}
@@ -0,0 +1,89 @@
+#include <labdev/utils/scpi_cmd.hh>
+#include "ld_debug.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace labdev {
+
+    const char* scpi_cmd::copy_until_placeholder(const char* fmt) {
+        const char* pos = fmt;
+        while ( (*pos != '\0') && !((pos[0] == '{') && (pos[1] == '}')) )
+            pos++;
+        this->append_raw(fmt, pos - fmt);
+        return (*pos == '\0') ? nullptr : pos + 2;
+    }
+
+    void scpi_cmd::append(long long val) {
+        if (val < 0) {
+            this->append('-');
+            // Negate in unsigned arithmetic, -LLONG_MIN overflows
+            this->append(0ULL - (unsigned long long)val);
+        } else
+            this->append((unsigned long long)val);
+        return;
+    }
+
+    void scpi_cmd::append(unsigned long long val) {
+        char digits[20];
+        size_t pos = sizeof(digits);
+        do {
+            digits[--pos] = '0' + (val % 10);
+            val /= 10;
+        } while (val);
+        this->append_raw(digits + pos, sizeof(digits) - pos);
+        return;
+    }
+
+    void scpi_cmd::append(double val) {
+        // 15 significant digits represent every value set by the user
+        // exactly, more digits only add rounding noise
+        char num[32];
+        int n = snprintf(num, sizeof(num), "%.15g", val);
+        // Locale independent decimal point
+        for (int i = 0; i < n; i++) {
+            if (num[i] == ',')
+                num[i] = '.';
+        }
+        this->append_raw(num, n);
+        return;
+    }
+
+    void scpi_cmd::append(const char* str) {
+        this->append_raw(str, strlen(str));
+        return;
+    }
+
+    void scpi_cmd::append(const std::string& str) {
+        this->append_raw(str.data(), str.size());
+        return;
+    }
+
+    void scpi_cmd::append(char c) {
+        this->append_raw(&c, 1);
+        return;
+    }
+
+    void scpi_cmd::append_raw(const char* str, size_t len) {
+        if ( m_heap.empty() && (m_len + len <= s_max_len) ) {
+            memcpy(m_buf + m_len, str, len);
+            m_len += len;
+            return;
+        }
+        // Rare long command, move to the heap
+        if ( m_heap.empty() ) {
+            debug_print("SCPI command exceeds %zu bytes\n", s_max_len);
+            m_heap.assign(m_buf, m_len);
+        }
+        m_heap.append(str, len);
+        m_len += len;
+        return;
+    }
+
+    void scpi_cmd::fail(const char* reason) const {
+        fprintf(stderr, "%s: '%.*s'\n", reason, (int)m_len, this->data());
+        abort();
+    }
+
+}
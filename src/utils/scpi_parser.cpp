@@ -0,0 +1,375 @@
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/exceptions.hh>
+#include "ld_debug.hh"
+
+#include <limits>
+
+namespace labdev {
+
+    // Exactly representable powers of ten
+    static const double s_pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    static const int s_max_pow10 = 22;
+
+    static inline bool is_digit(char c) { return (c >= '0') && (c <= '9'); }
+
+    static inline char to_upper(char c) {
+        return ((c >= 'a') && (c <= 'z')) ? c - 'a' + 'A' : c;
+    }
+
+    static inline bool is_separator(char c) {
+        return (c == ',') || (c == ';') || (c == ' ') || (c == '\t') ||
+               (c == '\r') || (c == '\n');
+    }
+
+    // Case insensitive comparison of character data with upper case keyword
+    static bool equals(const char* str, size_t len, const char* keyword) {
+        size_t i = 0;
+        for (; (i < len) && keyword[i]; i++) {
+            if (to_upper(str[i]) != keyword[i])
+                return false;
+        }
+        return (i == len) && !keyword[i];
+    }
+
+    scpi_parser::scpi_parser(const char* data, size_t len):
+        m_pos(data),
+        m_end(data + len) {
+        return;
+    }
+
+    scpi_parser::scpi_parser(const std::string& resp):
+        scpi_parser(resp.data(), resp.size()) {
+        return;
+    }
+
+    bool scpi_parser::read_int(int64_t& val) {
+        const char* start = m_pos;
+        uint64_t mant = 0;
+        int exp10 = 0;
+        bool neg = false;
+
+        this->skip_ws();
+        if ( (m_pos < m_end) && (*m_pos == '#') ) {
+            if ( !this->read_non_decimal(mant) ||
+                 (mant > (uint64_t)std::numeric_limits<int64_t>::max()) ) {
+                m_pos = start;
+                return false;
+            }
+        } else {
+            if ( !this->read_decimal(mant, exp10, neg) ) {
+                m_pos = start;
+                return false;
+            }
+            // NR2/NR3 values are accepted if they are integral
+            for (; exp10 > 0; exp10--) {
+                if (mant > (uint64_t)std::numeric_limits<int64_t>::max() / 10) {
+                    m_pos = start;
+                    return false;
+                }
+                mant *= 10;
+            }
+            for (; exp10 < 0; exp10++) {
+                if (mant % 10 != 0) {
+                    m_pos = start;
+                    return false;
+                }
+                mant /= 10;
+            }
+            if (mant > (uint64_t)std::numeric_limits<int64_t>::max()) {
+                m_pos = start;
+                return false;
+            }
+        }
+
+        if ( !this->next_element() ) {
+            m_pos = start;
+            return false;
+        }
+        val = neg ? -(int64_t)mant : (int64_t)mant;
+        return true;
+    }
+
+    bool scpi_parser::read_double(double& val) {
+        const char* start = m_pos;
+        uint64_t mant = 0;
+        int exp10 = 0;
+        bool neg = false;
+
+        if ( !this->read_decimal(mant, exp10, neg) ) {
+            // Some instruments return infinity or NaN as character data
+            m_pos = start;
+            const char* str;
+            size_t len;
+            if ( !this->read_chars(str, len) )
+                return false;
+            if ( equals(str, len, "INF") || equals(str, len, "+INF") )
+                val = std::numeric_limits<double>::infinity();
+            else if ( equals(str, len, "NINF") || equals(str, len, "-INF") )
+                val = -std::numeric_limits<double>::infinity();
+            else if ( equals(str, len, "NAN") )
+                val = std::numeric_limits<double>::quiet_NaN();
+            else {
+                m_pos = start;
+                return false;
+            }
+            return true;
+        }
+        if ( !this->next_element() ) {
+            m_pos = start;
+            return false;
+        }
+
+        // Scale mantissa with exact powers of ten, extended precision keeps
+        // the rounding error of large exponents small
+        long double ret = mant;
+        if (ret != 0) {
+            while (exp10 > s_max_pow10) {
+                ret *= s_pow10[s_max_pow10];
+                exp10 -= s_max_pow10;
+            }
+            while (exp10 < -s_max_pow10) {
+                ret /= s_pow10[s_max_pow10];
+                exp10 += s_max_pow10;
+            }
+            if (exp10 >= 0)
+                ret *= s_pow10[exp10];
+            else
+                ret /= s_pow10[-exp10];
+        }
+        val = (double)(neg ? -ret : ret);
+        return true;
+    }
+
+    bool scpi_parser::read_bool(bool& val) {
+        const char* start = m_pos;
+        int64_t num;
+        if ( this->read_int(num) ) {
+            val = (num != 0);
+            return true;
+        }
+
+        const char* str;
+        size_t len;
+        if ( this->read_chars(str, len) ) {
+            if ( equals(str, len, "ON") ) {
+                val = true;
+                return true;
+            }
+            if ( equals(str, len, "OFF") ) {
+                val = false;
+                return true;
+            }
+        }
+        m_pos = start;
+        return false;
+    }
+
+    bool scpi_parser::read_chars(const char*& str, size_t& len) {
+        const char* start = m_pos;
+        this->skip_ws();
+        const char* chars = m_pos;
+        while ( (m_pos < m_end) && !is_separator(*m_pos) && (*m_pos != '"') &&
+                (*m_pos != '\'') )
+            m_pos++;
+        size_t nchars = m_pos - chars;
+        if ( (nchars == 0) || !this->next_element() ) {
+            m_pos = start;
+            return false;
+        }
+        str = chars;
+        len = nchars;
+        return true;
+    }
+
+    bool scpi_parser::read_string(const char*& str, size_t& len) {
+        const char* start = m_pos;
+        this->skip_ws();
+        if ( (m_pos >= m_end) || ((*m_pos != '"') && (*m_pos != '\'')) ) {
+            m_pos = start;
+            return false;
+        }
+
+        // Find closing quote, doubled quotes are part of the string
+        char quote = *m_pos++;
+        const char* content = m_pos;
+        while (m_pos < m_end) {
+            if (*m_pos == quote) {
+                if ( (m_pos + 1 < m_end) && (m_pos[1] == quote) ) {
+                    m_pos += 2;
+                    continue;
+                }
+                break;
+            }
+            m_pos++;
+        }
+        if (m_pos >= m_end) {
+            m_pos = start;
+            return false;
+        }
+        str = content;
+        len = m_pos - content;
+        m_pos++;
+
+        if ( !this->next_element() ) {
+            m_pos = start;
+            return false;
+        }
+        return true;
+    }
+
+    bool scpi_parser::skip() {
+        const char* str;
+        size_t len;
+        if ( this->read_string(str, len) )
+            return true;
+        this->skip_ws();
+        while ( (m_pos < m_end) && (*m_pos != ',') && (*m_pos != ';') )
+            m_pos++;
+        return this->next_element();
+    }
+
+    bool scpi_parser::at_end() {
+        this->skip_ws();
+        return (m_pos >= m_end);
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    void scpi_parser::skip_ws() {
+        while ( (m_pos < m_end) && ((*m_pos == ' ') || (*m_pos == '\t') ||
+                (*m_pos == '\r') || (*m_pos == '\n')) )
+            m_pos++;
+        return;
+    }
+
+    bool scpi_parser::next_element() {
+        this->skip_ws();
+        if (m_pos >= m_end)
+            return true;
+        if ( (*m_pos == ',') || (*m_pos == ';') ) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool scpi_parser::read_decimal(uint64_t& mant, int& exp10, bool& neg) {
+        this->skip_ws();
+        mant = 0;
+        exp10 = 0;
+        neg = false;
+        if ( (m_pos < m_end) && ((*m_pos == '+') || (*m_pos == '-')) )
+            neg = (*m_pos++ == '-');
+
+        // Up to 19 significant digits fit into the mantissa
+        int ndigits = 0, nsig = 0;
+        for (; (m_pos < m_end) && is_digit(*m_pos); m_pos++, ndigits++) {
+            if (nsig < 19) {
+                mant = 10 * mant + (*m_pos - '0');
+                if (mant) nsig++;
+            } else
+                exp10++;
+        }
+        if ( (m_pos < m_end) && (*m_pos == '.') ) {
+            for (m_pos++; (m_pos < m_end) && is_digit(*m_pos); m_pos++,
+                ndigits++) {
+                if (nsig < 19) {
+                    mant = 10 * mant + (*m_pos - '0');
+                    if (mant) nsig++;
+                    exp10--;
+                }
+            }
+        }
+        if (ndigits == 0)
+            return false;
+
+        // Exponent
+        if ( (m_pos < m_end) && ((*m_pos == 'E') || (*m_pos == 'e')) ) {
+            m_pos++;
+            bool exp_neg = false;
+            if ( (m_pos < m_end) && ((*m_pos == '+') || (*m_pos == '-')) )
+                exp_neg = (*m_pos++ == '-');
+            if ( (m_pos >= m_end) || !is_digit(*m_pos) )
+                return false;
+            int exp = 0;
+            for (; (m_pos < m_end) && is_digit(*m_pos); m_pos++) {
+                if (exp < 10000)
+                    exp = 10 * exp + (*m_pos - '0');
+            }
+            exp10 += exp_neg ? -exp : exp;
+        }
+        return true;
+    }
+
+    bool scpi_parser::read_non_decimal(uint64_t& val) {
+        // '#' followed by H (hex), Q (octal), or B (binary)
+        if ( (m_end - m_pos < 3) || (*m_pos != '#') )
+            return false;
+        unsigned base;
+        switch ( to_upper(m_pos[1]) ) {
+            case 'H': base = 16; break;
+            case 'Q': base = 8; break;
+            case 'B': base = 2; break;
+            default: return false;
+        }
+        m_pos += 2;
+
+        val = 0;
+        int ndigits = 0;
+        for (; m_pos < m_end; m_pos++, ndigits++) {
+            char c = to_upper(*m_pos);
+            unsigned digit;
+            if ( is_digit(c) )
+                digit = c - '0';
+            else if ( (c >= 'A') && (c <= 'F') )
+                digit = c - 'A' + 10;
+            else
+                break;
+            if ( (digit >= base) ||
+                 (val > (std::numeric_limits<uint64_t>::max() - digit) / base) )
+                return false;
+            val = base * val + digit;
+        }
+        return (ndigits > 0);
+    }
+
+    /*
+     *      Convenience functions
+     */
+
+    int parse_int(const std::string& resp) {
+        scpi_parser parser(resp);
+        int64_t val;
+        if ( !parser.read_int(val) ) {
+            debug_print("Invalid NR1 response '%s'\n", resp.c_str());
+            throw bad_protocol("Received invalid integer response");
+        }
+        return (int)val;
+    }
+
+    double parse_double(const std::string& resp) {
+        scpi_parser parser(resp);
+        double val;
+        if ( !parser.read_double(val) ) {
+            debug_print("Invalid NR3 response '%s'\n", resp.c_str());
+            throw bad_protocol("Received invalid numeric response");
+        }
+        return val;
+    }
+
+    bool parse_bool(const std::string& resp) {
+        scpi_parser parser(resp);
+        bool val;
+        if ( !parser.read_bool(val) ) {
+            debug_print("Invalid boolean response '%s'\n", resp.c_str());
+            throw bad_protocol("Received invalid boolean response");
+        }
+        return val;
+    }
+
+}
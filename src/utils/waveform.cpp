@@ -0,0 +1,127 @@
+#include <labdev/utils/waveform.hh>
+#include <labdev/utils/convert.hh>
+#include "ld_debug.hh"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace labdev {
+
+    static const char* s_type_names[] = {"int8", "uint8", "int16"};
+
+    // Conversion format of each sample type
+    static const Sample_format s_formats[] = {S8, U8, S16_HOST};
+
+    waveform::waveform():
+    m_type(INT8),
+    m_npts(0),
+    m_raw(),
+    m_xincr(0.), m_xorg(0.), m_xref(0.),
+    m_yinc(0.), m_yorg(0.), m_yref(0.) {
+        return;
+    }
+
+    waveform::waveform(Sample_type type, size_t npts) : waveform() {
+        this->resize(type, npts);
+        return;
+    }
+
+    void waveform::resize(Sample_type type, size_t npts) {
+        m_type = type;
+        m_npts = npts;
+        // Only grow, the buffer is reused for the next acquisition
+        if (m_raw.size() < this->raw_size())
+            m_raw.resize(this->raw_size());
+        return;
+    }
+
+    void waveform::clear() {
+        m_npts = 0;
+        return;
+    }
+
+    void waveform::set_horz_scale(double xincr, double xorg, double xref) {
+        m_xincr = xincr;
+        m_xorg = xorg;
+        m_xref = xref;
+        return;
+    }
+
+    void waveform::set_vert_scale(double yinc, double yorg, double yref) {
+        m_yinc = yinc;
+        m_yorg = yorg;
+        m_yref = yref;
+        return;
+    }
+
+    int waveform::code(size_t i) const {
+        switch (m_type) {
+        case INT8:  return ((const int8_t*)m_raw.data())[i];
+        case UINT8: return m_raw[i];
+        case INT16: return ((const int16_t*)m_raw.data())[i];
+        }
+        return 0;
+    }
+
+    void waveform::to_voltage(float* out, size_t first, size_t n) const {
+        // Offset is folded into one multiply-add per sample
+        double offset = m_yorg - m_yref * m_yinc;
+        convert_samples(m_raw.data() + first * this->sample_size(),
+            s_formats[m_type], out, n, m_yinc, offset);
+        return;
+    }
+
+    void waveform::to_voltage(double* out, size_t first, size_t n) const {
+        double offset = m_yorg - m_yref * m_yinc;
+        convert_samples(m_raw.data() + first * this->sample_size(),
+            s_formats[m_type], out, n, m_yinc, offset);
+        return;
+    }
+
+    void waveform::to_time(double* out, size_t first, size_t n) const {
+        for (size_t i = 0; i < n; i++)
+            out[i] = this->time(first + i);
+        return;
+    }
+
+    std::vector<double> waveform::voltages() const {
+        std::vector<double> ret(m_npts);
+        this->to_voltage(ret.data(), 0, m_npts);
+        return ret;
+    }
+
+    std::vector<float> waveform::voltages_float() const {
+        std::vector<float> ret(m_npts);
+        this->to_voltage(ret.data(), 0, m_npts);
+        return ret;
+    }
+
+    std::vector<double> waveform::times() const {
+        std::vector<double> ret(m_npts);
+        this->to_time(ret.data(), 0, m_npts);
+        return ret;
+    }
+
+    void waveform::to_vectors(std::vector<double>& horz_data,
+    std::vector<double>& vert_data) const {
+        horz_data.resize(m_npts);
+        vert_data.resize(m_npts);
+        this->to_time(horz_data.data(), 0, m_npts);
+        this->to_voltage(vert_data.data(), 0, m_npts);
+        return;
+    }
+
+    /*
+     *      P R I V A T E   M E T H O D S
+     */
+
+    void waveform::check_type(Sample_type type) const {
+        if (type != m_type) {
+            fprintf(stderr, "Waveform samples are of type %s, not %s\n",
+                s_type_names[m_type], s_type_names[type]);
+            abort();
+        }
+        return;
+    }
+
+}
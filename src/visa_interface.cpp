@@ -12,7 +12,10 @@ namespace labdev {
         m_instr(0),
         m_visa_id(),
         m_connected(false),
-        m_timeout(DFLT_TIMEOUT_MS) {
+        m_timeout(DFLT_TIMEOUT_MS),
+        m_end(false),
+        m_async_enabled(false),
+        m_completed_jobs() {
         ViStatus stat;
         if (s_interface_ctr == 0) {
             stat = viOpenDefaultRM(&s_default_rm);
@@ -62,10 +65,16 @@ namespace labdev {
         if (!m_instr)
             return;
         ViStatus stat;
+        if (m_async_enabled) {
+            viDisableEvent(m_instr, VI_EVENT_IO_COMPLETION, VI_QUEUE);
+            m_async_enabled = false;
+            m_completed_jobs.clear();
+        }
         debug_print("Closing instrument '%s'\n", m_visa_id.c_str());
         stat = viClose(m_instr);
         check_and_throw(stat, "Failed to close instrument '" + m_visa_id + "'");
 
+        m_instr = 0;
         m_connected = false;
         return;
     }
@@ -87,34 +96,35 @@ namespace labdev {
             ret.push_back(std::string(rname));
             debug_print("Found resource '%s'\n", rname);
         }
+        viClose(rlist);
         return ret;
     }
 
     int visa_interface::write_raw(const uint8_t* data, size_t len) {
         size_t bytes_left =len;
         size_t bytes_written = 0;
-        ssize_t nbytes = 0;
+        ViUInt32 nbytes = 0;
         ViStatus stat;
 
         while ( bytes_left > 0 ) {
-            stat = viWrite(m_instr, (ViBuf)&data[bytes_written], bytes_left, (ViUInt32*)&nbytes);
+            stat = viWrite(m_instr, (ViBuf)&data[bytes_written], bytes_left, &nbytes);
             check_and_throw(stat, "Failed to write to device");
             if (nbytes > 0) {
                 bytes_left -= nbytes;
 
-                debug_print("Written %zu bytes: ", nbytes);
+                debug_print("Written %u bytes: ", nbytes);
                 #ifdef LD_DEBUG
                 if (nbytes > 20) {
                     for (int i = 0; i < 10; i++)
                         printf("0x%02X ", data[bytes_written + i]);
                     printf("[...] ");
-                    for (int i = nbytes-10; i < nbytes; i++)
+                    for (int i = nbytes-10; i < (int)nbytes; i++)
                         printf("0x%02X ", data[bytes_written + i]);
                 } else {
-                    for (int i = 0; i < nbytes; i++)
+                    for (int i = 0; i < (int)nbytes; i++)
                         printf("0x%02X ", data[bytes_written + i]);
                 }
-                printf("(%zi bytes left)\n", bytes_left);
+                printf("(%zu bytes left)\n", bytes_left);
                 #endif
 
                 bytes_written += nbytes;
@@ -125,6 +135,16 @@ namespace labdev {
     }
 
     int visa_interface::read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms) {
+        io_result<size_t> ret = this->try_read_raw(data, max_len, timeout_ms);
+        // Data received before the timeout is returned, the next read times
+        // out if the device has nothing more to send
+        if ( !ret && (ret.value == 0) )
+            check_and_throw(VI_ERROR_TMO, "failed to read data from device");
+        return ret.value;
+    }
+
+    io_result<size_t> visa_interface::try_read_raw(uint8_t* data,
+    size_t max_len, unsigned timeout_ms) {
         ViStatus stat;
         if (timeout_ms != m_timeout) {
             stat = viSetAttribute(m_instr, VI_ATTR_TMO_VALUE, timeout_ms);
@@ -132,43 +152,110 @@ namespace labdev {
             m_timeout = timeout_ms;
         }
 
-        uint8_t rbuf[s_dflt_buf_size] = {0};
-        ssize_t nbytes;
-        ssize_t bytes_received = 0;
+        ViUInt32 nbytes = 0;
+        io_result<size_t> ret = {io_timeout, 0};
+        size_t& bytes_received = ret.value;
         stat = VI_SUCCESS_MAX_CNT;
+        m_end = false;
 
+        // Read directly into data until the message is complete or data is
+        // full; the rest of the message is returned by the next read
         debug_print("%s", "Reading from device\n");
-        while (stat == VI_SUCCESS_MAX_CNT) {
-            stat = viRead(m_instr, (ViBuf)rbuf, max_len, (ViUInt32*)&nbytes);
+        while ( (stat == VI_SUCCESS_MAX_CNT) && (bytes_received < max_len) ) {
+            stat = viRead(m_instr, (ViBuf)&data[bytes_received],
+                max_len - bytes_received, &nbytes);
+            // Timeouts are returned with the bytes received so far (the
+            // count is also valid if viRead() timed out)
+            if (stat == VI_ERROR_TMO) {
+                bytes_received += nbytes;
+                return ret;
+            }
             check_and_throw(stat, "failed to read data from device");
             if (nbytes > 0) {
-                // Check for buffer overflow
-                if (bytes_received + nbytes > s_dflt_buf_size)
-                    throw bad_protocol("Read buffer too small", s_dflt_buf_size);
-
-                debug_print("Read %zi bytes: ", nbytes);
+                uint8_t* rbuf = &data[bytes_received];
+                debug_print("Read %u bytes: ", nbytes);
                 #ifdef LD_DEBUG
                 if (nbytes > 20) {
                     for (int i = 0; i < 10; i++)
                         printf("0x%02X ", rbuf[i]);
                     printf("[...] ");
-                    for (int i = nbytes-10; i < nbytes; i++)
+                    for (int i = nbytes-10; i < (int)nbytes; i++)
                         printf("0x%02X ", rbuf[i]);
                 } else {
-                    for (int i = 0; i < nbytes; i++)
+                    for (int i = 0; i < (int)nbytes; i++)
                         printf("0x%02X ", rbuf[i]);
                 }
                 printf("\n");
                 #endif
 
-                // Append read buffer to output data array
-                for (ssize_t ibyte = 0; ibyte < nbytes; ibyte++)
-                    data[bytes_received + ibyte] = rbuf[ibyte];
-
                 bytes_received += nbytes;
             }
         }
-        return bytes_received;
+        // VI_SUCCESS means END, other completion codes (VI_SUCCESS_MAX_CNT,
+        // VI_SUCCESS_TERM_CHAR) leave the rest of the message to be read
+        m_end = (stat == VI_SUCCESS);
+        ret.status = io_ok;
+        return ret;
+    }
+
+    ViJobId visa_interface::write_async(const uint8_t* data, size_t len) {
+        this->enable_async();
+        ViJobId job;
+        ViStatus stat = viWriteAsync(m_instr, (ViBuf)data, len, &job);
+        check_and_throw(stat, "Failed to start asynchronous write");
+        debug_print("Started asynchronous write of %zu bytes (job %lu)\n", len,
+            (unsigned long)job);
+        return job;
+    }
+
+    ViJobId visa_interface::read_async(uint8_t* data, size_t max_len) {
+        this->enable_async();
+        ViJobId job;
+        ViStatus stat = viReadAsync(m_instr, (ViBuf)data, max_len, &job);
+        check_and_throw(stat, "Failed to start asynchronous read");
+        debug_print("Started asynchronous read of %zu bytes (job %lu)\n",
+            max_len, (unsigned long)job);
+        return job;
+    }
+
+    size_t visa_interface::wait_async(ViJobId job, unsigned timeout_ms) {
+        // Job might have completed while waiting for another one
+        auto it = m_completed_jobs.find(job);
+        while ( it == m_completed_jobs.end() ) {
+            ViEventType etype;
+            ViEvent event;
+            ViStatus stat = viWaitOnEvent(m_instr, VI_EVENT_IO_COMPLETION,
+                timeout_ms, &etype, &event);
+            check_and_throw(stat, "Asynchronous I/O did not complete");
+
+            ViJobId event_job;
+            ViStatus job_stat;
+            ViUInt32 count = 0;
+            viGetAttribute(event, VI_ATTR_JOB_ID, &event_job);
+            viGetAttribute(event, VI_ATTR_STATUS, &job_stat);
+            viGetAttribute(event, VI_ATTR_RET_COUNT, &count);
+            viClose(event);
+            debug_print("Job %lu completed (%u bytes)\n",
+                (unsigned long)event_job, count);
+
+            it = m_completed_jobs.insert(std::make_pair(event_job,
+                std::make_pair(job_stat, count))).first;
+            if (event_job != job)
+                it = m_completed_jobs.find(job);
+        }
+
+        ViStatus job_stat = it->second.first;
+        size_t count = it->second.second;
+        m_completed_jobs.erase(it);
+        check_and_throw(job_stat, "Asynchronous I/O failed");
+        return count;
+    }
+
+    void visa_interface::cancel_async(ViJobId job) {
+        ViStatus stat = viTerminate(m_instr, VI_NULL, job);
+        check_and_throw(stat, "Failed to abort asynchronous I/O");
+        debug_print("Aborted job %lu\n", (unsigned long)job);
+        return;
     }
 
     void visa_interface::flush_buffer(uint16_t flag) {
@@ -201,6 +288,16 @@ namespace labdev {
         return;
     }
 
+    void visa_interface::enable_async() {
+        if (m_async_enabled)
+            return;
+        ViStatus stat = viEnableEvent(m_instr, VI_EVENT_IO_COMPLETION, VI_QUEUE,
+            VI_NULL);
+        check_and_throw(stat, "Failed to enable I/O completion events");
+        m_async_enabled = true;
+        return;
+    }
+
     void visa_interface::check_and_throw(ViStatus status, const std::string &msg)
         const {
         if (status < VI_SUCCESS) {
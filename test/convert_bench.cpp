@@ -0,0 +1,99 @@
+#include <labdev/utils/convert.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <random>
+#include <chrono>
+
+/*
+ *      Throughput of convert_samples() in samples per second for every
+ *      instruction set supported by the CPU, each sample format and float
+ *      and double output; results are compared to the scalar kernel.
+ *
+ *      Usage: convert_bench [samples per call]
+ *      The default of 64k samples stays in the cache, large values (e.g.
+ *      16M) show the memory bound throughput.
+ */
+
+using namespace labdev;
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+static const Sample_format s_formats[] = { S8, U8, S16_LE, S16_BE };
+static const char* s_format_names[] = { "S8", "U8", "S16_LE", "S16_BE" };
+static const double s_scale = 0.01, s_offset = -1.5;
+
+// Runs the conversion for at least 0.2 s, returns samples per second
+template <typename T>
+static double run(const vector<uint8_t>& in, Sample_format fmt,
+vector<T>& out) {
+    size_t n = out.size();
+    unsigned ncalls = 0;
+    double sec = 0.;
+    bench_clock::time_point tsta = bench_clock::now();
+    do {
+        convert_samples(in.data(), fmt, out.data(), n, (T)s_scale,
+            (T)s_offset);
+        ncalls++;
+        sec = chrono::duration<double>(bench_clock::now() - tsta).count();
+    } while (sec < 0.2);
+    return ncalls * n / sec;
+}
+
+template <typename T>
+static void bench(const char* type, const vector<uint8_t>& in, size_t n,
+Simd_level max_level) {
+    vector<T> out(n), ref(n);
+    for (size_t f = 0; f < 4; f++) {
+        Sample_format fmt = s_formats[f];
+        set_simd_level(SIMD_SCALAR);
+        convert_samples(in.data(), fmt, ref.data(), n, (T)s_scale,
+            (T)s_offset);
+
+        printf("  %-6s %-7s", s_format_names[f], type);
+        for (unsigned lvl = SIMD_SCALAR; lvl <= max_level; lvl++) {
+            set_simd_level((Simd_level)lvl);
+            double rate = run(in, fmt, out);
+            // Kernels may differ in the last bit of code * scale (fused
+            // multiply-add), i.e. relative to the terms, not the result
+            T tol = 2 * numeric_limits<T>::epsilon();
+            size_t nbad = 0;
+            for (size_t i = 0; i < n; i++)
+                if ( fabs(out[i] - ref[i]) > tol * (fabs(ref[i]) +
+                     fabs(s_offset)) )
+                    nbad++;
+            printf(" %10.1f", rate / 1e6);
+            if (nbad)
+                printf(" (%zu differ)", nbad);
+        }
+        printf("\n");
+    }
+    return;
+}
+
+int main(int argc, char** argv) {
+    size_t n = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 64 * 1024;
+
+    // Random codes, two bytes per sample cover all formats
+    mt19937 rng(1);
+    vector<uint8_t> in(2 * n);
+    for (auto& b : in)
+        b = rng() & 0xFF;
+
+    Simd_level max_level = detect_simd_level();
+    printf("Msamples/s, %zu samples per call:\n", n);
+    printf("  %-14s", "");
+    for (unsigned lvl = SIMD_SCALAR; lvl <= max_level; lvl++)
+        printf(" %10s", simd_level_name((Simd_level)lvl));
+    printf("\n");
+
+    bench<float>("float", in, n, max_level);
+    bench<double>("double", in, n, max_level);
+
+    set_simd_level(max_level);
+    return 0;
+}
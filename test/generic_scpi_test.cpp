@@ -0,0 +1,146 @@
+#include <labdev/devices/generic_scpi_device.hh>
+#include <labdev/utils/scpi_cmd.hh>
+#include <labdev/exceptions.hh>
+#include "test_util.hh"
+
+#include <cstring>
+#include <deque>
+#include <string>
+
+/*
+ *      Tests generic_scpi_device with the example description in
+ *      test/generic_scpi against a stand-in transport which records the
+ *      written commands and returns queued responses: parameter
+ *      information, formatted set commands and queries, the settings cache,
+ *      and string parameters longer than the stack buffer of scpi_cmd.
+ */
+
+using namespace labdev;
+using namespace std;
+
+// Transport recording all writes, reads return the queued responses
+class stub_interface : public interface {
+public:
+    string written;
+    deque<string> responses;
+
+    int write_raw(const uint8_t* data, size_t len) override {
+        written.append((const char*)data, len);
+        return len;
+    }
+
+    int read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms) override {
+        if ( responses.empty() )
+            throw timeout("No response queued");
+        string& resp = responses.front();
+        size_t len = min(max_len, resp.size());
+        memcpy(data, resp.data(), len);
+        resp.erase(0, len);
+        if ( resp.empty() )
+            responses.pop_front();
+        return len;
+    }
+
+    Interface_type type() const override { return none; }
+    bool connected() const override { return true; }
+    void close() override {}
+};
+
+static string s_desc_path;
+
+static void test_load() {
+    stub_interface comm;
+    generic_scpi_device dev(&comm, s_desc_path);
+    CHECK( dev.get_n_params() == 6 );
+    CHECK( dev.get_n_channels() == 2 );
+    CHECK( dev.has_param("voltage") && !dev.has_param("power") );
+    size_t volt = dev.get_param("voltage");
+    CHECK( dev.get_name(volt) == "voltage" );
+    CHECK( dev.get_type(volt) == generic_scpi_device::PARAM_DOUBLE );
+    CHECK( dev.get_unit(volt) == "V" );
+    CHECK( dev.get_type(dev.get_param("mode")) ==
+        generic_scpi_device::PARAM_ENUM );
+    CHECK( dev.get_unit(dev.get_param("output")).empty() );
+    // Loading does not talk to the device
+    CHECK( comm.written.empty() );
+    return;
+}
+
+static void test_commands() {
+    stub_interface comm;
+    generic_scpi_device dev(&comm, s_desc_path);
+
+    dev.set_double("voltage", 12.5, 1);
+    dev.set_double("current", 0.1, 2);
+    dev.set_bool("output", true, 2);
+    dev.set_int("ovp_level", 15, 1);
+    dev.set_enum("mode", "REM");
+    CHECK( comm.written == "SOUR1:VOLT 12.5\nSOUR2:CURR 0.1\nOUTP2 1\n"
+        "SOUR1:VOLT:PROT:LEV 15\nSYST:MODE REM\n" );
+
+    // Settings already written are skipped
+    comm.written.clear();
+    dev.set_double("voltage", 12.5, 1);
+    CHECK( comm.written.empty() );
+    dev.set_double("voltage", 12.5, 2);
+    CHECK( comm.written == "SOUR2:VOLT 12.5\n" );
+
+    // Queries are sent once, then answered from the cache
+    comm.written.clear();
+    comm.responses.push_back("1.25E+01\n");
+    comm.responses.push_back("RWL\n");
+    comm.responses.push_back("0\n");
+    CHECK( dev.get_double("voltage", 1) == 12.5 );
+    CHECK( dev.get_double("voltage", 1) == 12.5 );
+    CHECK( dev.get_enum("mode") == "RWL" );
+    CHECK( !dev.get_bool("output", 1) );
+    CHECK( comm.written == "SOUR1:VOLT?\nSYST:MODE?\nOUTP1?\n" );
+    CHECK( comm.responses.empty() );
+    return;
+}
+
+static void test_strings() {
+    stub_interface comm;
+    generic_scpi_device dev(&comm, s_desc_path);
+
+    // Quotes inside the string are doubled
+    dev.set_string("display", "say \"hi\"");
+    CHECK( comm.written == "DISP:TEXT \"say \"\"hi\"\"\"\n" );
+    comm.responses.push_back("\"say \"\"hi\"\"\"\n");
+    CHECK( dev.get_string("display") == "say \"hi\"" );
+
+    // Strings longer than the stack buffer of scpi_cmd are written
+    // completely (the buffer would have aborted before)
+    string text(3 * scpi_cmd::s_max_len, 'x');
+    for (size_t i = 0; i < text.size(); i++)
+        text[i] = 'a' + i % 26;
+    comm.written.clear();
+    dev.set_string("display", text);
+    CHECK( comm.written == "DISP:TEXT \"" + text + "\"\n" );
+    comm.written.clear();
+    dev.set_string("display", text);
+    CHECK( comm.written.empty() );
+
+    // The same holds for all commands formatted by scpi_cmd
+    scpi_cmd cmd = SCPI_CMD("{} {},{}\n", text, -42, 1.5);
+    CHECK( cmd.str() == text + " -42,1.5\n" );
+    CHECK( strlen(cmd.c_str()) == cmd.size() );
+    scpi_cmd copy = cmd;
+    CHECK( copy.str() == cmd.str() );
+    scpi_cmd limit = SCPI_CMD("{}", text.substr(0, scpi_cmd::s_max_len));
+    CHECK( limit.str() == text.substr(0, scpi_cmd::s_max_len) );
+    return;
+}
+
+int main(int argc, char** argv) {
+    // The description is found next to the test program
+    string prog(argv[0]);
+    s_desc_path = prog.substr(0, prog.rfind('/') + 1) +
+        "generic_scpi/power_supply.desc";
+
+    test_load();
+    test_commands();
+    test_strings();
+
+    return test_result();
+}
@@ -0,0 +1,518 @@
+#include "libusb_stub.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <unistd.h>     // usleep()
+
+// Opaque libusb types
+struct libusb_context { int id; };
+struct libusb_device { int id; };
+struct libusb_device_handle { int id; };
+
+namespace libusb_stub {
+
+    const uint16_t s_vid = 0x1234;
+    const uint16_t s_pid = 0x5678;
+    const char* s_idn = "LABDEV,LIBUSB-STUB,0,1.0\n";
+    static const char* s_serial = "STUB0001";
+
+    // USBTMC message IDs, requests and status values
+    enum : uint8_t {
+        DEV_DEP_MSG_OUT = 0x01, REQUEST_DEV_DEP_MSG_IN = 0x02,
+        TRIGGER = 0x80
+    };
+    enum : uint8_t {
+        INITIATE_ABORT_BULK_OUT = 0x01, CHECK_ABORT_BULK_OUT_STATUS = 0x02,
+        INITIATE_ABORT_BULK_IN = 0x03, CHECK_ABORT_BULK_IN_STATUS = 0x04,
+        INITIATE_CLEAR = 0x05, CHECK_CLEAR_STATUS = 0x06,
+        GET_CAPABILITIES = 0x07, INDICATOR_PULSE = 0x40,
+        READ_STATUS_BYTE = 0x80, REN_CONTROL = 0xA0, GO_TO_LOCAL = 0xA1,
+        LOCAL_LOCKOUT = 0xA2
+    };
+    enum : uint8_t { STATUS_SUCCESS = 0x01, STATUS_FAILED = 0x80 };
+    static const size_t s_header_len = 12;
+    // Status byte bits
+    static const uint8_t s_esb = 0x20, s_rqs = 0x40;
+
+    struct notification {
+        uint8_t data[2];
+        unsigned delay_ms;
+    };
+
+    static libusb_context s_ctx;
+    static libusb_device s_dev;
+    static libusb_device_handle s_handle;
+    static libusb_device* s_dev_list[] = { &s_dev, nullptr };
+    static libusb_endpoint_descriptor s_eps[3];
+    static libusb_interface_descriptor s_alt;
+    static libusb_interface s_itf;
+    static libusb_config_descriptor s_cfg;
+
+    static bool s_open = false;
+    static uint16_t s_pkt_size = 64;
+    static Fault s_fault = NO_FAULT;
+    static uint8_t s_stb = 0;
+    static std::string s_written, s_cmd;
+    // Bulk-OUT data of the current USBTMC message
+    static std::vector<uint8_t> s_out_msg;
+    // Response data and pending REQUEST_DEV_DEP_MSG_IN (bTag, TransferSize)
+    static std::string s_output;
+    static bool s_stall = false;
+    static bool s_request_pending = false;
+    static uint8_t s_request_tag = 0;
+    static uint32_t s_request_size = 0;
+    // Bulk-IN packets ready to be sent, empty packets are zero-length packets
+    static std::deque<std::vector<uint8_t>> s_in_pkts;
+    static std::deque<notification> s_notifications;
+    static unsigned s_bulk_in_calls = 0, s_interrupt_calls = 0;
+    static unsigned s_interrupt_timeout = 0;
+    static std::map<uint8_t, unsigned> s_control_calls;
+
+    static void execute(const std::string& cmd) {
+        size_t len = strtoul(cmd.c_str() + cmd.find(' ') + 1, nullptr, 10);
+        if (cmd == "*IDN?")
+            s_output += s_idn;
+        else if (cmd.compare(0, 6, "DATA? ") == 0)
+            s_output += data_pattern(len) + "\n";
+        else if ( (cmd.compare(0, 7, "BLOCK? ") == 0) ||
+                  (cmd.compare(0, 9, "BLOCKNT? ") == 0) ) {
+            std::string digits = std::to_string(len);
+            s_output += "#" + std::to_string(digits.size()) + digits +
+                data_pattern(len);
+            if (cmd[5] == '?')
+                s_output += "\n";
+        } else if (cmd.compare(0, 7, "STALL? ") == 0) {
+            s_output += data_pattern(len);
+            s_stall = true;
+        } else if (cmd == "*OPC") {
+            s_stb |= s_esb | s_rqs;
+            add_notification(0x81, s_stb);
+        }
+        return;
+    }
+
+    static void dev_dep_msg_out(const uint8_t* data, size_t len, bool eom) {
+        s_written.append((const char*)data, len);
+        s_cmd.append((const char*)data, len);
+        if (!eom)
+            return;
+        size_t pos = 0, end;
+        while ( (end = s_cmd.find('\n', pos)) != std::string::npos ) {
+            execute(s_cmd.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        s_cmd.erase(0, pos);
+        return;
+    }
+
+    // Processes a complete Bulk-OUT message (header, payload, alignment)
+    static void bulk_out_msg(const std::vector<uint8_t>& msg) {
+        uint32_t size = msg[4] | (msg[5] << 8) | (msg[6] << 16) |
+            ((uint32_t)msg[7] << 24);
+        switch (msg[0]) {
+        case DEV_DEP_MSG_OUT:
+            dev_dep_msg_out(&msg[s_header_len], size, msg[8] & 0x01);
+            break;
+        case REQUEST_DEV_DEP_MSG_IN:
+            s_request_pending = true;
+            s_request_tag = msg[1];
+            s_request_size = size;
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
+    // Splits the response to a pending request into packets; a transfer
+    // ending on a packet boundary is terminated by a zero-length packet
+    static void queue_transfer() {
+        if ( !s_request_pending || s_output.empty() )
+            return;
+        uint32_t size = std::min<size_t>(s_output.size(), s_request_size);
+        if (s_fault == IGNORE_MAX_SIZE)
+            size = s_output.size();
+        bool eom = (size == s_output.size());
+
+        std::vector<uint8_t> xfer(s_header_len, 0x00);
+        uint32_t hdr_size = (s_fault == CORRUPT_SIZE) ? 0xFFFFFFF0 : size;
+        xfer[0] = REQUEST_DEV_DEP_MSG_IN;
+        xfer[1] = s_request_tag;
+        xfer[2] = ~s_request_tag;
+        for (int i = 0; i < 4; i++)
+            xfer[4 + i] = 0xFF & (hdr_size >> 8*i);
+        xfer[8] = eom ? 0x01 : 0x00;
+        xfer.insert(xfer.end(), s_output.begin(), s_output.begin() + size);
+        while (xfer.size() % 4)
+            xfer.push_back(0x00);
+        s_output.erase(0, size);
+        s_request_pending = false;
+
+        for (size_t pos = 0; pos < xfer.size(); pos += s_pkt_size) {
+            size_t end = std::min<size_t>(pos + s_pkt_size, xfer.size());
+            s_in_pkts.push_back(std::vector<uint8_t>(xfer.begin() + pos,
+                xfer.begin() + end));
+        }
+        if (xfer.size() % s_pkt_size == 0)
+            s_in_pkts.push_back(std::vector<uint8_t>());
+
+        // A stalled instrument stops after three packets
+        if (s_stall) {
+            s_in_pkts.resize(std::min<size_t>(s_in_pkts.size(), 3));
+            s_output.clear();
+            s_stall = false;
+        }
+        return;
+    }
+
+    static bool abort_bulk_in() {
+        bool active = s_request_pending || !s_in_pkts.empty() ||
+            !s_output.empty();
+        s_request_pending = false;
+        s_in_pkts.clear();
+        s_output.clear();
+        return active;
+    }
+
+    static int control_in(uint8_t request, uint16_t value, uint8_t* data,
+    uint16_t len) {
+        uint8_t resp[0x18] = {0};
+        size_t resp_len = 1;
+        resp[0] = STATUS_SUCCESS;
+        switch (request) {
+        case GET_CAPABILITIES:
+            resp[2] = 0x00; resp[3] = 0x01;     // bcdUSBTMC 1.00
+            resp[4] = 0x04;                     // INDICATOR_PULSE
+            resp[5] = 0x01;                     // TermChar
+            resp[12] = 0x00; resp[13] = 0x01;   // bcdUSB488 1.00
+            resp[14] = 0x07;                    // 488.2, REN/GTL/LLO, TRG
+            resp[15] = 0x0F;                    // SCPI, SR1, RL1, DT1
+            resp_len = sizeof(resp);
+            break;
+        case INITIATE_ABORT_BULK_IN:
+            resp[0] = abort_bulk_in() ? STATUS_SUCCESS : STATUS_FAILED;
+            resp[1] = value & 0xFF;
+            resp_len = 2;
+            break;
+        case INITIATE_ABORT_BULK_OUT:
+            resp[0] = STATUS_FAILED;
+            resp_len = 2;
+            break;
+        case CHECK_ABORT_BULK_IN_STATUS:
+        case CHECK_ABORT_BULK_OUT_STATUS:
+            resp_len = 8;
+            break;
+        case INITIATE_CLEAR:
+            abort_bulk_in();
+            s_out_msg.clear();
+            s_cmd.clear();
+            break;
+        case CHECK_CLEAR_STATUS:
+            resp_len = 2;
+            break;
+        case READ_STATUS_BYTE:
+            // Answered on the interrupt endpoint, reading clears RQS
+            resp[1] = value & 0xFF;
+            resp_len = 3;
+            add_notification(0x80 | (value & 0x7F), s_stb);
+            s_stb &= ~s_rqs;
+            break;
+        case INDICATOR_PULSE:
+        case REN_CONTROL:
+        case GO_TO_LOCAL:
+        case LOCAL_LOCKOUT:
+            break;
+        default:
+            return LIBUSB_ERROR_PIPE;
+        }
+        resp_len = std::min<size_t>(resp_len, len);
+        memcpy(data, resp, resp_len);
+        return resp_len;
+    }
+
+    static int bulk_out(const uint8_t* data, int len, int* transferred) {
+        s_out_msg.insert(s_out_msg.end(), data, data + len);
+        *transferred = len;
+        // Process all complete messages
+        while (s_out_msg.size() >= s_header_len) {
+            uint32_t size = s_out_msg[4] | (s_out_msg[5] << 8) |
+                (s_out_msg[6] << 16) | ((uint32_t)s_out_msg[7] << 24);
+            size_t msg_len = s_header_len;
+            if (s_out_msg[0] == DEV_DEP_MSG_OUT)
+                msg_len += (size + 3) / 4 * 4;
+            if (s_out_msg.size() < msg_len)
+                break;
+            std::vector<uint8_t> msg(s_out_msg.begin(),
+                s_out_msg.begin() + msg_len);
+            s_out_msg.erase(s_out_msg.begin(), s_out_msg.begin() + msg_len);
+            bulk_out_msg(msg);
+        }
+        return LIBUSB_SUCCESS;
+    }
+
+    // Returns packets until a short packet or len bytes; times out with the
+    // bytes received so far if the instrument has nothing more to send
+    static int bulk_in(uint8_t* data, int len, int* transferred) {
+        s_bulk_in_calls++;
+        *transferred = 0;
+        if ( s_in_pkts.empty() )
+            queue_transfer();
+        while ( !s_in_pkts.empty() ) {
+            std::vector<uint8_t>& pkt = s_in_pkts.front();
+            if (*transferred + (int)pkt.size() > len)
+                return (*transferred == 0) ? LIBUSB_ERROR_OVERFLOW :
+                    LIBUSB_SUCCESS;
+            if ( !pkt.empty() )
+                memcpy(data + *transferred, pkt.data(), pkt.size());
+            *transferred += pkt.size();
+            bool short_pkt = (pkt.size() < s_pkt_size);
+            s_in_pkts.pop_front();
+            if ( short_pkt || (*transferred == len) )
+                return LIBUSB_SUCCESS;
+        }
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+
+    static int interrupt_in(uint8_t* data, int len, int* transferred,
+    unsigned timeout) {
+        s_interrupt_calls++;
+        s_interrupt_timeout = timeout;
+        *transferred = 0;
+        if ( s_notifications.empty() ) {
+            usleep(1000 * timeout);
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        notification& ntf = s_notifications.front();
+        if (ntf.delay_ms > timeout) {
+            usleep(1000 * timeout);
+            ntf.delay_ms -= timeout;
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        usleep(1000 * ntf.delay_ms);
+        *transferred = std::min(len, 2);
+        memcpy(data, ntf.data, *transferred);
+        s_notifications.pop_front();
+        return LIBUSB_SUCCESS;
+    }
+
+    void reset() {
+        s_open = false;
+        s_pkt_size = 64;
+        s_fault = NO_FAULT;
+        s_stb = 0;
+        s_written.clear();
+        s_cmd.clear();
+        s_out_msg.clear();
+        s_output.clear();
+        s_stall = false;
+        s_request_pending = false;
+        s_in_pkts.clear();
+        s_notifications.clear();
+        s_bulk_in_calls = 0;
+        s_interrupt_calls = 0;
+        s_interrupt_timeout = 0;
+        s_control_calls.clear();
+        return;
+    }
+
+    void set_packet_size(uint16_t len) { s_pkt_size = len; }
+    void set_fault(Fault fault) { s_fault = fault; }
+
+    void add_notification(uint8_t notify1, uint8_t notify2,
+    unsigned delay_ms) {
+        s_notifications.push_back({{notify1, notify2}, delay_ms});
+        return;
+    }
+
+    std::string data_pattern(size_t len) {
+        std::string ret(len, '\0');
+        for (size_t i = 0; i < len; i++)
+            ret[i] = 'A' + (i % 26);
+        return ret;
+    }
+
+    const std::string& written() { return s_written; }
+    unsigned bulk_in_calls() { return s_bulk_in_calls; }
+    unsigned interrupt_calls() { return s_interrupt_calls; }
+    unsigned control_calls(uint8_t request) { return s_control_calls[request]; }
+    unsigned interrupt_timeout() { return s_interrupt_timeout; }
+    bool is_open() { return s_open; }
+
+}
+
+using namespace libusb_stub;
+
+extern "C" {
+
+int LIBUSB_CALL libusb_init(libusb_context** ctx) {
+    *ctx = &s_ctx;
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_exit(libusb_context* ctx) {
+    return;
+}
+
+ssize_t LIBUSB_CALL libusb_get_device_list(libusb_context* ctx,
+libusb_device*** list) {
+    *list = s_dev_list;
+    return 1;
+}
+
+void LIBUSB_CALL libusb_free_device_list(libusb_device** list,
+int unref_devices) {
+    return;
+}
+
+int LIBUSB_CALL libusb_get_device_descriptor(libusb_device* dev,
+struct libusb_device_descriptor* desc) {
+    memset(desc, 0, sizeof(*desc));
+    desc->idVendor = s_vid;
+    desc->idProduct = s_pid;
+    desc->iSerialNumber = 3;
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_open(libusb_device* dev,
+libusb_device_handle** handle) {
+    *handle = &s_handle;
+    s_open = true;
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_close(libusb_device_handle* handle) {
+    s_open = false;
+    return;
+}
+
+int LIBUSB_CALL libusb_get_string_descriptor_ascii(libusb_device_handle* dev,
+uint8_t desc_index, unsigned char* data, int length) {
+    int len = std::min<int>(strlen(s_serial), length - 1);
+    memcpy(data, s_serial, len);
+    data[len] = '\0';
+    return len;
+}
+
+uint8_t LIBUSB_CALL libusb_get_bus_number(libusb_device* dev) {
+    return 1;
+}
+
+uint8_t LIBUSB_CALL libusb_get_port_number(libusb_device* dev) {
+    return 1;
+}
+
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle* dev,
+int interface_number) {
+    return (interface_number == 0) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int LIBUSB_CALL libusb_release_interface(libusb_device_handle* dev,
+int interface_number) {
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_kernel_driver_active(libusb_device_handle* dev,
+int interface_number) {
+    return 0;
+}
+
+int LIBUSB_CALL libusb_detach_kernel_driver(libusb_device_handle* dev,
+int interface_number) {
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_set_interface_alt_setting(libusb_device_handle* dev,
+int interface_number, int alternate_setting) {
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_get_config_descriptor(libusb_device* dev,
+uint8_t config_index, struct libusb_config_descriptor** config) {
+    // Bulk-IN, Bulk-OUT and Interrupt-IN endpoint of a USB488 interface
+    const uint8_t addr[3] = {(uint8_t)(LIBUSB_ENDPOINT_IN | s_ep_bulk_in),
+        s_ep_bulk_out, (uint8_t)(LIBUSB_ENDPOINT_IN | s_ep_int_in)};
+    for (int i = 0; i < 3; i++) {
+        memset(&s_eps[i], 0, sizeof(s_eps[i]));
+        s_eps[i].bEndpointAddress = addr[i];
+        s_eps[i].bmAttributes = (i < 2) ? LIBUSB_TRANSFER_TYPE_BULK :
+            LIBUSB_TRANSFER_TYPE_INTERRUPT;
+        s_eps[i].wMaxPacketSize = (i < 2) ? s_pkt_size : 8;
+    }
+    memset(&s_alt, 0, sizeof(s_alt));
+    s_alt.bInterfaceClass = LIBUSB_CLASS_APPLICATION;
+    s_alt.bInterfaceSubClass = 0x03;
+    s_alt.bInterfaceProtocol = 0x01;
+    s_alt.bNumEndpoints = 3;
+    s_alt.endpoint = s_eps;
+    memset(&s_itf, 0, sizeof(s_itf));
+    s_itf.altsetting = &s_alt;
+    s_itf.num_altsetting = 1;
+    memset(&s_cfg, 0, sizeof(s_cfg));
+    s_cfg.bNumInterfaces = 1;
+    s_cfg.interface = &s_itf;
+    *config = &s_cfg;
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_free_config_descriptor(
+struct libusb_config_descriptor* config) {
+    return;
+}
+
+const char* LIBUSB_CALL libusb_error_name(int errcode) {
+    return (errcode == LIBUSB_ERROR_TIMEOUT) ? "LIBUSB_ERROR_TIMEOUT" :
+        "LIBUSB_ERROR";
+}
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle* dev,
+uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+unsigned char* data, uint16_t wLength, unsigned int timeout) {
+    s_control_calls[bRequest]++;
+    if ( !(request_type & LIBUSB_ENDPOINT_IN) )
+        return wLength;
+    return control_in(bRequest, wValue, data, wLength);
+}
+
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle* dev,
+unsigned char endpoint, unsigned char* data, int length, int* transferred,
+unsigned int timeout) {
+    if (endpoint == (LIBUSB_ENDPOINT_IN | s_ep_bulk_in))
+        return bulk_in(data, length, transferred);
+    if (endpoint == s_ep_bulk_out)
+        return bulk_out(data, length, transferred);
+    *transferred = 0;
+    return LIBUSB_ERROR_PIPE;
+}
+
+int LIBUSB_CALL libusb_interrupt_transfer(libusb_device_handle* dev,
+unsigned char endpoint, unsigned char* data, int length, int* transferred,
+unsigned int timeout) {
+    if (endpoint == (LIBUSB_ENDPOINT_IN | s_ep_int_in))
+        return interrupt_in(data, length, transferred, timeout);
+    *transferred = 0;
+    return LIBUSB_ERROR_PIPE;
+}
+
+int LIBUSB_CALL libusb_clear_halt(libusb_device_handle* dev,
+unsigned char endpoint) {
+    return LIBUSB_SUCCESS;
+}
+
+unsigned char* LIBUSB_CALL libusb_dev_mem_alloc(libusb_device_handle* dev,
+size_t length) {
+    return (unsigned char*)malloc(length);
+}
+
+int LIBUSB_CALL libusb_dev_mem_free(libusb_device_handle* dev,
+unsigned char* buffer, size_t length) {
+    free(buffer);
+    return LIBUSB_SUCCESS;
+}
+
+}
@@ -0,0 +1,75 @@
+#ifndef LD_LIBUSB_STUB_HH
+#define LD_LIBUSB_STUB_HH
+
+#include <libusb.h>
+
+#include <string>
+#include <cstdint>
+
+/*
+ *      Stand-in for libusb with a single USBTMC-USB488 instrument (s_vid,
+ *      s_pid) for testing usb_interface, usbtmc_interface and
+ *      usb488_interface without hardware. The test program is linked
+ *      against the stand-in instead of libusb. Bulk transfers are simulated
+ *      packet by packet (short packets, zero-length packets, partial data on
+ *      timeouts). Bulk transfers do not block, timeouts are returned
+ *      immediately; interrupt-IN notifications can be delayed.
+ *
+ *      Commands (one per line):
+ *          *IDN?           identification (s_idn)
+ *          DATA? <n>       n bytes of data_pattern() followed by '\n'
+ *          BLOCK? <n>      definite length block of n bytes followed by '\n'
+ *          BLOCKNT? <n>    same without terminator
+ *          STALL? <n>      announces n bytes but stops sending after three
+ *                          packets (the host times out with partial data)
+ *          *OPC            raises a service request (RQS and ESB)
+ *      Everything else is only recorded.
+ */
+
+namespace libusb_stub {
+
+    extern const uint16_t s_vid, s_pid;
+    extern const char* s_idn;
+
+    // Endpoint numbers of the USBTMC interface (without direction bit)
+    static constexpr uint8_t s_ep_bulk_in = 0x02;
+    static constexpr uint8_t s_ep_bulk_out = 0x03;
+    static constexpr uint8_t s_ep_int_in = 0x01;
+
+    // Misbehaviour of the instrument in DEV_DEP_MSG_IN transfers
+    enum Fault {
+        NO_FAULT,
+        IGNORE_MAX_SIZE,    // sends the whole response regardless of the
+                            // requested TransferSize
+        CORRUPT_SIZE        // announces a TransferSize of almost 4GiB
+    };
+
+    // Restores the initial state (closed, no responses, 64 byte packets)
+    void reset();
+
+    // wMaxPacketSize of the bulk endpoints
+    void set_packet_size(uint16_t len);
+    void set_fault(Fault fault);
+
+    // Queues an interrupt-IN notification, sent after delay_ms
+    void add_notification(uint8_t notify1, uint8_t notify2,
+        unsigned delay_ms = 0);
+
+    // Deterministic response data
+    std::string data_pattern(size_t len);
+
+    // Payload of all DEV_DEP_MSG_OUT transfers so far
+    const std::string& written();
+    // Number of calls of libusb_bulk_transfer() for the IN endpoint,
+    // libusb_interrupt_transfer() and libusb_control_transfer() with bRequest
+    unsigned bulk_in_calls();
+    unsigned interrupt_calls();
+    unsigned control_calls(uint8_t request);
+    // Timeout of the last libusb_interrupt_transfer()
+    unsigned interrupt_timeout();
+    // True while the device is opened
+    bool is_open();
+
+}
+
+#endif
@@ -0,0 +1,231 @@
+#include <labdev/utils/measurement.hh>
+#include <labdev/utils/waveform.hh>
+#include <labdev/devices/rigol/ds1000z.hh>
+#include "test_util.hh"
+
+#include <cmath>
+#include <vector>
+
+/*
+ *      Tests the host measurements of measure() on synthetic waveforms with
+ *      known values (sine and trapezoidal square wave), signals without
+ *      edges or reference, and the agreement of the float kernels of the
+ *      waveform path (SSE2 if available) with the double kernels of the
+ *      vector path.
+ */
+
+using namespace labdev;
+using namespace std;
+
+static bool near(double val, double expected, double tol) {
+    return fabs(val - expected) <= tol;
+}
+
+// Equal within the relative tolerance or both NaN
+static bool agree(double a, double b, double rel = 1e-9) {
+    if ( std::isnan(a) || std::isnan(b) )
+        return std::isnan(a) && std::isnan(b);
+    return fabs(a - b) <= rel * std::max(fabs(a), fabs(b));
+}
+
+// offset + ampl * sin(2 pi freq t + phase), npts samples at xincr
+static void sine(double ampl, double offset, double freq, double phase,
+double xincr, size_t npts, vector<double>& horz, vector<double>& vert) {
+    horz.resize(npts);
+    vert.resize(npts);
+    for (size_t i = 0; i < npts; i++) {
+        horz[i] = i * xincr;
+        vert[i] = offset + ampl * sin(2 * M_PI * freq * horz[i] + phase);
+    }
+    return;
+}
+
+// Square wave of 8 bit codes (base, top) with linear edges of ramp samples,
+// starting with the low half period
+static const uint8_t s_base = 78, s_top = 178;
+static const double s_yinc = 1. / 32;
+static const double s_yref = 128;
+
+static void square(size_t period, size_t ramp, size_t npts, double xincr,
+waveform& wf) {
+    wf.resize(waveform::UINT8, npts);
+    wf.set_horz_scale(xincr, 0.);
+    wf.set_vert_scale(s_yinc, 0., s_yref);
+    uint8_t* code = wf.raw_data();
+    size_t half = period / 2;
+    for (size_t i = 0; i < npts; i++) {
+        size_t pos = i % period;
+        double frac;
+        if (pos < half)
+            frac = 0.;
+        else if (pos < half + ramp)
+            frac = (double)(pos - half) / ramp;
+        else if (pos < period - ramp)
+            frac = 1.;
+        else
+            frac = (double)(period - pos) / ramp;
+        code[i] = s_base + (uint8_t)(frac * (s_top - s_base) + 0.5);
+    }
+    return;
+}
+
+static void test_sine() {
+    // 5 periods of 1 kHz with 2000 samples each, channel lags the
+    // reference by 45 degrees
+    const double ampl = 2., offset = 0.5, freq = 1e3, xincr = 5e-7;
+    vector<double> horz, vert, ref_horz, ref_vert;
+    sine(ampl, offset, freq, -M_PI / 4, xincr, 10000, horz, vert);
+    sine(ampl, offset, freq, 0., xincr, 10000, ref_horz, ref_vert);
+    measurements m = measure(horz, vert, &ref_vert);
+
+    CHECK( near(m[ds1000z::MEAS_VMAX], offset + ampl, 1e-5) );
+    CHECK( near(m[ds1000z::MEAS_VMIN], offset - ampl, 1e-5) );
+    CHECK( near(m[ds1000z::MEAS_VPP], 2 * ampl, 1e-5) );
+    // No flat top or base, the amplitude is the peak-to-peak value
+    CHECK( near(m[ds1000z::MEAS_VAMP], 2 * ampl, 1e-5) );
+    CHECK( near(m[ds1000z::MEAS_VAVG], offset, 1e-6) );
+    CHECK( near(m[ds1000z::MEAS_VRMS], sqrt(offset*offset + ampl*ampl/2),
+        1e-6) );
+    CHECK( near(m[ds1000z::MEAS_PER], 1. / freq, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_FREQ], freq, 1e-3) );
+    // 10% to 90% of the amplitude: 2 asin(0.8) / (2 pi f)
+    double rtim = asin(0.8) / (M_PI * freq);
+    CHECK( near(m[ds1000z::MEAS_RTIM], rtim, 1e-8) );
+    CHECK( near(m[ds1000z::MEAS_FTIM], rtim, 1e-8) );
+    CHECK( near(m[ds1000z::MEAS_PDUT], 0.5, 1e-5) );
+    CHECK( near(m[ds1000z::MEAS_RDEL], -0.125 / freq, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_RPH], -45., 1e-3) );
+    CHECK( near(m[ds1000z::MEAS_FPH], -45., 1e-3) );
+
+    // The reference has no delay to itself
+    m = measure(ref_horz, ref_vert, &ref_vert);
+    CHECK( near(m[ds1000z::MEAS_RPH], 0., 1e-9) );
+    return;
+}
+
+static void test_square() {
+    // 1 us per sample, 200 us period with 10 sample edges
+    const double xincr = 1e-6;
+    waveform wf;
+    square(200, 10, 1007, xincr, wf);
+    measurements m = measure(wf);
+
+    double vbas = (s_base - s_yref) * s_yinc, vtop = (s_top - s_yref) * s_yinc;
+    CHECK( near(m[ds1000z::MEAS_VBAS], vbas, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_VTOP], vtop, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_VPP], vtop - vbas, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_VAMP], vtop - vbas, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_OVER], 0., 1e-9) );
+    double sumsq = 0.;
+    for (size_t i = 0; i < wf.size(); i++)
+        sumsq += wf.voltage(i) * wf.voltage(i);
+    CHECK( near(m[ds1000z::MEAS_VRMS], sqrt(sumsq / wf.size()), 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_FREQ], 1. / (200 * xincr), 1e-3) );
+    // 10% to 90% of a linear edge over 10 samples
+    CHECK( near(m[ds1000z::MEAS_RTIM], 8 * xincr, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_FTIM], 8 * xincr, 1e-9) );
+    // Middle of the edges at 105 and 195 samples
+    CHECK( near(m[ds1000z::MEAS_PWID], 90 * xincr, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_NWID], 110 * xincr, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_PDUT], 0.45, 1e-6) );
+
+    // A reference delayed by a quarter period
+    waveform ref;
+    square(200, 10, 1007, xincr, ref);
+    ref.set_horz_scale(xincr, 50 * xincr);
+    m = measure(wf, &ref);
+    CHECK( near(m[ds1000z::MEAS_RDEL], 50 * xincr, 1e-9) );
+    CHECK( near(m[ds1000z::MEAS_RPH], 90., 1e-6) );
+    return;
+}
+
+static void test_edge_cases() {
+    const unsigned edge_items[] = { ds1000z::MEAS_PER, ds1000z::MEAS_FREQ,
+        ds1000z::MEAS_RTIM, ds1000z::MEAS_FTIM, ds1000z::MEAS_PWID,
+        ds1000z::MEAS_PDUT, ds1000z::MEAS_RPH };
+
+    // Flat signal: levels only
+    vector<double> horz(100), vert(100, 1.5);
+    for (size_t i = 0; i < horz.size(); i++)
+        horz[i] = i * 1e-3;
+    measurements m = measure(horz, vert, &vert);
+    CHECK( near(m[ds1000z::MEAS_VAVG], 1.5, 1e-12) );
+    CHECK( near(m[ds1000z::MEAS_VRMS], 1.5, 1e-12) );
+    CHECK( m[ds1000z::MEAS_VPP] == 0. );
+    CHECK( m[ds1000z::MEAS_VAMP] == 0. );
+    for (unsigned item : edge_items)
+        CHECK( std::isnan(m[item]) );
+
+    // One rising edge: rise time, but no period and widths
+    waveform wf;
+    square(400, 10, 300, 1e-6, wf);
+    m = measure(wf);
+    CHECK( near(m[ds1000z::MEAS_RTIM], 8e-6, 1e-12) );
+    CHECK( std::isnan(m[ds1000z::MEAS_FTIM]) );
+    CHECK( std::isnan(m[ds1000z::MEAS_PER]) );
+    CHECK( std::isnan(m[ds1000z::MEAS_FREQ]) );
+    CHECK( std::isnan(m[ds1000z::MEAS_PWID]) );
+    CHECK( std::isnan(m[ds1000z::MEAS_MPAR]) );
+
+    // No reference: delays are NaN, the other items are measured
+    square(200, 10, 1007, 1e-6, wf);
+    m = measure(wf);
+    CHECK( !std::isnan(m[ds1000z::MEAS_FREQ]) );
+    CHECK( std::isnan(m[ds1000z::MEAS_RDEL]) );
+    CHECK( std::isnan(m[ds1000z::MEAS_RPH]) );
+    vector<waveform> wfs(2, wf);
+    vector<measurements> res = measure(wfs, wfs.size());
+    CHECK( res.size() == 2 );
+    CHECK( std::isnan(res[1][ds1000z::MEAS_FDEL]) );
+    CHECK( std::isnan(res[1][ds1000z::MEAS_FPH]) );
+
+    // Empty record
+    m = measure(waveform());
+    for (unsigned i = 0; i < measurements::s_n_items; i++)
+        CHECK( std::isnan(m[i]) );
+    return;
+}
+
+static void test_kernels() {
+    // Noisy square wave with a length which is no multiple of the vector
+    // width, float kernels (waveform) against double kernels (vectors)
+    waveform wf, ref;
+    square(160, 12, 2011, 2e-6, wf);
+    square(160, 12, 2011, 2e-6, ref);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < wf.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        wf.raw_data()[i] += (seed >> 16) % 7;
+        ref.raw_data()[(i + 37) % ref.size()] += (seed >> 20) % 5;
+    }
+    measurements mw = measure(wf, &ref);
+    vector<double> ref_vert = ref.voltages();
+    measurements mv = measure(wf.times(), wf.voltages(), &ref_vert);
+    for (unsigned i = 0; i < measurements::s_n_items; i++) {
+        if ( !agree(mw[i], mv[i]) )
+            fprintf(stderr, "Item %u: %.12g (waveform) != %.12g (vectors)\n",
+                i, mw[i], mv[i]);
+        CHECK( agree(mw[i], mv[i]) );
+    }
+    CHECK( !std::isnan(mw[ds1000z::MEAS_RPH]) );
+
+    // Channels measured in parallel give the same results
+    vector<waveform> wfs = {ref, wf};
+    vector<measurements> res = measure(wfs, 0);
+    for (unsigned i = 0; i < measurements::s_n_items; i++)
+        CHECK( agree(res[1][i], mw[i]) );
+    return;
+}
+
+int main(int argc, char** argv) {
+    test_sine();
+    test_square();
+    test_edge_cases();
+    test_kernels();
+
+    #if defined(__SSE2__)
+    return test_result("SSE2 kernels");
+    #else
+    return test_result("scalar kernels");
+    #endif
+}
@@ -0,0 +1,107 @@
+#include <labdev/utils/scpi_parser.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+
+/*
+ *      Compares scpi_parser with std::stod()/std::stof() on NR3 responses
+ *      as returned by instruments (single values and comma separated
+ *      ASCII waveform data).
+ *
+ *      Usage: scpi_parser_bench [number of values]
+ */
+
+using namespace labdev;
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+static double elapsed_ns(bench_clock::time_point tsta) {
+    return chrono::duration<double, nano>(bench_clock::now() - tsta).count();
+}
+
+// Prevents the compiler from dropping unused results
+static volatile double s_sink;
+
+static void print_result(const char* name, double ns, size_t n, double sum) {
+    s_sink = sum;
+    printf("  %-28s %8.1f ns/value %8.2f Mvalues/s\n", name, ns / n,
+        1e3 * n / ns);
+    return;
+}
+
+int main(int argc, char** argv) {
+    size_t n = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 1000000;
+
+    // Typical instrument formats, e.g. Rigol (%.6E) and Tektronix (%.9E)
+    mt19937_64 rng(1);
+    uniform_real_distribution<double> dist(-5., 5.);
+    vector<string> values(n);
+    string list;
+    char str[64];
+    for (size_t i = 0; i < n; i++) {
+        snprintf(str, sizeof(str), (i % 2) ? "%.6E" : "%.9E", dist(rng));
+        values[i] = str;
+        list += values[i];
+        list += (i + 1 < n) ? "," : "\n";
+    }
+
+    printf("Single values (%zu):\n", n);
+    double sum = 0.;
+    bench_clock::time_point tsta = bench_clock::now();
+    for (const auto& val : values)
+        sum += parse_double(val);
+    print_result("parse_double()", elapsed_ns(tsta), n, sum);
+
+    sum = 0.;
+    tsta = bench_clock::now();
+    for (const auto& val : values)
+        sum += stod(val);
+    print_result("std::stod()", elapsed_ns(tsta), n, sum);
+
+    sum = 0.;
+    tsta = bench_clock::now();
+    for (const auto& val : values)
+        sum += stof(val);
+    print_result("std::stof()", elapsed_ns(tsta), n, sum);
+
+    printf("Comma separated list (%zu bytes):\n", list.size());
+    sum = 0.;
+    tsta = bench_clock::now();
+    scpi_parser parser(list);
+    double val;
+    while ( parser.read_double(val) )
+        sum += val;
+    print_result("scpi_parser::read_double()", elapsed_ns(tsta), n, sum);
+
+    // The old way: split at commas and convert each substring
+    sum = 0.;
+    tsta = bench_clock::now();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == string::npos)
+            end = list.size();
+        sum += stod(list.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    print_result("substr() + std::stod()", elapsed_ns(tsta), n, sum);
+
+    sum = 0.;
+    tsta = bench_clock::now();
+    pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == string::npos)
+            end = list.size();
+        sum += stof(list.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    print_result("substr() + std::stof()", elapsed_ns(tsta), n, sum);
+
+    return 0;
+}
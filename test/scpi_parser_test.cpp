@@ -0,0 +1,357 @@
+#include <labdev/utils/scpi_parser.hh>
+#include <labdev/exceptions.hh>
+#include "test_util.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <random>
+
+/*
+ *      Regression and fuzz test for scpi_parser: fixed IEEE 488.2 responses
+ *      followed by random numbers compared against strtod()/strtoull() and
+ *      random garbage that must neither be accepted partially nor read past
+ *      the end of the buffer.
+ *
+ *      Usage: scpi_parser_test [iterations] [seed]
+ *
+ *      Targets without extended precision long double can be emulated on
+ *      x86 by compiling the test and scpi_parser.cpp with -mlong-double-64.
+ */
+
+using namespace labdev;
+using namespace std;
+
+// Maximum deviation from strtod() in units in the last place; without
+// extended precision (long double == double, e.g. ARM or -mlong-double-64)
+// every scaling step by 1e22 rounds once more
+static const double s_max_ulp = (LDBL_MANT_DIG > DBL_MANT_DIG) ? 1. : 8.;
+
+// Parses a copy of str with the exact length, so reads past the end are
+// caught by valgrind or the address sanitizer
+struct parse_buf {
+    vector<char> data;
+    scpi_parser parser;
+    parse_buf(const string& str) : data(str.begin(), str.end()),
+        parser(data.data(), data.size()) {}
+};
+
+static bool parse_int(const string& str, int64_t& val) {
+    parse_buf buf(str);
+    return buf.parser.read_int(val) && buf.parser.at_end();
+}
+
+static bool parse_double(const string& str, double& val) {
+    parse_buf buf(str);
+    return buf.parser.read_double(val) && buf.parser.at_end();
+}
+
+static double ulp_diff(double a, double b) {
+    if (a == b)
+        return 0.;
+    return fabs(a - b) / fabs(nextafter(b, 2. * b) - b);
+}
+
+static void test_nr1() {
+    int64_t val;
+    CHECK( parse_int("42", val) && (val == 42) );
+    CHECK( parse_int("-17\n", val) && (val == -17) );
+    CHECK( parse_int(" +5 ", val) && (val == 5) );
+    CHECK( parse_int("0", val) && (val == 0) );
+    CHECK( parse_int("9223372036854775807", val) &&
+        (val == INT64_MAX) );
+    CHECK( parse_int("-9223372036854775807", val) &&
+        (val == -INT64_MAX) );
+    CHECK( !parse_int("9223372036854775808", val) );
+    CHECK( !parse_int("", val) );
+    CHECK( !parse_int("-", val) );
+    CHECK( !parse_int("12a", val) );
+    CHECK( !parse_int("ON", val) );
+    // Integral NR2/NR3 values
+    CHECK( parse_int("1.0E3", val) && (val == 1000) );
+    CHECK( parse_int("2.500e+2", val) && (val == 250) );
+    CHECK( parse_int("1200E-2", val) && (val == 12) );
+    CHECK( !parse_int("1.5", val) );
+    CHECK( !parse_int("1E19", val) );
+    return;
+}
+
+static void test_nr2_nr3() {
+    double val;
+    CHECK( parse_double("3.25", val) && (val == 3.25) );
+    CHECK( parse_double("-.5", val) && (val == -0.5) );
+    CHECK( parse_double("7.", val) && (val == 7.) );
+    CHECK( parse_double("1.5E+3", val) && (val == 1500.) );
+    CHECK( parse_double("-2.5e-3", val) && (val == -2.5e-3) );
+    CHECK( parse_double("+1.000000E+00\n", val) && (val == 1.) );
+    CHECK( parse_double("9.9E37", val) && (val == 9.9e37) );
+    CHECK( parse_double("0.0E-999", val) && (val == 0.) );
+    CHECK( parse_double("1E-400", val) && (val == 0.) );
+    CHECK( parse_double("1E400", val) && isinf(val) );
+    CHECK( parse_double("INF", val) && isinf(val) && (val > 0) );
+    CHECK( parse_double("-inf", val) && isinf(val) && (val < 0) );
+    CHECK( parse_double("NINF", val) && isinf(val) && (val < 0) );
+    CHECK( parse_double("NAN", val) && isnan(val) );
+    CHECK( !parse_double("", val) );
+    CHECK( !parse_double(".", val) );
+    CHECK( !parse_double("1E", val) );
+    CHECK( !parse_double("1E+", val) );
+    CHECK( !parse_double("1.2.3", val) );
+    CHECK( !parse_double("0x10", val) );
+    CHECK( !parse_double("\"1.0\"", val) );
+    // More than 19 significant digits
+    CHECK( parse_double("3.14159265358979323846264338", val) &&
+        (ulp_diff(val, 3.14159265358979323846) <= s_max_ulp) );
+    CHECK( parse_double("123456789012345678901234567890", val) &&
+        (ulp_diff(val, 1.2345678901234567890e29) <= s_max_ulp) );
+    return;
+}
+
+static void test_non_decimal() {
+    int64_t val;
+    CHECK( parse_int("#H1F", val) && (val == 31) );
+    CHECK( parse_int("#hff", val) && (val == 255) );
+    CHECK( parse_int("#Q17", val) && (val == 15) );
+    CHECK( parse_int("#B101", val) && (val == 5) );
+    CHECK( parse_int("#H7FFFFFFFFFFFFFFF", val) && (val == INT64_MAX) );
+    CHECK( !parse_int("#H8000000000000000", val) );
+    CHECK( !parse_int("#HFFFFFFFFFFFFFFFFF", val) );
+    CHECK( !parse_int("#B102", val) );
+    CHECK( !parse_int("#Q8", val) );
+    CHECK( !parse_int("#HG", val) );
+    CHECK( !parse_int("#X1", val) );
+    CHECK( !parse_int("#H", val) );
+    CHECK( !parse_int("#", val) );
+    return;
+}
+
+static void test_strings() {
+    const char* str;
+    size_t len;
+    {
+        parse_buf buf("\"abc\"");
+        CHECK( buf.parser.read_string(str, len) &&
+            (string(str, len) == "abc") );
+        CHECK( buf.parser.at_end() );
+    }
+    {
+        // Doubled quotes are not unescaped
+        parse_buf buf("'a''b' , \"\"");
+        CHECK( buf.parser.read_string(str, len) &&
+            (string(str, len) == "a''b") );
+        CHECK( buf.parser.read_string(str, len) && (len == 0) );
+        CHECK( buf.parser.at_end() );
+    }
+    {
+        // Separators inside strings
+        parse_buf buf("\"a,b;c\",x");
+        CHECK( buf.parser.read_string(str, len) &&
+            (string(str, len) == "a,b;c") );
+        CHECK( buf.parser.read_chars(str, len) && (string(str, len) == "x") );
+    }
+    {
+        // Unterminated strings and strings with trailing data are rejected
+        // without moving the read position
+        parse_buf buf("\"abc");
+        CHECK( !buf.parser.read_string(str, len) );
+        CHECK( buf.parser.remaining() == 4 );
+        parse_buf buf2("\"abc\"d");
+        CHECK( !buf2.parser.read_string(str, len) );
+        CHECK( buf2.parser.remaining() == 6 );
+    }
+    return;
+}
+
+static void test_lists() {
+    parse_buf buf(" 1,2.5E-3 ,ON, CH1 ,\"x,y\",#H10;OFF,NAN\r\n");
+    scpi_parser& p = buf.parser;
+    int64_t ival;
+    double dval;
+    bool bval;
+    const char* str;
+    size_t len;
+    CHECK( p.read_int(ival) && (ival == 1) );
+    // Failed reads keep the position
+    size_t rem = p.remaining();
+    CHECK( !p.read_int(ival) && (p.remaining() == rem) );
+    CHECK( !p.read_string(str, len) && (p.remaining() == rem) );
+    CHECK( p.read_double(dval) && (dval == 2.5e-3) );
+    CHECK( p.read_bool(bval) && bval );
+    CHECK( p.read_chars(str, len) && (string(str, len) == "CH1") );
+    CHECK( p.skip() );
+    CHECK( p.read_int(ival) && (ival == 16) );
+    CHECK( p.read_bool(bval) && !bval );
+    CHECK( !p.at_end() );
+    CHECK( p.read_double(dval) && isnan(dval) );
+    CHECK( p.at_end() );
+    CHECK( !p.read_int(ival) );
+
+    parse_buf bools("1,0,on,Off,2");
+    for (bool exp : {true, false, true, false, true})
+        CHECK( bools.parser.read_bool(bval) && (bval == exp) );
+    CHECK( bools.parser.at_end() );
+
+    // Missing separator between elements
+    parse_buf nosep("1 2");
+    CHECK( !nosep.parser.read_int(ival) && (nosep.parser.remaining() == 3) );
+    return;
+}
+
+static void test_convenience() {
+    CHECK( labdev::parse_int("1234\n") == 1234 );
+    CHECK( labdev::parse_double("-1.25E-1\n") == -0.125 );
+    CHECK( labdev::parse_bool("ON\n") );
+    bool thrown = false;
+    try {
+        labdev::parse_double("ERR");
+    } catch (const bad_protocol&) {
+        thrown = true;
+    }
+    CHECK( thrown );
+    return;
+}
+
+// Random doubles in the formats instruments use (NR1/NR2/NR3, various
+// precisions and exponents) compared to strtod()
+static void fuzz_double(mt19937_64& rng, unsigned n) {
+    const char* fmts[] = { "%.*e", "%.*E", "%+.*e", "%.*f", "%.*g" };
+    uniform_int_distribution<int> fmt_dist(0, 4), prec_dist(0, 25),
+        exp_dist(-310, 310);
+    uniform_real_distribution<double> mant_dist(-10., 10.);
+    double max_ulp = 0.;
+    char str[512];
+    for (unsigned i = 0; i < n; i++) {
+        int exp = exp_dist(rng);
+        const char* fmt = fmts[fmt_dist(rng)];
+        // %f only for moderate exponents to keep strings short
+        if ( (fmt[3] == 'f') && (abs(exp) > 40) )
+            fmt = fmts[0];
+        double x = mant_dist(rng) * pow(10., exp);
+        snprintf(str, sizeof(str), fmt, prec_dist(rng), x);
+        double exp_val = strtod(str, nullptr), val;
+        if ( !parse_double(str, val) ) {
+            CHECK( !"read_double() rejected number" );
+            fprintf(stderr, "  input '%s'\n", str);
+            continue;
+        }
+        double diff = ulp_diff(val, exp_val);
+        if ( isinf(exp_val) || (exp_val == 0.) )
+            diff = (val == exp_val) ? 0. : HUGE_VAL;
+        // Denormals have fewer significant bits, compare absolute values
+        else if ( fabs(exp_val) < DBL_MIN )
+            diff = fabs(val - exp_val) / (DBL_MIN * DBL_EPSILON);
+        if (diff > max_ulp)
+            max_ulp = diff;
+        if (diff > s_max_ulp) {
+            CHECK( diff <= s_max_ulp );
+            fprintf(stderr, "  input '%s': %.17g instead of %.17g\n", str,
+                val, exp_val);
+        }
+    }
+    printf("read_double(): max. deviation from strtod() %.2f ulp (limit %.0f,"
+        " long double %s)\n", max_ulp, s_max_ulp,
+        (LDBL_MANT_DIG > DBL_MANT_DIG) ? "extended" : "== double");
+    return;
+}
+
+// Random integers as NR1 and #H/#Q/#B compared to the original value
+static void fuzz_int(mt19937_64& rng, unsigned n) {
+    char str[128];
+    for (unsigned i = 0; i < n; i++) {
+        // Uniform bit lengths instead of mostly huge values
+        int64_t x = (int64_t)(rng() >> (rng() % 64));
+        x = (rng() & 1) ? -x : x;
+        int64_t val;
+        snprintf(str, sizeof(str), "%lld", (long long)x);
+        CHECK( parse_int(str, val) && (val == x) );
+        if (x < 0)
+            continue;
+        snprintf(str, sizeof(str), "#H%llX", (unsigned long long)x);
+        CHECK( parse_int(str, val) && (val == x) );
+        snprintf(str, sizeof(str), "#Q%llo", (unsigned long long)x);
+        CHECK( parse_int(str, val) && (val == x) );
+        string bin = "#B";
+        for (int bit = 63; bit >= 0; bit--)
+            if ( (x >> bit) || (bit == 0) )
+                bin += ((x >> bit) & 1) ? '1' : '0';
+        CHECK( parse_int(bin, val) && (val == x) );
+    }
+    return;
+}
+
+// Random garbage from characters significant to the parser; every read must
+// either consume input or leave the position unchanged, and numbers accepted
+// by read_int() must agree with strtoll()
+static void fuzz_garbage(mt19937_64& rng, unsigned n) {
+    static const char alphabet[] = "0123456789+-.eE#HhQqBbF,; \t\r\n\"'ONFIA";
+    uniform_int_distribution<size_t> len_dist(0, 24),
+        char_dist(0, sizeof(alphabet) - 2);
+    for (unsigned i = 0; i < n; i++) {
+        string str;
+        for (size_t len = len_dist(rng); len > 0; len--)
+            str += alphabet[char_dist(rng)];
+
+        parse_buf buf(str);
+        scpi_parser& p = buf.parser;
+        // Parse until no element type matches
+        for (unsigned step = 0; !p.at_end(); step++) {
+            size_t rem = p.remaining();
+            int64_t ival;
+            double dval;
+            bool bval;
+            const char* s;
+            size_t len;
+            bool ok;
+            switch (rng() % 6) {
+                case 0: ok = p.read_int(ival); break;
+                case 1: ok = p.read_double(dval); break;
+                case 2: ok = p.read_bool(bval); break;
+                case 3: ok = p.read_chars(s, len); break;
+                case 4: ok = p.read_string(s, len); break;
+                default: ok = p.skip(); break;
+            }
+            CHECK( p.remaining() <= rem );
+            if (ok) {
+                CHECK( (p.remaining() < rem) || (rem == 0) );
+            } else
+                CHECK( p.remaining() == rem );
+            if ( !ok && !p.skip() )
+                break;
+            if (step > str.size()) {
+                CHECK( !"parser does not advance" );
+                break;
+            }
+        }
+
+        // Plain decimal integers agree with strtoll()
+        int64_t val;
+        if ( parse_int(str, val) &&
+             (str.find_first_of("#.eE") == string::npos) ) {
+            CHECK( val == strtoll(str.c_str(), nullptr, 10) );
+        }
+    }
+    return;
+}
+
+int main(int argc, char** argv) {
+    unsigned n = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 100000;
+    unsigned seed = (argc > 2) ? strtoul(argv[2], nullptr, 0) : 1;
+    mt19937_64 rng(seed);
+
+    test_nr1();
+    test_nr2_nr3();
+    test_non_decimal();
+    test_strings();
+    test_lists();
+    test_convenience();
+    fuzz_double(rng, n);
+    fuzz_int(rng, n / 10);
+    fuzz_garbage(rng, n);
+
+    return test_result(to_string(n) + " iterations, seed " +
+        to_string(seed));
+}
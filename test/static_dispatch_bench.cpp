@@ -0,0 +1,127 @@
+#include <labdev/devices/rigol/ds1000z.hh>
+#include <labdev/utils/scpi_parser.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+/*
+ *      Compares the statically dispatched monitoring path of ds1000z_t
+ *      (scpi_static_io) with the runtime-polymorphic ds1000z on a loopback
+ *      transport which answers instantly, so only the host overhead per
+ *      query is measured (virtual calls, std::string responses, parsing).
+ *      Both variants are timed alternately for several rounds, the fastest
+ *      round is reported. Build with 'make bench' (optimized library).
+ *
+ *      Usage: static_dispatch_bench [number of queries] [rounds]
+ */
+
+using namespace labdev;
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+// Answers every query with a number
+class loopback final : public interface {
+public:
+    loopback() : m_resp(nullptr), m_len(0) {};
+
+    int write_raw(const uint8_t* data, size_t len) override {
+        if ( memchr(data, '?', len) )
+            m_resp = "1.234560e-03\n";
+        m_len = m_resp ? strlen(m_resp) : 0;
+        return len;
+    }
+
+    int read_raw(uint8_t* data, size_t max_len, unsigned timeout_ms)
+    override {
+        if (!m_resp)
+            throw timeout("No response queued");
+        size_t len = (m_len < max_len) ? m_len : max_len;
+        memcpy(data, m_resp, len);
+        m_resp = nullptr;
+        return len;
+    }
+
+    Interface_type type() const override { return none; }
+    bool connected() const override { return true; }
+    void close() override {};
+
+private:
+    const char* m_resp;
+    size_t m_len;
+};
+
+// ds1000z_t uses the protected constructor for transports without one
+class bench_dso final : public ds1000z_t<loopback> {
+public:
+    bench_dso(loopback* comm) : ds1000z_t<loopback>(comm) {};
+};
+
+// Prevents the compiler from dropping unused results
+static volatile double s_sink;
+
+// Time per call in ns
+template <typename F>
+static double run(unsigned n, F func) {
+    double sum = 0.;
+    bench_clock::time_point tsta = bench_clock::now();
+    for (unsigned i = 0; i < n; i++)
+        sum += func();
+    double ns = chrono::duration<double, nano>(bench_clock::now() -
+        tsta).count();
+    s_sink = sum;
+    return ns / n;
+}
+
+// Compares the fastest of several alternating rounds
+template <typename F, typename G>
+static void compare(const char* name_virt, F func_virt,
+const char* name_static, G func_static, unsigned n, unsigned rounds) {
+    double t_virt = 0., t_static = 0.;
+    for (unsigned i = 0; i < rounds; i++) {
+        double t = run(n, func_virt);
+        if ( (i == 0) || (t < t_virt) )
+            t_virt = t;
+        t = run(n, func_static);
+        if ( (i == 0) || (t < t_static) )
+            t_static = t;
+    }
+    printf("  %-40s %8.1f ns/query\n", name_virt, t_virt);
+    printf("  %-40s %8.1f ns/query\n", name_static, t_static);
+    printf("  speedup %.2fx\n", t_virt / t_static);
+    return;
+}
+
+int main(int argc, char** argv) {
+    unsigned n = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 1000000;
+    unsigned rounds = (argc > 2) ? strtoul(argv[2], nullptr, 0) : 5;
+
+    loopback comm;
+    bench_dso dso(&comm);
+    // Same object through the runtime-polymorphic interface
+    ds1000z& dso_virt = dso;
+    scpi_static_io<loopback> io(&comm);
+    interface* comm_virt = &comm;
+
+    printf("Single value queries (%u, best of %u):\n", n, rounds);
+    compare("interface::query() + parse_double()", [&]{
+        return parse_double(comm_virt->query(":MEAS:STAT:ITEM? CURR,VPP\n"));
+    }, "scpi_static_io::query_double()", [&]{
+        return io.query_double(scpi_cmd(":MEAS:STAT:ITEM? CURR,VPP\n"));
+    }, n, rounds);
+
+    // The runtime-polymorphic versions are called explicitly, calls through
+    // ds1000z& are dispatched to ds1000z_t as well
+    printf("Measurement readout (%u, best of %u):\n", n, rounds);
+    compare("ds1000z::get_measurement()", [&]{
+        return dso_virt.ds1000z::get_measurement(1, 1, ds1000z::MEAS_VPP,
+            ds1000z::MEAS_CUR);
+    }, "ds1000z_t::get_measurement() via ds1000z&", [&]{
+        return dso_virt.get_measurement(1, ds1000z::MEAS_VPP,
+            ds1000z::MEAS_CUR);
+    }, n, rounds);
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef LD_TEST_UTIL_HH
+#define LD_TEST_UTIL_HH
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ *      Checks shared by the test programs in test/: CHECK() counts failed
+ *      conditions and continues, test_result() prints the summary and
+ *      returns the exit status of the test.
+ */
+
+static unsigned s_nfail = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { s_nfail++; \
+        fprintf(stderr, "%s:%d: check '%s' failed\n", __FILE__, __LINE__, \
+        #cond); } } while (0)
+
+// Returns 0 if all checks passed, 1 otherwise
+static inline int test_result(const std::string& info = "") {
+    if (s_nfail) {
+        printf("%u checks FAILED\n", s_nfail);
+        return 1;
+    }
+    printf("All checks passed%s\n", info.empty() ? "" :
+        (" (" + info + ")").c_str());
+    return 0;
+}
+
+// True if func throws E, false if it throws anything else or nothing
+template <typename E, typename F>
+static bool throws(F func) {
+    try {
+        func();
+    } catch (const E&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
+static const uint8_t s_guard = 0xA5;
+
+// Buffer with guard bytes behind max_len to detect overruns
+struct guarded_buf {
+    std::vector<uint8_t> data;
+    size_t max_len;
+    guarded_buf(size_t len) : data(len + 64, s_guard), max_len(len) {}
+    uint8_t* get() { return data.data(); }
+    std::string str(size_t len) const { return std::string(data.begin(),
+        data.begin() + len); }
+    bool intact() const {
+        for (size_t i = max_len; i < data.size(); i++)
+            if (data[i] != s_guard) return false;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include <labdev/usbtmc_interface.hh>
+#include <labdev/exceptions.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+/*
+ *      Compares the bulk transfer throughput of usb_interface with
+ *      kernel-mapped transfer buffers (libusb_dev_mem_alloc(), zero-copy)
+ *      and ordinary heap buffers on a USBTMC instrument by repeating a
+ *      query with a large response (e.g. waveform data).
+ *
+ *      Usage: usb_transfer_bench <vid> <pid> <ep in> <ep out> [query] [n]
+ *      e.g.   usb_transfer_bench 0x1AB1 0x04CE 0x02 0x03 ':WAV:DATA?' 100
+ */
+
+using namespace labdev;
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+static const size_t s_buf_size = 64 << 20;
+
+static void run(usbtmc_interface& tmc, bool zero_copy, const string& query,
+unsigned n) {
+    tmc.set_zero_copy(zero_copy);
+    vector<uint8_t> buf(s_buf_size);
+    // First query allocates the transfer buffer and is not measured
+    tmc.write(query);
+    tmc.read_raw(buf.data(), buf.size(), 10000);
+
+    size_t total = 0;
+    bench_clock::time_point tsta = bench_clock::now();
+    for (unsigned i = 0; i < n; i++) {
+        tmc.write(query);
+        total += tmc.read_raw(buf.data(), buf.size(), 10000);
+    }
+    double sec = chrono::duration<double>(bench_clock::now() - tsta).count();
+    printf("  %-22s %9zu bytes/query %8.3f ms/query %8.2f MB/s\n",
+        tmc.zero_copy() ? "kernel-mapped buffer" : "heap buffer", total / n,
+        1e3 * sec / n, total / sec / 1e6);
+    if (zero_copy && !tmc.zero_copy())
+        printf("  (kernel-mapped memory not supported by OS or libusb)\n");
+    return;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s <vid> <pid> <ep in> <ep out> [query] "
+            "[n]\n", argv[0]);
+        return 1;
+    }
+    uint16_t vid = strtoul(argv[1], nullptr, 0);
+    uint16_t pid = strtoul(argv[2], nullptr, 0);
+    uint8_t ep_in = strtoul(argv[3], nullptr, 0);
+    uint8_t ep_out = strtoul(argv[4], nullptr, 0);
+    string query = (argc > 5) ? string(argv[5]) + "\n" : "*IDN?\n";
+    unsigned n = (argc > 6) ? strtoul(argv[6], nullptr, 0) : 100;
+
+    try {
+        usbtmc_interface tmc(vid, pid);
+        tmc.claim_interface(0);
+        tmc.set_endpoint_in(ep_in);
+        tmc.set_endpoint_out(ep_out);
+
+        // Alternating runs to average out drifts of the instrument
+        printf("%u x '%s':\n", n, query.substr(0, query.size() - 1).c_str());
+        for (unsigned round = 0; round < 2; round++) {
+            run(tmc, false, query, n);
+            run(tmc, true, query, n);
+        }
+    } catch (const std::exception& ex) {
+        fprintf(stderr, "Benchmark failed: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
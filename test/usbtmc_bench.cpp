@@ -0,0 +1,85 @@
+#include <labdev/usbtmc_kernel_interface.hh>
+#include <labdev/usbtmc_interface.hh>
+#include <labdev/exceptions.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+/*
+ *      Compares the throughput of a USBTMC instrument via the Linux kernel
+ *      driver (usbtmc_kernel_interface) and via libusb (usbtmc_interface)
+ *      by repeating a query and reading the full response.
+ *
+ *      Usage: usbtmc_bench <device> <vid> <pid> <ep in> <ep out> [query] [n]
+ *      e.g.   usbtmc_bench /dev/usbtmc0 0x1AB1 0x04CE 0x02 0x03 \
+ *                 ':WAV:DATA?' 100
+ *
+ *      The kernel driver is measured first since libusb detaches it from
+ *      the instrument (the device file disappears until it is reattached,
+ *      e.g. by replugging the instrument).
+ */
+
+using namespace labdev;
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+// Large enough for the waveform data of common oscilloscopes
+static const size_t s_buf_size = 64 << 20;
+
+static void run(interface& comm, const char* name, const string& query,
+unsigned n) {
+    vector<uint8_t> buf(s_buf_size);
+    // First query is not measured (e.g. the instrument prepares data)
+    comm.write(query);
+    comm.read_raw(buf.data(), buf.size(), 10000);
+
+    size_t total = 0;
+    bench_clock::time_point tsta = bench_clock::now();
+    for (unsigned i = 0; i < n; i++) {
+        comm.write(query);
+        total += comm.read_raw(buf.data(), buf.size(), 10000);
+    }
+    double sec = chrono::duration<double>(bench_clock::now() - tsta).count();
+    printf("  %-28s %9zu bytes/query %8.3f ms/query %8.2f MB/s\n", name,
+        total / n, 1e3 * sec / n, total / sec / 1e6);
+    return;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        fprintf(stderr, "Usage: %s <device> <vid> <pid> <ep in> <ep out> "
+            "[query] [n]\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[1];
+    uint16_t vid = strtoul(argv[2], nullptr, 0);
+    uint16_t pid = strtoul(argv[3], nullptr, 0);
+    uint8_t ep_in = strtoul(argv[4], nullptr, 0);
+    uint8_t ep_out = strtoul(argv[5], nullptr, 0);
+    string query = (argc > 6) ? string(argv[6]) + "\n" : "*IDN?\n";
+    unsigned n = (argc > 7) ? strtoul(argv[7], nullptr, 0) : 100;
+
+    printf("%u x '%s':\n", n, query.substr(0, query.size() - 1).c_str());
+    try {
+        usbtmc_kernel_interface tmc(path);
+        run(tmc, "usbtmc_kernel_interface", query, n);
+    } catch (const std::exception& ex) {
+        fprintf(stderr, "  usbtmc_kernel_interface failed: %s\n", ex.what());
+    }
+
+    try {
+        usbtmc_interface tmc(vid, pid);
+        tmc.claim_interface(0);
+        tmc.set_endpoint_in(ep_in);
+        tmc.set_endpoint_out(ep_out);
+        run(tmc, "usbtmc_interface (libusb)", query, n);
+    } catch (const std::exception& ex) {
+        fprintf(stderr, "  usbtmc_interface failed: %s\n", ex.what());
+    }
+
+    return 0;
+}
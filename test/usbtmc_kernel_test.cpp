@@ -0,0 +1,158 @@
+#include <labdev/usbtmc_kernel_interface.hh>
+#include <labdev/exceptions.hh>
+#include "usbtmc_stub.hh"
+#include "test_util.hh"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/ioctl.h>
+#include <linux/usb/tmc.h>
+
+/*
+ *      Tests usbtmc_kernel_interface against the character device stand-in
+ *      in test/usbtmc_stub: messages larger than the read buffer, timeouts,
+ *      buffer clears, service requests, and the USB488 control ioctls.
+ */
+
+using namespace labdev;
+using namespace std;
+
+static void test_open_close() {
+    usbtmc_stub::reset();
+    CHECK( throws<bad_connection>([]{
+        usbtmc_kernel_interface tmc("/dev/usbtmc-does-not-exist"); }) );
+    {
+        usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+        CHECK( tmc.connected() && usbtmc_stub::is_open() );
+        CHECK( tmc.srq_supported() );
+        CHECK( tmc.get_usb488_capabilities() & USBTMC488_CAPABILITY_TRIGGER );
+        CHECK( usbtmc_stub::timeout() == interface::s_dflt_timeout_ms );
+        tmc.close();
+        CHECK( !tmc.connected() && !usbtmc_stub::is_open() );
+        tmc.open(usbtmc_stub::s_dev_path);
+        CHECK( tmc.connected() );
+    }
+    CHECK( !usbtmc_stub::is_open() );
+
+    // Plain USBTMC devices without SRQ
+    usbtmc_stub::set_capabilities(0);
+    usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+    CHECK( !tmc.srq_supported() );
+    return;
+}
+
+static void test_io() {
+    usbtmc_stub::reset();
+    usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+    CHECK( tmc.query("*IDN?\n") == usbtmc_stub::s_idn );
+    CHECK( usbtmc_stub::written() == "*IDN?\n" );
+
+    // Messages larger than the buffer are returned by consecutive reads
+    // without writing past max_len
+    size_t len = 3 << 20;
+    tmc.write("DATA? " + to_string(len) + "\n");
+    string exp = usbtmc_stub::data_pattern(len) + "\n", data;
+    guarded_buf buf(1 << 20);
+    while (data.size() < exp.size()) {
+        int nbytes = tmc.read_raw(buf.get(), buf.max_len, 1000);
+        CHECK( nbytes > 0 );
+        data.append(buf.str(nbytes));
+        CHECK( buf.intact() );
+        CHECK( tmc.end_of_message() == (data.size() == exp.size()) );
+    }
+    CHECK( data == exp );
+    CHECK( usbtmc_stub::read_calls() == 5 );
+    CHECK( usbtmc_stub::timeout() == 1000 );
+
+    // A message filling the buffer exactly is ended according to the driver
+    usbtmc_stub::add_response("#15abcde");
+    CHECK( tmc.read_raw(buf.get(), 8, 1000) == 8 );
+    CHECK( tmc.end_of_message() );
+    return;
+}
+
+static void test_timeout() {
+    usbtmc_stub::reset();
+    usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+    uint8_t buf[64];
+
+    io_result<size_t> ret = tmc.try_read_raw(buf, sizeof(buf), 500);
+    CHECK( (ret.status == io_timeout) && (ret.value == 0) );
+    CHECK( usbtmc_stub::timeout() == 500 );
+    CHECK( throws<timeout>([&]{ tmc.read_raw(buf, sizeof(buf), 500); }) );
+    CHECK( !tmc.try_read() );
+
+    // The driver does not accept timeouts below 100ms
+    ret = tmc.try_read_raw(buf, sizeof(buf), 20);
+    CHECK( !ret && (usbtmc_stub::timeout() == 100) );
+
+    // The timeout is only set if it changed
+    unsigned nset = usbtmc_stub::ioctl_calls(USBTMC_IOCTL_SET_TIMEOUT);
+    tmc.try_read_raw(buf, sizeof(buf), 20);
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC_IOCTL_SET_TIMEOUT) == nset );
+    return;
+}
+
+static void test_clear() {
+    usbtmc_stub::reset();
+    usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+    uint8_t buf[64];
+
+    tmc.write("DATA? 100\n");
+    tmc.clear_buffer();
+    CHECK( !tmc.try_read_raw(buf, sizeof(buf), 100) );
+
+    // Rest of an unfinished message is dropped
+    tmc.write("DATA? 100\n*IDN?\n");
+    CHECK( tmc.read_raw(buf, sizeof(buf), 100) == sizeof(buf) );
+    tmc.abort_bulk_in();
+    CHECK( tmc.read() == usbtmc_stub::s_idn );
+    tmc.abort_bulk_out();
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC_IOCTL_CLEAR) == 1 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC_IOCTL_ABORT_BULK_IN) == 1 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC_IOCTL_ABORT_BULK_OUT) == 1 );
+    return;
+}
+
+static void test_srq() {
+    usbtmc_stub::reset();
+    usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+
+    CHECK( !tmc.wait_for_srq(10) );
+    tmc.write("*OPC\n");
+    CHECK( tmc.wait_for_srq(10) );
+    // SRQ is reset by reading the status byte
+    CHECK( !tmc.wait_for_srq(10) );
+    CHECK( tmc.read_status_byte() == 0x20 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC488_IOCTL_READ_STB) == 2 );
+    return;
+}
+
+static void test_usb488() {
+    usbtmc_stub::reset();
+    usbtmc_kernel_interface tmc(usbtmc_stub::s_dev_path);
+    tmc.remote_enable();
+    tmc.local_lockout();
+    tmc.go_to_local();
+    tmc.trigger();
+    tmc.indicator_pulse();
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC488_IOCTL_REN_CONTROL) == 1 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC488_IOCTL_LOCAL_LOCKOUT) == 1 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC488_IOCTL_GOTO_LOCAL) == 1 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC488_IOCTL_TRIGGER) == 1 );
+    CHECK( usbtmc_stub::ioctl_calls(USBTMC_IOCTL_INDICATOR_PULSE) == 1 );
+    return;
+}
+
+int main(int argc, char** argv) {
+    test_open_close();
+    test_io();
+    test_timeout();
+    test_clear();
+    test_srq();
+    test_usb488();
+
+    return test_result();
+}
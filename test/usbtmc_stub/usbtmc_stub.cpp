@@ -0,0 +1,278 @@
+#include "usbtmc_stub.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <deque>
+#include <map>
+#include <algorithm>
+
+#include <dlfcn.h>          // dlsym()
+#include <fcntl.h>          // open()
+#include <unistd.h>         // close(), read(), write()
+#include <errno.h>          // errno
+#include <poll.h>           // poll()
+#include <sys/ioctl.h>      // ioctl()
+#include <linux/usb/tmc.h>  // USBTMC ioctls
+
+namespace usbtmc_stub {
+
+    const char* s_dev_path = "/dev/usbtmc-stub";
+    const char* s_idn = "LABDEV,USBTMC-STUB,0,1.0\n";
+
+    // Status byte bits
+    static const uint8_t s_esb = 0x20, s_rqs = 0x40;
+    // Driver limit for USBTMC_IOCTL_SET_TIMEOUT
+    static const uint32_t s_min_timeout = 100;
+
+    static const uint8_t s_dflt_caps = USBTMC488_CAPABILITY_SR1 |
+        USBTMC488_CAPABILITY_TRIGGER | USBTMC488_CAPABILITY_REN_CONTROL |
+        USBTMC488_CAPABILITY_488_DOT_2;
+    static const uint32_t s_dflt_timeout = 5000;
+
+    static int s_fd = -1;
+    static uint8_t s_caps = s_dflt_caps;
+    static uint8_t s_stb = 0;
+    static bool s_srq = false;
+    static uint32_t s_timeout = s_dflt_timeout;
+    static std::string s_written, s_cmd;
+    static std::deque<std::string> s_responses;
+    static size_t s_resp_pos = 0;
+    // EOM of the last transfer (USBTMC_IOCTL_MSG_IN_ATTR)
+    static bool s_eom = false;
+    static unsigned s_read_calls = 0;
+    static std::map<unsigned long, unsigned> s_ioctl_calls;
+
+    // C library functions for all other files
+    template <typename F>
+    static F next_func(const char* name) {
+        void* func = dlsym(RTLD_NEXT, name);
+        if (!func) {
+            fprintf(stderr, "usbtmc_stub: %s() not found\n", name);
+            abort();
+        }
+        return (F)func;
+    }
+
+    static void execute(const std::string& cmd) {
+        if (cmd == "*IDN?")
+            s_responses.push_back(s_idn);
+        else if (cmd.compare(0, 6, "DATA? ") == 0)
+            s_responses.push_back(data_pattern(strtoul(cmd.c_str() + 6,
+                nullptr, 10)) + "\n");
+        else if (cmd == "*OPC") {
+            s_stb |= s_esb | s_rqs;
+            s_srq = true;
+        }
+        return;
+    }
+
+    static ssize_t dev_write(const void* buf, size_t len) {
+        s_written.append((const char*)buf, len);
+        for (size_t i = 0; i < len; i++) {
+            char c = ((const char*)buf)[i];
+            if (c == '\n') {
+                execute(s_cmd);
+                s_cmd.clear();
+            } else
+                s_cmd += c;
+        }
+        return len;
+    }
+
+    static ssize_t dev_read(void* buf, size_t len) {
+        s_read_calls++;
+        if ( s_responses.empty() ) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        // The rest of a message is returned by the next read
+        const std::string& msg = s_responses.front();
+        len = std::min(len, msg.size() - s_resp_pos);
+        memcpy(buf, msg.data() + s_resp_pos, len);
+        s_resp_pos += len;
+        s_eom = (s_resp_pos == msg.size());
+        if (s_eom) {
+            s_responses.pop_front();
+            s_resp_pos = 0;
+        }
+        return len;
+    }
+
+    static int dev_ioctl(unsigned long request, void* arg) {
+        s_ioctl_calls[request]++;
+        switch (request) {
+            case USBTMC_IOCTL_SET_TIMEOUT:
+                if (*(uint32_t*)arg < s_min_timeout) {
+                    errno = EINVAL;
+                    return -1;
+                }
+                s_timeout = *(uint32_t*)arg;
+                return 0;
+            case USBTMC_IOCTL_MSG_IN_ATTR:
+                *(uint8_t*)arg = s_eom ? 0x01 : 0x00;
+                return 0;
+            case USBTMC488_IOCTL_GET_CAPS:
+                *(uint8_t*)arg = s_caps;
+                return 0;
+            case USBTMC_IOCTL_CLEAR:
+                s_cmd.clear();
+                s_responses.clear();
+                s_resp_pos = 0;
+                return 0;
+            case USBTMC_IOCTL_ABORT_BULK_IN:
+                if ( !s_responses.empty() ) {
+                    s_responses.pop_front();
+                    s_resp_pos = 0;
+                }
+                return 0;
+            case USBTMC_IOCTL_ABORT_BULK_OUT:
+                s_cmd.clear();
+                return 0;
+            case USBTMC488_IOCTL_READ_STB:
+                // Reading the status byte resets the SRQ
+                *(uint8_t*)arg = s_stb;
+                s_stb &= ~s_rqs;
+                s_srq = false;
+                return 0;
+            case USBTMC_IOCTL_INDICATOR_PULSE:
+            case USBTMC488_IOCTL_REN_CONTROL:
+            case USBTMC488_IOCTL_GOTO_LOCAL:
+            case USBTMC488_IOCTL_LOCAL_LOCKOUT:
+            case USBTMC488_IOCTL_TRIGGER:
+                return 0;
+            default:
+                errno = ENOTTY;
+                return -1;
+        }
+    }
+
+    void reset() {
+        if (s_fd >= 0)
+            next_func<int (*)(int)>("close")(s_fd);
+        s_fd = -1;
+        s_caps = s_dflt_caps;
+        s_stb = 0;
+        s_srq = false;
+        s_timeout = s_dflt_timeout;
+        s_written.clear();
+        s_cmd.clear();
+        s_responses.clear();
+        s_resp_pos = 0;
+        s_eom = false;
+        s_read_calls = 0;
+        s_ioctl_calls.clear();
+        return;
+    }
+
+    void set_capabilities(uint8_t caps) {
+        s_caps = caps;
+        return;
+    }
+
+    void add_response(const std::string& data) {
+        s_responses.push_back(data);
+        return;
+    }
+
+    std::string data_pattern(size_t len) {
+        std::string ret(len, '\0');
+        for (size_t i = 0; i < len; i++)
+            ret[i] = (char)((i * 13 + 1) & 0xFF);
+        return ret;
+    }
+
+    const std::string& written() { return s_written; }
+    uint32_t timeout() { return s_timeout; }
+    bool is_open() { return s_fd >= 0; }
+    unsigned read_calls() { return s_read_calls; }
+
+    unsigned ioctl_calls(unsigned long request) {
+        auto it = s_ioctl_calls.find(request);
+        return (it == s_ioctl_calls.end()) ? 0 : it->second;
+    }
+
+    static bool is_dev(int fd) { return (fd >= 0) && (fd == s_fd); }
+
+}
+
+using namespace usbtmc_stub;
+
+/*
+ *      Interposed C library functions
+ */
+
+extern "C" {
+
+int open(const char* path, int flags, ...) {
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    auto real_open = next_func<int (*)(const char*, int, ...)>("open");
+    if ( strcmp(path, s_dev_path) )
+        return real_open(path, flags, mode);
+    // The driver allows only one open file per device in this stand-in
+    if (s_fd >= 0) {
+        errno = EBUSY;
+        return -1;
+    }
+    // Reserve a file descriptor number
+    s_fd = real_open("/dev/null", O_RDWR);
+    return s_fd;
+}
+
+int close(int fd) {
+    if ( is_dev(fd) )
+        s_fd = -1;
+    return next_func<int (*)(int)>("close")(fd);
+}
+
+ssize_t read(int fd, void* buf, size_t len) {
+    if ( is_dev(fd) )
+        return dev_read(buf, len);
+    return next_func<ssize_t (*)(int, void*, size_t)>("read")(fd, buf, len);
+}
+
+ssize_t write(int fd, const void* buf, size_t len) {
+    if ( is_dev(fd) )
+        return dev_write(buf, len);
+    return next_func<ssize_t (*)(int, const void*, size_t)>("write")(fd, buf,
+        len);
+}
+
+int ioctl(int fd, unsigned long request, ...) __THROW {
+    va_list args;
+    va_start(args, request);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+    if ( is_dev(fd) )
+        return dev_ioctl(request, arg);
+    return next_func<int (*)(int, unsigned long, ...)>("ioctl")(fd, request,
+        arg);
+}
+
+// Only single file polls are served by the stand-in; glibc declares fds
+// write-only, so reading the fd triggers a false positive
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+    if ( (nfds != 1) || !is_dev(fds[0].fd) )
+        return next_func<int (*)(struct pollfd*, nfds_t, int)>("poll")(fds,
+            nfds, timeout);
+    fds[0].revents = 0;
+    if ( (fds[0].events & POLLPRI) && s_srq )
+        fds[0].revents |= POLLPRI;
+    if ( (fds[0].events & POLLIN) && !s_responses.empty() )
+        fds[0].revents |= POLLIN;
+    if (fds[0].events & POLLOUT)
+        fds[0].revents |= POLLOUT;
+    return fds[0].revents ? 1 : 0;
+}
+#pragma GCC diagnostic pop
+
+}
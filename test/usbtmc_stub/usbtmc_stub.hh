@@ -0,0 +1,48 @@
+#ifndef LD_USBTMC_STUB_HH
+#define LD_USBTMC_STUB_HH
+
+#include <string>
+#include <cstdint>
+
+/*
+ *      Stand-in for a USB488 instrument behind the Linux USBTMC driver
+ *      (/dev/usbtmcN) for testing usbtmc_kernel_interface without hardware.
+ *      The test program defines open(), close(), read(), write(), ioctl()
+ *      and poll(); calls for s_dev_path are served by the stand-in, all
+ *      others are passed on to the C library. Nothing blocks, timeouts are
+ *      returned immediately (ETIMEDOUT like the driver).
+ *
+ *      Commands (one per line):
+ *          *IDN?           identification (s_idn)
+ *          DATA? <n>       n bytes of data_pattern() followed by '\n'
+ *          *OPC            raises a service request (RQS and ESB)
+ *      Everything else is only recorded.
+ */
+
+namespace usbtmc_stub {
+
+    extern const char* s_dev_path;
+    extern const char* s_idn;
+
+    // Restores the initial state (closed, no responses, SR1 capability)
+    void reset();
+
+    // USB488 capabilities returned by USBTMC488_IOCTL_GET_CAPS
+    void set_capabilities(uint8_t caps);
+    // Queues a response message
+    void add_response(const std::string& data);
+    // Data returned by DATA?
+    std::string data_pattern(size_t len);
+
+    // All data written so far
+    const std::string& written();
+    // Driver timeout set by USBTMC_IOCTL_SET_TIMEOUT
+    uint32_t timeout();
+    bool is_open();
+    // Number of read() calls and ioctl() calls with the given request
+    unsigned read_calls();
+    unsigned ioctl_calls(unsigned long request);
+
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include <labdev/usbtmc_interface.hh>
+#include <labdev/usb488_interface.hh>
+#include <labdev/devices/scpi_device.hh>
+#include <labdev/exceptions.hh>
+#include "libusb_stub.hh"
+#include "test_util.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>     // mkstemp(), unlink()
+#include <sys/time.h>   // gettimeofday()
+
+/*
+ *      Tests usb_interface and usbtmc_interface against the libusb
+ *      stand-in in test/libusb_stub: recovery from invalid and stalled
+ *      Bulk-IN transfers, block responses ending at EOM, USB488 service
+ *      requests, and the capture of a USBTMC session and its offline replay.
+ */
+
+using namespace labdev;
+using namespace std;
+
+// Opens the stand-in instrument like a device driver does
+static void setup(usbtmc_interface& tmc) {
+    tmc.claim_interface(0);
+    tmc.set_endpoint_in(libusb_stub::s_ep_bulk_in);
+    tmc.set_endpoint_out(libusb_stub::s_ep_bulk_out);
+    return;
+}
+
+// USBTMC session recorded by capture and repeated by replay
+struct session {
+    string idn, data, aligned;
+    io_result<int> hdr, partial;
+    string partial_data;
+};
+
+static session run_session(usbtmc_interface& tmc) {
+    session ret;
+    ret.idn = tmc.query("*IDN?\n");
+    // Several packets and a transfer ending on a packet boundary (followed
+    // by a zero-length packet)
+    ret.data = tmc.query("DATA? 1000\n");
+    ret.aligned = tmc.query("DATA? 115\n");
+
+    // The instrument stops sending in the middle of a transfer, the bulk
+    // read times out with partial data
+    tmc.write("STALL? 1000\n");
+    uint8_t req[12] = {0x02, 0x80, 0x7F, 0x00, 0xE8, 0x03, 0x00, 0x00};
+    tmc.write_bulk(req, sizeof(req));
+    vector<uint8_t> buf(1024);
+    ret.hdr = tmc.try_read_bulk(buf.data(), 64, 100);
+    ret.partial = tmc.try_read_bulk(buf.data(), buf.size(), 100);
+    ret.partial_data.assign(buf.begin(), buf.begin() + ret.partial.value);
+    tmc.abort_bulk_in();
+    return ret;
+}
+
+static void test_transfer_size() {
+    libusb_stub::reset();
+    usbtmc_interface tmc(libusb_stub::s_vid, libusb_stub::s_pid);
+    setup(tmc);
+
+    // A corrupt TransferSize is rejected before memory is allocated and the
+    // rest of the transfer is discarded
+    libusb_stub::set_fault(libusb_stub::CORRUPT_SIZE);
+    CHECK( throws<bad_protocol>([&]{ tmc.query("DATA? 1000\n"); }) );
+    CHECK( libusb_stub::control_calls(
+        usbtmc_interface::INITIATE_ABORT_BULK_IN) == 1 );
+    libusb_stub::set_fault(libusb_stub::NO_FAULT);
+    CHECK( tmc.query("*IDN?\n") == libusb_stub::s_idn );
+
+    // Same for more data than requested by a buffer read
+    libusb_stub::set_fault(libusb_stub::IGNORE_MAX_SIZE);
+    tmc.write("DATA? 1000\n");
+    guarded_buf buf(100);
+    CHECK( throws<bad_protocol>([&]{
+        tmc.read_raw(buf.get(), buf.max_len, 100); }) );
+    CHECK( buf.intact() );
+    CHECK( libusb_stub::control_calls(
+        usbtmc_interface::INITIATE_ABORT_BULK_IN) == 2 );
+    libusb_stub::set_fault(libusb_stub::NO_FAULT);
+    CHECK( tmc.query("*IDN?\n") == libusb_stub::s_idn );
+    return;
+}
+
+static void test_stalled_read() {
+    libusb_stub::reset();
+    usbtmc_interface tmc(libusb_stub::s_vid, libusb_stub::s_pid);
+    setup(tmc);
+
+    // try_read_raw() reports the timeout without throwing, the data received
+    // before the device stalled is returned and the transfer aborted
+    tmc.write("STALL? 1000\n");
+    guarded_buf buf(1000);
+    io_result<size_t> ret;
+    bool thrown = false;
+    try {
+        ret = tmc.try_read_raw(buf.get(), buf.max_len, 100);
+    } catch (...) {
+        thrown = true;
+    }
+    CHECK( !thrown );
+    CHECK( !ret && (ret.value == 3*64 - 12) );
+    CHECK( buf.str(ret.value) == libusb_stub::data_pattern(ret.value) );
+    CHECK( buf.intact() );
+    CHECK( libusb_stub::control_calls(
+        usbtmc_interface::INITIATE_ABORT_BULK_IN) == 1 );
+    CHECK( tmc.query("*IDN?\n") == libusb_stub::s_idn );
+
+    // read_raw() throws on the same condition
+    tmc.write("STALL? 1000\n");
+    CHECK( throws<labdev::timeout>([&]{
+        tmc.read_raw(buf.get(), buf.max_len, 100); }) );
+    CHECK( libusb_stub::control_calls(
+        usbtmc_interface::INITIATE_ABORT_BULK_IN) == 2 );
+    CHECK( tmc.query("*IDN?\n") == libusb_stub::s_idn );
+
+    // A complete message is returned with io_ok
+    tmc.write("DATA? 500\n");
+    ret = tmc.try_read_raw(buf.get(), buf.max_len, 100);
+    CHECK( ret && (ret.value == 501) );
+    CHECK( buf.str(500) == libusb_stub::data_pattern(500) );
+    return;
+}
+
+static void test_block_eom() {
+    libusb_stub::reset();
+    usbtmc_interface tmc(libusb_stub::s_vid, libusb_stub::s_pid);
+    setup(tmc);
+    scpi_device dev(&tmc);
+    vector<uint8_t> data;
+
+    // The terminator following the block is consumed
+    tmc.write("BLOCK? 1000\n");
+    CHECK( dev.read_block(data, 1000) == 1000 );
+    CHECK( string(data.begin(), data.end()) ==
+        libusb_stub::data_pattern(1000) );
+    CHECK( tmc.end_of_message() );
+
+    // A block ending the message (EOM set) is not followed by a read which
+    // times out and aborts the transfer
+    tmc.write("BLOCKNT? 1000\n");
+    CHECK( dev.read_block(data, 1000) == 1000 );
+    CHECK( tmc.end_of_message() );
+    CHECK( libusb_stub::control_calls(
+        usbtmc_interface::INITIATE_ABORT_BULK_IN) == 0 );
+    CHECK( tmc.query("*IDN?\n") == libusb_stub::s_idn );
+    return;
+}
+
+static void test_srq_timeout() {
+    libusb_stub::reset();
+    usb488_interface tmc(libusb_stub::s_vid, libusb_stub::s_pid);
+    setup(tmc);
+    tmc.set_endpoint_interrupt_in(libusb_stub::s_ep_int_in);
+    CHECK( tmc.srq_supported() );
+
+    // Other notifications do not extend the timeout
+    for (int i = 0; i < 3; i++)
+        libusb_stub::add_notification(0x82, 0x00, 40);
+    struct timeval tsta, tsto;
+    gettimeofday(&tsta, NULL);
+    CHECK( !tmc.wait_for_srq(100) );
+    gettimeofday(&tsto, NULL);
+    double tdiff = (tsto.tv_sec - tsta.tv_sec) * 1000. +
+        (tsto.tv_usec - tsta.tv_usec) / 1000.;
+    CHECK( (tdiff > 90) && (tdiff < 150) );
+    CHECK( libusb_stub::interrupt_timeout() < 40 );
+
+    tmc.write("*OPC\n");
+    CHECK( tmc.wait_for_srq(100) );
+    return;
+}
+
+static void test_capture_replay() {
+    libusb_stub::reset();
+    char path[] = "/tmp/usbtmc_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK( fd >= 0 );
+    close(fd);
+
+    session cap;
+    {
+        usbtmc_interface tmc(libusb_stub::s_vid, libusb_stub::s_pid);
+        tmc.start_capture(path);
+        CHECK( tmc.capturing() );
+        setup(tmc);
+        cap = run_session(tmc);
+    }
+    CHECK( cap.idn == libusb_stub::s_idn );
+    CHECK( cap.data == libusb_stub::data_pattern(1000) + "\n" );
+    CHECK( cap.aligned == libusb_stub::data_pattern(115) + "\n" );
+    CHECK( cap.hdr && (cap.hdr.value == 64) );
+    CHECK( !cap.partial && (cap.partial.value == 128) );
+    CHECK( cap.partial_data == libusb_stub::data_pattern(1000).substr(52,
+        128) );
+
+    // The replay does not access the device at all and returns the same
+    // results, including partial data of timed out transfers
+    libusb_stub::reset();
+    {
+        usbtmc_interface tmc;
+        tmc.open_replay(path);
+        CHECK( tmc.replaying() && tmc.connected() );
+        setup(tmc);
+        CHECK( tmc.get_vid() == libusb_stub::s_vid );
+        CHECK( tmc.term_char_supported() );
+        session rep = run_session(tmc);
+        CHECK( rep.idn == cap.idn );
+        CHECK( rep.data == cap.data );
+        CHECK( rep.aligned == cap.aligned );
+        CHECK( rep.hdr.ok() && (rep.hdr.value == cap.hdr.value) );
+        CHECK( !rep.partial && (rep.partial.value == cap.partial.value) );
+        CHECK( rep.partial_data == cap.partial_data );
+        // End of the capture
+        CHECK( throws<bad_io>([&]{ tmc.query("*IDN?\n"); }) );
+    }
+    CHECK( libusb_stub::bulk_in_calls() == 0 );
+    CHECK( libusb_stub::written().empty() );
+
+    // A driver deviating from the capture is detected
+    {
+        usbtmc_interface tmc;
+        tmc.open_replay(path);
+        tmc.claim_interface(0);
+        CHECK( throws<bad_protocol>([&]{ tmc.set_endpoint_in(0x05); }) );
+        CHECK( throws<bad_protocol>([&]{ tmc.set_endpoint_out(0x04); }) );
+        tmc.set_endpoint_in(libusb_stub::s_ep_bulk_in);
+        tmc.set_endpoint_out(libusb_stub::s_ep_bulk_out);
+        CHECK( throws<bad_protocol>([&]{ tmc.write("*RST\n"); }) );
+    }
+
+    unlink(path);
+    return;
+}
+
+int main(int argc, char** argv) {
+    test_transfer_size();
+    test_stalled_read();
+    test_block_eom();
+    test_srq_timeout();
+    test_capture_replay();
+
+    return test_result();
+}
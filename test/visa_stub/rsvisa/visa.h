@@ -0,0 +1,83 @@
+#ifndef LD_VISA_STUB_VISA_H
+#define LD_VISA_STUB_VISA_H
+
+/*
+ *      Stand-in for the VISA library header, declares the subset of VISA
+ *      used by visa_interface with the types and values of the 64 bit
+ *      VISA headers; implemented by visa_stub.cpp
+ */
+
+#include <cstdint>
+
+typedef int32_t ViInt32;
+typedef uint32_t ViUInt32;
+typedef uint16_t ViUInt16;
+typedef uint64_t ViUInt64;
+typedef ViInt32 ViStatus;
+typedef ViUInt32 ViObject;
+typedef ViObject ViSession;
+typedef ViObject ViFindList;
+typedef ViObject ViEvent;
+typedef ViUInt32 ViJobId;
+typedef ViUInt32 ViEventType;
+typedef ViUInt32 ViEventFilter;
+typedef ViUInt32 ViAttr;
+typedef ViUInt64 ViAttrState;
+typedef ViUInt32 ViAccessMode;
+typedef unsigned char* ViBuf;
+typedef char ViChar;
+typedef const char* ViConstRsrc;
+typedef const char* ViConstString;
+
+#define VI_NULL                     0
+
+#define _VI_ERROR                   (-2147483647L-1)
+#define VI_SUCCESS                  0L
+#define VI_SUCCESS_MAX_CNT          0x3FFF0006L
+#define VI_WARN_NULL_OBJECT         0x3FFF0082L
+#define VI_ERROR_INV_OBJECT         (_VI_ERROR+0x3FFF000EL)
+#define VI_ERROR_RSRC_NFOUND        (_VI_ERROR+0x3FFF0011L)
+#define VI_ERROR_TMO                (_VI_ERROR+0x3FFF0015L)
+#define VI_ERROR_ABORT              (_VI_ERROR+0x3FFF0030L)
+#define VI_ERROR_OUTP_PROT_VIOL     (_VI_ERROR+0x3FFF0036L)
+#define VI_ERROR_BERR               (_VI_ERROR+0x3FFF0038L)
+#define VI_ERROR_IO                 (_VI_ERROR+0x3FFF003EL)
+#define VI_ERROR_NENABLED           (_VI_ERROR+0x3FFF0051L)
+#define VI_ERROR_INV_JOB_ID         (_VI_ERROR+0x3FFF0070L)
+
+#define VI_FIND_BUFLEN              256
+#define VI_READ_BUF                 1
+#define VI_WRITE_BUF                2
+#define VI_QUEUE                    1
+#define VI_TMO_INFINITE             0xFFFFFFFFUL
+
+#define VI_ATTR_TMO_VALUE           0x3FFF001AUL
+#define VI_ATTR_JOB_ID              0x3FFF4006UL
+#define VI_ATTR_STATUS              0x3FFF4025UL
+#define VI_ATTR_RET_COUNT           0x3FFF4026UL
+#define VI_EVENT_IO_COMPLETION      0x3FFF2009UL
+
+ViStatus viOpenDefaultRM(ViSession* vi);
+ViStatus viOpen(ViSession sesn, ViConstRsrc name, ViAccessMode mode,
+    ViUInt32 timeout, ViSession* vi);
+ViStatus viClose(ViObject vi);
+ViStatus viFindRsrc(ViSession sesn, ViConstString expr, ViFindList* vi,
+    ViUInt32* retcnt, ViChar desc[]);
+ViStatus viFindNext(ViFindList vi, ViChar desc[]);
+ViStatus viSetAttribute(ViObject vi, ViAttr attr, ViAttrState val);
+ViStatus viGetAttribute(ViObject vi, ViAttr attr, void* val);
+ViStatus viStatusDesc(ViObject vi, ViStatus stat, ViChar desc[]);
+ViStatus viTerminate(ViObject vi, ViUInt16 degree, ViJobId job);
+ViStatus viEnableEvent(ViSession vi, ViEventType type, ViUInt16 mech,
+    ViEventFilter ctx);
+ViStatus viDisableEvent(ViSession vi, ViEventType type, ViUInt16 mech);
+ViStatus viWaitOnEvent(ViSession vi, ViEventType type, ViUInt32 timeout,
+    ViEventType* out_type, ViEvent* out_ctx);
+ViStatus viRead(ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* ret_cnt);
+ViStatus viReadAsync(ViSession vi, ViBuf buf, ViUInt32 cnt, ViJobId* job);
+ViStatus viWrite(ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* ret_cnt);
+ViStatus viWriteAsync(ViSession vi, ViBuf buf, ViUInt32 cnt, ViJobId* job);
+ViStatus viFlush(ViSession vi, ViUInt16 mask);
+ViStatus viClear(ViSession vi);
+
+#endif
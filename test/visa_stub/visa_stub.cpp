@@ -0,0 +1,282 @@
+#include "visa_stub.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <algorithm>
+
+namespace visa_stub {
+
+    const char* s_rsrc_name = "USB0::0x1234::0x5678::STUB::INSTR";
+
+    enum object_type {rsrc_manager, instrument, find_list, event};
+
+    struct message {
+        std::string data;
+        size_t pos;
+        bool end;
+    };
+
+    struct io_event {
+        ViJobId job;
+        ViStatus status;
+        ViUInt32 count;
+    };
+
+    struct read_job {
+        ViBuf buf;
+        ViUInt32 cnt;
+    };
+
+    static std::map<ViObject, object_type> s_objects;
+    static ViObject s_next_object = 1;
+    static std::deque<message> s_responses;
+    static std::string s_written;
+    static ViUInt32 s_timeout = 2000;
+    static unsigned s_read_calls = 0;
+
+    static bool s_events_enabled = false;
+    static std::map<ViEvent, io_event> s_events;
+    static std::deque<ViEvent> s_event_queue;
+    static std::map<ViJobId, read_job> s_pending;
+    static ViJobId s_next_job = 1;
+
+    static ViObject new_object(object_type type) {
+        s_objects[s_next_object] = type;
+        return s_next_object++;
+    }
+
+    static bool is_type(ViObject vi, object_type type) {
+        auto it = s_objects.find(vi);
+        return (it != s_objects.end()) && (it->second == type);
+    }
+
+    // Transfers the next response like viRead(): stops at the end of the
+    // message or when cnt bytes were read, times out if the instrument does
+    // not terminate the message
+    static ViStatus transfer(ViBuf buf, ViUInt32 cnt, ViUInt32& ret_cnt) {
+        ret_cnt = 0;
+        if ( s_responses.empty() )
+            return VI_ERROR_TMO;
+        message& msg = s_responses.front();
+        size_t len = std::min<size_t>(cnt, msg.data.size() - msg.pos);
+        memcpy(buf, msg.data.data() + msg.pos, len);
+        msg.pos += len;
+        ret_cnt = len;
+        if ( msg.pos < msg.data.size() )
+            return VI_SUCCESS_MAX_CNT;
+        bool end = msg.end;
+        s_responses.pop_front();
+        return end ? VI_SUCCESS : VI_ERROR_TMO;
+    }
+
+    static void complete(ViJobId job, ViStatus status, ViUInt32 count) {
+        // Completion events are lost if they are not enabled
+        if (!s_events_enabled)
+            return;
+        ViEvent ev = new_object(event);
+        s_events[ev] = {job, status, count};
+        s_event_queue.push_back(ev);
+        return;
+    }
+
+    void reset() {
+        s_objects.clear();
+        s_next_object = 1;
+        s_responses.clear();
+        s_written.clear();
+        s_timeout = 2000;
+        s_read_calls = 0;
+        s_events_enabled = false;
+        s_events.clear();
+        s_event_queue.clear();
+        s_pending.clear();
+        s_next_job = 1;
+        return;
+    }
+
+    void add_response(const std::string& data, bool end) {
+        s_responses.push_back({data, 0, end});
+        return;
+    }
+
+    bool complete_job(ViJobId job) {
+        auto it = s_pending.find(job);
+        if ( it == s_pending.end() )
+            return false;
+        ViUInt32 count;
+        ViStatus stat = transfer(it->second.buf, it->second.cnt, count);
+        s_pending.erase(it);
+        complete(job, stat, count);
+        return true;
+    }
+
+    const std::string& written() { return s_written; }
+    ViUInt32 timeout() { return s_timeout; }
+    unsigned read_calls() { return s_read_calls; }
+    unsigned open_events() { return s_events.size(); }
+
+    unsigned open_sessions() {
+        return std::count_if(s_objects.begin(), s_objects.end(),
+            [](const std::pair<const ViObject, object_type>& obj)
+            { return obj.second != event; });
+    }
+
+}
+
+using namespace visa_stub;
+
+ViStatus viOpenDefaultRM(ViSession* vi) {
+    *vi = new_object(rsrc_manager);
+    return VI_SUCCESS;
+}
+
+ViStatus viOpen(ViSession sesn, ViConstRsrc name, ViAccessMode mode,
+ViUInt32 timeout, ViSession* vi) {
+    if ( !is_type(sesn, rsrc_manager) )
+        return VI_ERROR_INV_OBJECT;
+    if ( strcmp(name, s_rsrc_name) )
+        return VI_ERROR_RSRC_NFOUND;
+    *vi = new_object(instrument);
+    return VI_SUCCESS;
+}
+
+ViStatus viClose(ViObject vi) {
+    if (vi == VI_NULL)
+        return VI_WARN_NULL_OBJECT;
+    auto it = s_objects.find(vi);
+    if ( it == s_objects.end() )
+        return VI_ERROR_INV_OBJECT;
+    if (it->second == event)
+        s_events.erase(vi);
+    s_objects.erase(it);
+    return VI_SUCCESS;
+}
+
+ViStatus viFindRsrc(ViSession sesn, ViConstString expr, ViFindList* vi,
+ViUInt32* retcnt, ViChar desc[]) {
+    if ( !is_type(sesn, rsrc_manager) )
+        return VI_ERROR_INV_OBJECT;
+    *vi = new_object(find_list);
+    *retcnt = 1;
+    snprintf(desc, VI_FIND_BUFLEN, "%s", s_rsrc_name);
+    return VI_SUCCESS;
+}
+
+ViStatus viFindNext(ViFindList vi, ViChar desc[]) {
+    return VI_ERROR_RSRC_NFOUND;
+}
+
+ViStatus viSetAttribute(ViObject vi, ViAttr attr, ViAttrState val) {
+    if ( !is_type(vi, instrument) || (attr != VI_ATTR_TMO_VALUE) )
+        return VI_ERROR_INV_OBJECT;
+    s_timeout = val;
+    return VI_SUCCESS;
+}
+
+ViStatus viGetAttribute(ViObject vi, ViAttr attr, void* val) {
+    if ( is_type(vi, instrument) && (attr == VI_ATTR_TMO_VALUE) ) {
+        *(ViUInt32*)val = s_timeout;
+        return VI_SUCCESS;
+    }
+    auto it = s_events.find(vi);
+    if ( it == s_events.end() )
+        return VI_ERROR_INV_OBJECT;
+    switch (attr) {
+        case VI_ATTR_JOB_ID: *(ViJobId*)val = it->second.job; break;
+        case VI_ATTR_STATUS: *(ViStatus*)val = it->second.status; break;
+        case VI_ATTR_RET_COUNT: *(ViUInt32*)val = it->second.count; break;
+        default: return VI_ERROR_INV_OBJECT;
+    }
+    return VI_SUCCESS;
+}
+
+ViStatus viStatusDesc(ViObject vi, ViStatus stat, ViChar desc[]) {
+    snprintf(desc, 256, "VISA stub status 0x%08X", (unsigned)stat);
+    return VI_SUCCESS;
+}
+
+ViStatus viTerminate(ViObject vi, ViUInt16 degree, ViJobId job) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    // Aborted jobs complete with VI_ERROR_ABORT
+    if ( !s_pending.erase(job) )
+        return VI_ERROR_INV_JOB_ID;
+    complete(job, VI_ERROR_ABORT, 0);
+    return VI_SUCCESS;
+}
+
+ViStatus viEnableEvent(ViSession vi, ViEventType type, ViUInt16 mech,
+ViEventFilter ctx) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    s_events_enabled = true;
+    return VI_SUCCESS;
+}
+
+ViStatus viDisableEvent(ViSession vi, ViEventType type, ViUInt16 mech) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    s_events_enabled = false;
+    return VI_SUCCESS;
+}
+
+ViStatus viWaitOnEvent(ViSession vi, ViEventType type, ViUInt32 timeout,
+ViEventType* out_type, ViEvent* out_ctx) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    if (!s_events_enabled)
+        return VI_ERROR_NENABLED;
+    if ( s_event_queue.empty() )
+        return VI_ERROR_TMO;
+    *out_type = VI_EVENT_IO_COMPLETION;
+    *out_ctx = s_event_queue.front();
+    s_event_queue.pop_front();
+    return VI_SUCCESS;
+}
+
+ViStatus viRead(ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* ret_cnt) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    s_read_calls++;
+    return transfer(buf, cnt, *ret_cnt);
+}
+
+ViStatus viReadAsync(ViSession vi, ViBuf buf, ViUInt32 cnt, ViJobId* job) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    *job = s_next_job++;
+    s_pending[*job] = {buf, cnt};
+    if ( !s_responses.empty() )
+        complete_job(*job);
+    return VI_SUCCESS;
+}
+
+ViStatus viWrite(ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* ret_cnt) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    s_written.append((const char*)buf, cnt);
+    *ret_cnt = cnt;
+    return VI_SUCCESS;
+}
+
+ViStatus viWriteAsync(ViSession vi, ViBuf buf, ViUInt32 cnt, ViJobId* job) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    s_written.append((const char*)buf, cnt);
+    *job = s_next_job++;
+    complete(*job, VI_SUCCESS, cnt);
+    return VI_SUCCESS;
+}
+
+ViStatus viFlush(ViSession vi, ViUInt16 mask) {
+    return is_type(vi, instrument) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus viClear(ViSession vi) {
+    if ( !is_type(vi, instrument) )
+        return VI_ERROR_INV_OBJECT;
+    s_responses.clear();
+    return VI_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#ifndef LD_VISA_STUB_HH
+#define LD_VISA_STUB_HH
+
+#include <rsvisa/visa.h>
+
+#include <string>
+#include <cstddef>
+
+/*
+ *      Stand-in for the VISA library with a single instrument
+ *      (s_rsrc_name) for testing visa_interface without hardware. Reads
+ *      return scripted responses, writes are recorded. Asynchronous reads
+ *      complete immediately if response data is available, otherwise they
+ *      stay pending until complete_job() or viTerminate(). Nothing blocks:
+ *      timeouts are returned immediately.
+ */
+
+namespace visa_stub {
+
+    extern const char* s_rsrc_name;
+
+    // Restores the initial state (no responses, no sessions, no events)
+    void reset();
+
+    // Queues a response message; without end the instrument stops sending
+    // after the data and the read times out (VI_ERROR_TMO with the count of
+    // the bytes transferred, as with real VISA). Reads stop at the end of a
+    // message, the rest of a message exceeding the read count is returned by
+    // the next read (VI_SUCCESS_MAX_CNT).
+    void add_response(const std::string& data, bool end = true);
+
+    // Serves a pending asynchronous read from the queued responses, returns
+    // false if the job is not pending
+    bool complete_job(ViJobId job);
+
+    // All data written so far
+    const std::string& written();
+    // Current VI_ATTR_TMO_VALUE of the instrument session
+    ViUInt32 timeout();
+    // Number of viRead() calls, open sessions and unclosed events
+    unsigned read_calls();
+    unsigned open_sessions();
+    unsigned open_events();
+
+}
+
+#endif
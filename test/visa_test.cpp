@@ -0,0 +1,185 @@
+#include <labdev/visa_interface.hh>
+#include <labdev/exceptions.hh>
+#include "visa_stub.hh"
+#include "test_util.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ *      Tests visa_interface against the VISA stand-in in test/visa_stub:
+ *      bounds of direct reads into the caller's buffer, partial data on
+ *      timeouts, and asynchronous I/O (out of order completion, timeouts
+ *      and aborted jobs).
+ */
+
+using namespace labdev;
+using namespace std;
+
+static string pattern(size_t len, unsigned seed = 0) {
+    string ret(len, '\0');
+    for (size_t i = 0; i < len; i++)
+        ret[i] = (char)((i * 7 + seed) & 0xFF);
+    return ret;
+}
+
+static void test_open_close() {
+    visa_stub::reset();
+    {
+        visa_interface visa;
+        vector<string> rsrc = visa.find_resources();
+        CHECK( (rsrc.size() == 1) && (rsrc[0] == visa_stub::s_rsrc_name) );
+        CHECK( throws<bad_io>([&]{ visa.open("TCPIP::1.2.3.4::INSTR"); }) );
+        visa.open(visa_stub::s_rsrc_name);
+        CHECK( visa.connected() );
+        CHECK( throws<bad_io>([&]{ visa.open(visa_stub::s_rsrc_name); }) );
+        // Can be reopened after close()
+        visa.close();
+        CHECK( !visa.connected() );
+        visa.open(visa_stub::s_rsrc_name);
+        CHECK( visa.connected() );
+    }
+    // The default resource manager is closed with the last interface
+    CHECK( visa_stub::open_sessions() == 0 );
+    return;
+}
+
+static void test_write() {
+    visa_stub::reset();
+    visa_interface visa(visa_stub::s_rsrc_name);
+    visa.write("*IDN?\n");
+    string blk = pattern(100000);
+    visa.write_raw((const uint8_t*)blk.data(), blk.size());
+    CHECK( visa_stub::written() == "*IDN?\n" + blk );
+    return;
+}
+
+static void test_read_bounds() {
+    visa_stub::reset();
+    visa_interface visa(visa_stub::s_rsrc_name);
+    string msg = pattern(3000);
+    visa_stub::add_response(msg);
+    visa_stub::add_response("next\n");
+
+    // Messages longer than max_len are returned in pieces without writing
+    // past max_len, one viRead() per piece
+    guarded_buf buf(1000);
+    for (unsigned i = 0; i < 3; i++) {
+        unsigned ncalls = visa_stub::read_calls();
+        CHECK( visa.read_raw(buf.get(), buf.max_len, 100) == 1000 );
+        CHECK( buf.str(1000) == msg.substr(i * 1000, 1000) );
+        CHECK( buf.intact() );
+        CHECK( visa_stub::read_calls() == ncalls + 1 );
+        // END is only received with the last piece
+        CHECK( visa.end_of_message() == (i == 2) );
+    }
+    CHECK( visa_stub::timeout() == 100 );
+
+    // A read stops at the end of a message
+    guarded_buf large(10000);
+    visa_stub::add_response("last\n");
+    CHECK( visa.read_raw(large.get(), large.max_len, 200) == 5 );
+    CHECK( large.str(5) == "next\n" );
+    CHECK( visa_stub::timeout() == 200 );
+    CHECK( visa.read() == "last\n" );
+
+    // Messages larger than the 1 MB internal buffer of older versions
+    string huge = pattern(3 << 20, 1);
+    visa_stub::add_response(huge);
+    guarded_buf hbuf(huge.size());
+    CHECK( (size_t)visa.read_raw(hbuf.get(), hbuf.max_len, 100) ==
+        huge.size() );
+    CHECK( (hbuf.str(huge.size()) == huge) && hbuf.intact() );
+    return;
+}
+
+static void test_read_timeout() {
+    visa_stub::reset();
+    visa_interface visa(visa_stub::s_rsrc_name);
+    guarded_buf buf(1000);
+
+    // Nothing to read
+    io_result<size_t> ret = visa.try_read_raw(buf.get(), buf.max_len, 100);
+    CHECK( (ret.status == io_timeout) && (ret.value == 0) );
+    CHECK( throws<timeout>([&]{ visa.read_raw(buf.get(), buf.max_len, 100);
+        }) );
+
+    // Data received before the timeout is kept
+    visa_stub::add_response("partial", false);
+    ret = visa.try_read_raw(buf.get(), buf.max_len, 100);
+    CHECK( (ret.status == io_timeout) && (ret.value == 7) );
+    CHECK( buf.str(7) == "partial" );
+    visa_stub::add_response("more", false);
+    CHECK( visa.read_raw(buf.get(), buf.max_len, 100) == 4 );
+    CHECK( buf.str(4) == "more" );
+    CHECK( throws<timeout>([&]{ visa.read_raw(buf.get(), buf.max_len, 100);
+        }) );
+    CHECK( buf.intact() );
+    return;
+}
+
+static void test_async() {
+    visa_stub::reset();
+    visa_interface visa(visa_stub::s_rsrc_name);
+
+    // Write completes immediately
+    string cmd = "WAV:DATA?\n";
+    ViJobId wjob = visa.write_async((const uint8_t*)cmd.data(), cmd.size());
+    CHECK( visa.wait_async(wjob, 100) == cmd.size() );
+    CHECK( visa_stub::written() == cmd );
+
+    // Read with data available
+    visa_stub::add_response("0.5\n");
+    guarded_buf buf0(100);
+    ViJobId job0 = visa.read_async(buf0.get(), buf0.max_len);
+    CHECK( visa.wait_async(job0, 100) == 4 );
+    CHECK( buf0.str(4) == "0.5\n" );
+
+    // Two pending reads completed in reverse order
+    guarded_buf buf1(100), buf2(100);
+    ViJobId job1 = visa.read_async(buf1.get(), buf1.max_len);
+    ViJobId job2 = visa.read_async(buf2.get(), buf2.max_len);
+    CHECK( job1 != job2 );
+    CHECK( throws<timeout>([&]{ visa.wait_async(job1, 100); }) );
+    visa_stub::add_response("second\n");
+    CHECK( visa_stub::complete_job(job2) );
+    // Completion of job2 is kept while waiting for job1
+    CHECK( throws<timeout>([&]{ visa.wait_async(job1, 100); }) );
+    visa_stub::add_response("first\n");
+    CHECK( visa_stub::complete_job(job1) );
+    CHECK( visa.wait_async(job1, 100) == 6 );
+    CHECK( visa.wait_async(job2, 100) == 7 );
+    CHECK( (buf1.str(6) == "first\n") && (buf2.str(7) == "second\n") );
+    CHECK( buf1.intact() && buf2.intact() );
+
+    // Bounds of asynchronous reads
+    visa_stub::add_response(pattern(150));
+    ViJobId job3 = visa.read_async(buf0.get(), buf0.max_len);
+    CHECK( visa.wait_async(job3, 100) == 100 );
+    CHECK( buf0.intact() );
+    ViJobId job4 = visa.read_async(buf0.get(), buf0.max_len);
+    CHECK( visa.wait_async(job4, 100) == 50 );
+
+    // Aborted jobs complete with an error
+    ViJobId job5 = visa.read_async(buf0.get(), buf0.max_len);
+    visa.cancel_async(job5);
+    CHECK( throws<bad_io>([&]{ visa.wait_async(job5, 100); }) );
+    CHECK( throws<bad_io>([&]{ visa.cancel_async(job5); }) );
+
+    // Pending jobs and completion events do not leak
+    CHECK( throws<timeout>([&]{ visa.wait_async(job5, 100); }) );
+    CHECK( visa_stub::open_events() == 0 );
+    return;
+}
+
+int main(int argc, char** argv) {
+    test_open_close();
+    test_write();
+    test_read_bounds();
+    test_read_timeout();
+    test_async();
+
+    return test_result();
+}